@@ -361,6 +361,8 @@ void CL_Record_f (void)
 		return;
 	}
 
+	COM_FlushFileIndex ();
+
 	cls.forcetrack = track;
 	fprintf (cls.demofile, "%i\n", cls.forcetrack);
 	
@@ -432,6 +434,10 @@ void CL_Record_f (void)
 
 		CL_WriteDemoMessage();
 
+	// PROTOCOL_DELTA snapshots before now can't be played back, get a full one
+		cl.deltaacked = 0;
+		cl.deltaresync = true;
+
 	// restore net_message
 		net_message->message->data = data;
 		net_message->message->cursize = cursize;
@@ -390,7 +390,7 @@ void CL_SendMove (usercmd_t *cmd)
 			for (i=0 ; i<3 ; i++)
 				MSG_WritePreciseAngle (&buf, cl.viewangles[i]);
 		}
-		else if (cl.protocol == PROTOCOL_FITZQUAKE || cl.protocol == PROTOCOL_MARKV || cl.protocol == PROTOCOL_RMQ) //johnfitz -- 16-bit angles for PROTOCOL_FITZQUAKE
+		else if (cl.protocol == PROTOCOL_FITZQUAKE || cl.protocol == PROTOCOL_MARKV || cl.protocol == PROTOCOL_RMQ || cl.protocol == PROTOCOL_DELTA) //johnfitz -- 16-bit angles for PROTOCOL_FITZQUAKE
 		{
 			for (i=0 ; i<3 ; i++)
 				MSG_WriteAngle16 (&buf, cl.viewangles[i], cl.protocolflags);
@@ -422,6 +422,12 @@ void CL_SendMove (usercmd_t *cmd)
 		
 		MSG_WriteByte (&buf, in_impulse);
 		in_impulse = 0;
+
+	//
+	// send the last entity snapshot we got
+	//
+		if (cl.protocol == PROTOCOL_DELTA)
+			MSG_WriteLong (&buf, cl.deltaacked);
 	}
 
 //
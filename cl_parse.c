@@ -82,12 +82,15 @@ char *svc_strings[] =
 	"?", // 48
 	"?", // 49
 	"svc_skyboxsize", // [coord] size
-	"svc_fogn"		// [byte] enable <optional past this point, only included if enable is true> [float] density [byte] red [byte] green [byte] blue
+	"svc_fogn",		// [byte] enable <optional past this point, only included if enable is true> [float] density [byte] red [byte] green [byte] blue
+	"svc_deltasnapshot" // 52		// [long] sequence [long] delta from
 };
 
 
 extern vec3_t	v_punchangles[2];
 
+static void CL_ClearDelta (void);
+
 qboolean warn_about_nehahra_protocol; //johnfitz
 
 //=============================================================================
@@ -146,7 +149,7 @@ void CL_ParseStartSoundPacket(void)
 		attenuation = DEFAULT_SOUND_PACKET_ATTENUATION;
 
 	//johnfitz -- PROTOCOL_FITZQUAKE
-	if (cl.protocol == PROTOCOL_FITZQUAKE || cl.protocol == PROTOCOL_MARKV || cl.protocol == PROTOCOL_RMQ)
+	if (cl.protocol == PROTOCOL_FITZQUAKE || cl.protocol == PROTOCOL_MARKV || cl.protocol == PROTOCOL_RMQ || cl.protocol == PROTOCOL_DELTA)
 	{
 		if (field_mask & SND_LARGEENTITY)
 		{
@@ -280,23 +283,24 @@ void CL_ParseServerInfo (void)
 // wipe the client_state_t struct
 //
 	CL_ClearState ();
+	CL_ClearDelta ();
 
 // parse protocol version number
 	i = MSG_ReadLong (net_message);
 	if (i == PROTOCOL_BJP || i == PROTOCOL_BJP2 || i == PROTOCOL_BJP3)
 		Con_SafePrintf ("\nusing BJP demo protocol %i\n", i);
 	//johnfitz -- support multiple protocols
-	else if (i != PROTOCOL_NETQUAKE && i != PROTOCOL_FITZQUAKE && i != PROTOCOL_MARKV && i != PROTOCOL_RMQ)
+	else if (i != PROTOCOL_NETQUAKE && i != PROTOCOL_FITZQUAKE && i != PROTOCOL_MARKV && i != PROTOCOL_RMQ && i != PROTOCOL_DELTA)
 	{
 		Con_SafePrintf ("\n"); // because there's no newline after serverinfo print
-		Host_Error ("CL_ParseServerInfo: Server returned unknown protocol version %i, not %i, %i, %i or %i", i, 
-			PROTOCOL_NETQUAKE, PROTOCOL_FITZQUAKE, PROTOCOL_MARKV, PROTOCOL_RMQ);
+		Host_Error ("CL_ParseServerInfo: Server returned unknown protocol version %i, not %i, %i, %i, %i or %i", i, 
+			PROTOCOL_NETQUAKE, PROTOCOL_FITZQUAKE, PROTOCOL_MARKV, PROTOCOL_RMQ, PROTOCOL_DELTA);
 	}
 
 	cl.protocol = i;
 	Con_DPrintf ("Server protocol is %i", i);
 
-	if (cl.protocol == PROTOCOL_RMQ)
+	if (cl.protocol == PROTOCOL_RMQ || cl.protocol == PROTOCOL_DELTA)
 	{
 		unsigned int supportedflags = (PRFL_SHORTANGLE | PRFL_FLOATANGLE | PRFL_24BITCOORD | PRFL_FLOATCOORD | PRFL_EDICTSCALE | PRFL_INT32COORD);
 		
@@ -305,7 +309,7 @@ void CL_ParseServerInfo (void)
 		
 		if (0 != (cl.protocolflags & (~supportedflags)))
 		{
-			Con_Warning("PROTOCOL_RMQ protocolflags %i contains unsupported flags\n", cl.protocolflags);
+			Con_Warning("PROTOCOL_RMQ/PROTOCOL_DELTA protocolflags %i contains unsupported flags\n", cl.protocolflags);
 		}
 	}
 	else
@@ -447,7 +451,7 @@ void CL_ParseUpdate (int bits)
 	}
 
 	//johnfitz -- PROTOCOL_FITZQUAKE
-	if (cl.protocol == PROTOCOL_FITZQUAKE || cl.protocol == PROTOCOL_MARKV || cl.protocol == PROTOCOL_RMQ)
+	if (cl.protocol == PROTOCOL_FITZQUAKE || cl.protocol == PROTOCOL_MARKV || cl.protocol == PROTOCOL_RMQ || cl.protocol == PROTOCOL_DELTA)
 	{
 		if (bits & U_EXTEND1)
 			bits |= MSG_ReadByte (net_message) << 16;
@@ -479,7 +483,7 @@ void CL_ParseUpdate (int bits)
 
 	if (bits & U_MODEL)
 	{
-		if (cl.protocol == PROTOCOL_FITZQUAKE || cl.protocol == PROTOCOL_MARKV || cl.protocol == PROTOCOL_RMQ)
+		if (cl.protocol == PROTOCOL_FITZQUAKE || cl.protocol == PROTOCOL_MARKV || cl.protocol == PROTOCOL_RMQ || cl.protocol == PROTOCOL_DELTA)
 			modnum = MSG_ReadByte (net_message);
 		else if (cl.protocol == PROTOCOL_NETQUAKE)
 			modnum = MSG_ReadByte (net_message);
@@ -578,7 +582,7 @@ void CL_ParseUpdate (int bits)
 	//johnfitz
 
 	//johnfitz -- PROTOCOL_FITZQUAKE
-	if (cl.protocol == PROTOCOL_FITZQUAKE || cl.protocol == PROTOCOL_MARKV || cl.protocol == PROTOCOL_RMQ)
+	if (cl.protocol == PROTOCOL_FITZQUAKE || cl.protocol == PROTOCOL_MARKV || cl.protocol == PROTOCOL_RMQ || cl.protocol == PROTOCOL_DELTA)
 	{
 		if (bits & U_ALPHA)
 			ent->alpha = MSG_ReadByte (net_message);
@@ -666,6 +670,338 @@ void CL_ParseUpdate (int bits)
 	}
 }
 
+/*
+==============================================================================
+
+PROTOCOL_DELTA
+
+The entities of a snapshot are the ones of its base, with the updates of
+the message applied in entity order, and the removed ones left out.
+
+==============================================================================
+*/
+
+static deltahistory_t	cl_delta;
+static qboolean		cl_deltaparsing;	// svc_deltasnapshot came in this message
+static int			cl_deltasequence;
+static deltaframe_t	*cl_deltaframe;		// NULL if the base is gone
+static deltaframe_t	*cl_deltabase;		// NULL for the spawn baselines
+static int			cl_deltaold;		// next entity of the base to merge
+
+/*
+==================
+CL_ClearDelta
+==================
+*/
+static void CL_ClearDelta (void)
+{
+	Delta_Clear (&cl_delta);
+	cl_delta.sequence = 0;
+	cl_deltaparsing = false;
+}
+
+/*
+==================
+CL_SetDeltaEntity
+
+CL_ParseUpdate for an entity of the snapshot, whether it was sent or not
+==================
+*/
+static void CL_SetDeltaEntity (deltaentity_t *s)
+{
+	int			i;
+	model_t		*model;
+	qboolean	forcelink;
+	entity_t	*ent;
+
+	ent = CL_EntityNum (s->num);
+
+	if (ent->msgtime != cl.mtime[1])
+		forcelink = true;	// no previous frame to lerp from
+	else
+		forcelink = false;
+
+	if (ent->msgtime + 0.2 < cl.mtime[0]) //more than 0.2 seconds since the last message (most entities think every 0.1 sec)
+		ent->lerpflags |= LERP_RESETANIM; //if we missed a think, we'd be lerping from the wrong frame
+
+	ent->msgtime = cl.mtime[0];
+
+	ent->frame = s->state.frame;
+
+	i = s->state.colormap;
+	if (!i)
+		ent->colormap = vid.colormap;
+	else
+	{
+		if (i > cl.maxclients)
+			Host_Error ("CL_SetDeltaEntity: invalid colormap (%d, max = %d)", i, cl.maxclients);
+		ent->colormap = cl.scores[i-1].translations;
+	}
+
+	if (s->state.skin != ent->skinnum)
+	{
+		// skin has changed
+		ent->skinnum = s->state.skin;
+		if (s->num > 0 && s->num <= cl.maxclients)
+			R_TranslateNewPlayerSkin (s->num - 1);
+	}
+
+	ent->effects = s->state.effects;
+
+// shift the known values for interpolation
+	VectorCopy (ent->msg_origins[0], ent->msg_origins[1]);
+	VectorCopy (ent->msg_angles[0], ent->msg_angles[1]);
+	VectorCopy (s->state.origin, ent->msg_origins[0]);
+	VectorCopy (s->state.angles, ent->msg_angles[0]);
+
+	if (s->flags & U_STEP)
+	{
+		ent->lerpflags |= LERP_MOVESTEP;
+		ent->forcelink = true;
+	}
+	else
+		ent->lerpflags &= ~LERP_MOVESTEP;
+
+	ent->alpha = s->state.alpha;
+	ent->scale = s->state.scale;
+
+	if (s->flags & U_LERPFINISH)
+	{
+		ent->lerpfinish = ent->msgtime + ((float)s->lerpfinish / 255);
+		ent->lerpflags |= LERP_FINISH;
+	}
+	else
+		ent->lerpflags &= ~LERP_FINISH;
+
+	model = cl.model_precache[s->state.modelindex];
+	if (model != ent->model)
+	{
+		ent->model = model;
+
+		// automatic animation (torches, etc) can be either all together
+		// or randomized
+		if (model)
+		{
+			if (model->synctype == ST_RAND)
+				ent->syncbase = (float)(rand()&0x7fff) / 0x7fff;
+			else
+				ent->syncbase = 0.0;
+		}
+		else
+			forcelink = true;	// hack to make null model players work
+
+		if (s->num > 0 && s->num <= cl.maxclients)
+			R_TranslateNewPlayerSkin (s->num - 1);
+
+		ent->lerpflags |= LERP_RESETANIM; // don't lerp animation across model changes
+	}
+
+	if (forcelink)
+	{	// didn't have an update last message
+		VectorCopy (ent->msg_origins[0], ent->msg_origins[1]);
+		VectorCopy (ent->msg_origins[0], ent->origin);
+		VectorCopy (ent->msg_angles[0], ent->msg_angles[1]);
+		VectorCopy (ent->msg_angles[0], ent->angles);
+		ent->forcelink = true;
+	}
+}
+
+/*
+==================
+CL_KeepDeltaEntity
+==================
+*/
+static void CL_KeepDeltaEntity (deltaentity_t *s)
+{
+	if (cl_deltaframe && Delta_AddEntity (&cl_delta, cl_deltaframe, s))
+		CL_SetDeltaEntity (DELTA_ENT(&cl_delta, cl_deltaframe->first + cl_deltaframe->count - 1));
+}
+
+/*
+==================
+CL_CarryDeltaEntities
+
+The base entities before num weren't mentioned, so they didn't change
+==================
+*/
+static void CL_CarryDeltaEntities (int num)
+{
+	deltaentity_t	*old;
+
+	if (!cl_deltabase)
+		return;
+
+	for ( ; cl_deltaold < cl_deltabase->count ; cl_deltaold++)
+	{
+		old = DELTA_ENT(&cl_delta, cl_deltabase->first + cl_deltaold);
+		if (old->num >= num)
+			break;
+		CL_KeepDeltaEntity (old);
+	}
+}
+
+/*
+==================
+CL_ParseDeltaSnapshot
+==================
+*/
+static void CL_ParseDeltaSnapshot (void)
+{
+	int		from;
+
+	if (cls.signon == SIGNONS - 1)
+	{	// first update is the final signon stage
+		cls.signon = SIGNONS;
+		CL_SignonReply ();
+	}
+
+	cl_deltasequence = MSG_ReadLong (net_message);
+	from = MSG_ReadLong (net_message);
+
+	cl_deltaparsing = true;
+	cl_deltaframe = NULL;
+	cl_deltabase = NULL;
+	cl_deltaold = 0;
+
+	if (cl_deltasequence <= cl_delta.sequence)
+		return;		// out of order
+
+	if (from)
+	{
+		cl_deltabase = Delta_BaseFrame (&cl_delta, from, cl_deltasequence);
+		if (!cl_deltabase)
+		{
+			Con_DPrintf ("CL_ParseDeltaSnapshot: snapshot %i is gone, waiting for a full one\n", from);
+			cl.deltaacked = 0;
+			return;
+		}
+	}
+
+	cl_deltaframe = Delta_BeginFrame (&cl_delta, cl_deltasequence);
+}
+
+/*
+==================
+CL_ParseDeltaUpdate
+
+An entity of the current snapshot, the fields that aren't sent are the
+ones it had in the base
+==================
+*/
+static void CL_ParseDeltaUpdate (int bits)
+{
+	int		num;
+	deltaentity_t	*from, to;
+
+	if (!cl_deltaparsing)
+		Host_Error ("CL_ParseDeltaUpdate: update outside of a snapshot");
+
+	if (bits & U_MOREBITS)
+		bits |= MSG_ReadByte (net_message) << 8;
+	if (bits & U_EXTEND1)
+		bits |= MSG_ReadByte (net_message) << 16;
+	if (bits & U_EXTEND2)
+		bits |= MSG_ReadByte (net_message) << 24;
+
+	if (bits & U_LONGENTITY)
+		num = MSG_ReadShort (net_message);
+	else
+		num = MSG_ReadByte (net_message);
+
+	if (num < 1 || num >= MAX_EDICTS)
+		Host_Error ("CL_ParseDeltaUpdate: invalid edict number (%d, max = %d)", num, MAX_EDICTS);
+
+	CL_CarryDeltaEntities (num);
+
+	from = NULL;
+	if (cl_deltabase && cl_deltaold < cl_deltabase->count)
+	{
+		from = DELTA_ENT(&cl_delta, cl_deltabase->first + cl_deltaold);
+		if (from->num == num)
+			cl_deltaold++;
+		else
+			from = NULL;
+	}
+
+	if (bits & U_REMOVE)
+		return;
+
+	if (from)
+		to = *from;
+	else
+	{
+		to.state = CL_EntityNum (num)->baseline;
+		to.num = num;
+	}
+
+	if (bits & U_MODEL)
+		to.state.modelindex = MSG_ReadByte (net_message);
+	if (bits & U_FRAME)
+		to.state.frame = MSG_ReadByte (net_message);
+	if (bits & U_COLORMAP)
+		to.state.colormap = MSG_ReadByte (net_message);
+	if (bits & U_SKIN)
+		to.state.skin = MSG_ReadByte (net_message);
+	if (bits & U_EFFECTS)
+		to.state.effects = MSG_ReadByte (net_message);
+	if (bits & U_ORIGIN1)
+		to.state.origin[0] = MSG_ReadCoord (net_message, cl.protocolflags);
+	if (bits & U_ANGLE1)
+		to.state.angles[0] = MSG_ReadAngle (net_message, cl.protocolflags);
+	if (bits & U_ORIGIN2)
+		to.state.origin[1] = MSG_ReadCoord (net_message, cl.protocolflags);
+	if (bits & U_ANGLE2)
+		to.state.angles[1] = MSG_ReadAngle (net_message, cl.protocolflags);
+	if (bits & U_ORIGIN3)
+		to.state.origin[2] = MSG_ReadCoord (net_message, cl.protocolflags);
+	if (bits & U_ANGLE3)
+		to.state.angles[2] = MSG_ReadAngle (net_message, cl.protocolflags);
+	if (bits & U_ALPHA)
+		to.state.alpha = MSG_ReadByte (net_message);
+	if (bits & U_SCALE)
+		to.state.scale = MSG_ReadByte (net_message);
+	if (bits & U_FRAME2)
+		to.state.frame = (to.state.frame & 0x00FF) | (MSG_ReadByte (net_message) << 8);
+	if (bits & U_MODEL2)
+		to.state.modelindex = (to.state.modelindex & 0x00FF) | (MSG_ReadByte (net_message) << 8);
+
+	to.flags = bits & (U_STEP | U_LERPFINISH);
+	to.lerpfinish = (bits & U_LERPFINISH) ? MSG_ReadByte (net_message) : 0;
+
+	if (to.state.modelindex >= MAX_MODELS)
+		Host_Error ("CL_ParseDeltaUpdate: invalid model (%d, max = %d)", to.state.modelindex, MAX_MODELS);
+
+	CL_KeepDeltaEntity (&to);
+}
+
+/*
+==================
+CL_FinishDeltaSnapshot
+
+Called at the end of the message, the ack goes out with the next clc_move
+==================
+*/
+static void CL_FinishDeltaSnapshot (void)
+{
+	if (!cl_deltaparsing)
+		return;
+	cl_deltaparsing = false;
+
+	CL_CarryDeltaEntities (MAX_EDICTS);
+
+	if (!cl_deltaframe)
+		return;
+
+	Delta_EndFrame (&cl_delta, cl_deltaframe, cl_deltasequence);
+
+	// a demo started in the middle waits for one it can be played from
+	if (!cl.deltaresync || !cl_deltabase)
+	{
+		cl.deltaacked = cl_deltasequence;
+		cl.deltaresync = false;
+	}
+}
+
 /*
 ==================
 CL_ParseBaseline
@@ -679,7 +1015,7 @@ void CL_ParseBaseline (entity_t *ent, int version) //johnfitz -- added argument
 	bits = (version == 2) ? MSG_ReadByte (net_message) : 0;
 
 	//johnfitz -- PROTOCOL_FITZQUAKE
-	if (cl.protocol == PROTOCOL_FITZQUAKE || cl.protocol == PROTOCOL_MARKV || cl.protocol == PROTOCOL_RMQ)
+	if (cl.protocol == PROTOCOL_FITZQUAKE || cl.protocol == PROTOCOL_MARKV || cl.protocol == PROTOCOL_RMQ || cl.protocol == PROTOCOL_DELTA)
 	{
 		ent->baseline.modelindex = (bits & B_LARGEMODEL) ? MSG_ReadShort (net_message) : MSG_ReadByte (net_message);
 		ent->baseline.frame = (bits & B_LARGEFRAME) ? MSG_ReadShort (net_message) : MSG_ReadByte (net_message);
@@ -706,7 +1042,7 @@ void CL_ParseBaseline (entity_t *ent, int version) //johnfitz -- added argument
 	}
 
 	//johnfitz -- PROTOCOL_FITZQUAKE
-	if (cl.protocol == PROTOCOL_FITZQUAKE || cl.protocol == PROTOCOL_MARKV || cl.protocol == PROTOCOL_RMQ)
+	if (cl.protocol == PROTOCOL_FITZQUAKE || cl.protocol == PROTOCOL_MARKV || cl.protocol == PROTOCOL_RMQ || cl.protocol == PROTOCOL_DELTA)
 	{
 		ent->baseline.alpha = (bits & B_ALPHA) ? MSG_ReadByte (net_message) : ENTALPHA_DEFAULT;
 		ent->baseline.scale = (bits & B_SCALE) ? MSG_ReadByte (net_message) : ENTSCALE_DEFAULT;
@@ -734,7 +1070,7 @@ void CL_ParseClientdata (void)
 	bits = (unsigned short)MSG_ReadShort (net_message); // read bits here isntead of in CL_ParseServerMessage()
 
 	//johnfitz -- PROTOCOL_FITZQUAKE
-	if (cl.protocol == PROTOCOL_FITZQUAKE || cl.protocol == PROTOCOL_MARKV || cl.protocol == PROTOCOL_RMQ)
+	if (cl.protocol == PROTOCOL_FITZQUAKE || cl.protocol == PROTOCOL_MARKV || cl.protocol == PROTOCOL_RMQ || cl.protocol == PROTOCOL_DELTA)
 	{
 		if (bits & SU_EXTEND1)
 			bits |= (MSG_ReadByte (net_message) << 16);
@@ -805,7 +1141,7 @@ void CL_ParseClientdata (void)
 
 	if (bits & SU_WEAPON)
 	{
-		if (cl.protocol == PROTOCOL_FITZQUAKE || cl.protocol == PROTOCOL_MARKV || cl.protocol == PROTOCOL_RMQ)
+		if (cl.protocol == PROTOCOL_FITZQUAKE || cl.protocol == PROTOCOL_MARKV || cl.protocol == PROTOCOL_RMQ || cl.protocol == PROTOCOL_DELTA)
 			i = MSG_ReadByte (net_message);
 		else if (cl.protocol == PROTOCOL_NETQUAKE)
 			i = MSG_ReadByte (net_message);
@@ -869,7 +1205,7 @@ void CL_ParseClientdata (void)
 	}
 
 	//johnfitz -- PROTOCOL_FITZQUAKE
-	if (cl.protocol == PROTOCOL_FITZQUAKE || cl.protocol == PROTOCOL_MARKV || cl.protocol == PROTOCOL_RMQ)
+	if (cl.protocol == PROTOCOL_FITZQUAKE || cl.protocol == PROTOCOL_MARKV || cl.protocol == PROTOCOL_RMQ || cl.protocol == PROTOCOL_DELTA)
 	{
 		if (bits & SU_WEAPON2)
 			cl.stats[STAT_WEAPON] |= (MSG_ReadByte(net_message) << 8);
@@ -983,7 +1319,7 @@ void CL_ParseStaticSound (int version) //johnfitz -- added argument
 		org[i] = MSG_ReadCoord (net_message, cl.protocolflags);
 
 	//johnfitz -- PROTOCOL_FITZQUAKE
-	if (cl.protocol == PROTOCOL_FITZQUAKE || cl.protocol == PROTOCOL_MARKV || cl.protocol == PROTOCOL_RMQ)
+	if (cl.protocol == PROTOCOL_FITZQUAKE || cl.protocol == PROTOCOL_MARKV || cl.protocol == PROTOCOL_RMQ || cl.protocol == PROTOCOL_DELTA)
 	{
 		if (version == 2)
 			sound_num = MSG_ReadShort (net_message);
@@ -1075,6 +1411,7 @@ void CL_ParseServerMessage (void)
 		if (cmd == -1)
 		{
 			SHOWNET("END OF MESSAGE");
+			CL_FinishDeltaSnapshot ();
 			return;		// end of message
 		}
 
@@ -1082,7 +1419,10 @@ void CL_ParseServerMessage (void)
 		if (cmd & U_SIGNAL) // was 128, changed for clarity
 		{
 			SHOWNET("fast update");
-			CL_ParseUpdate (cmd&127);
+			if (cl.protocol == PROTOCOL_DELTA)
+				CL_ParseDeltaUpdate (cmd&127);
+			else
+				CL_ParseUpdate (cmd&127);
 			continue;
 		}
 
@@ -1116,9 +1456,9 @@ void CL_ParseServerMessage (void)
 			if (i == PROTOCOL_BJP || i == PROTOCOL_BJP2 || i == PROTOCOL_BJP3)
 				Con_SafePrintf ("using BJP demo protocol version %i\n", i);
 			//johnfitz -- support multiple protocols
-			else if (i != PROTOCOL_NETQUAKE && i != PROTOCOL_FITZQUAKE && i != PROTOCOL_MARKV && i != PROTOCOL_RMQ)
-				Host_Error ("CL_ParseServerMessage: Server protocol is %i instead of %i, %i, %i or %i", i, 
-					PROTOCOL_NETQUAKE, PROTOCOL_FITZQUAKE, PROTOCOL_MARKV, PROTOCOL_RMQ);
+			else if (i != PROTOCOL_NETQUAKE && i != PROTOCOL_FITZQUAKE && i != PROTOCOL_MARKV && i != PROTOCOL_RMQ && i != PROTOCOL_DELTA)
+				Host_Error ("CL_ParseServerMessage: Server protocol is %i instead of %i, %i, %i, %i or %i", i, 
+					PROTOCOL_NETQUAKE, PROTOCOL_FITZQUAKE, PROTOCOL_MARKV, PROTOCOL_RMQ, PROTOCOL_DELTA);
 			cl.protocol = i;
 			Con_DPrintf ("Using protocol version %i\n", cl.protocol);
 			//johnfitz
@@ -1400,6 +1740,10 @@ void CL_ParseServerMessage (void)
 				R_FogParseServerMessage2 ();
 			} 
 			break;
+
+		case svc_deltasnapshot:
+			CL_ParseDeltaSnapshot ();
+			break;
 		}
 	}
 }
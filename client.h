@@ -318,6 +318,9 @@ typedef struct
 
 	int			protocol;
 	unsigned	protocolflags;
+
+	int			deltaacked;		// PROTOCOL_DELTA snapshot sent back in clc_move, 0 asks for a full one
+	qboolean	deltaresync;	// don't ack until a full snapshot comes in
     
 } client_state_t;
 
@@ -31,12 +31,14 @@ static char     *safeargvs[NUM_SAFE_ARGVS] =
 
 cvar_t  registered = {"registered","0", CVAR_ROM};
 cvar_t  cmdline = {"cmdline","", CVAR_ROM};
+cvar_t  com_mapfiles = {"com_mapfiles","1", CVAR_NONE};
 
 qboolean        com_modified;   // set true if using non-id files
 
 
 void COM_InitFilesystem (void);
 void COM_Path_f (void);
+void COM_PathFlush_f (void);
 void COM_Game_f (void);
 
 // if a packfile directory differs from this, it is assumed to be hacked
@@ -155,6 +157,24 @@ size_t Q_strnlen (const char *s, size_t maxlen)
     return i;
 } 
 
+/*
+	COM_HashString
+	case-insensitive FNV-1a hash, so names differing only by case
+	land in the same chain
+*/
+unsigned int COM_HashString (const char *s)
+{
+	unsigned int hash = 2166136261u;
+
+	for ( ; *s ; s++)
+	{
+		hash ^= (unsigned int)tolower((unsigned char)*s);
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
 /*
 ============================================================================
 
@@ -561,6 +581,98 @@ float MSG_ReadAngle16 (qmsg_t *msg, unsigned int flags)
 
 //===========================================================================
 
+/*
+==================
+Delta_Clear
+
+Forgets all snapshots, the sequence keeps counting
+==================
+*/
+void Delta_Clear (deltahistory_t *hist)
+{
+	int		i;
+
+	for (i=0 ; i<DELTA_BACKUP ; i++)
+		hist->frames[i].sequence = 0;
+	hist->poolhead = 0;
+	hist->dropped = 0;
+}
+
+/*
+==================
+Delta_BaseFrame
+
+Returns the kept snapshot base if snapshot sequence can be built on it: its
+slot isn't the one sequence goes in, and its entities survive adding up to
+DELTA_MAXENTS more to the pool
+==================
+*/
+deltaframe_t *Delta_BaseFrame (deltahistory_t *hist, int base, int sequence)
+{
+	deltaframe_t	*frame;
+
+	if (base <= 0 || base >= sequence || sequence - base >= DELTA_BACKUP)
+		return NULL;
+
+	frame = &hist->frames[base & (DELTA_BACKUP-1)];
+	if (frame->sequence != base)
+		return NULL;
+	if (hist->poolhead + DELTA_MAXENTS - frame->first > DELTA_POOL)
+		return NULL;
+
+	return frame;
+}
+
+/*
+==================
+Delta_BeginFrame
+==================
+*/
+deltaframe_t *Delta_BeginFrame (deltahistory_t *hist, int sequence)
+{
+	deltaframe_t	*frame;
+
+	frame = &hist->frames[sequence & (DELTA_BACKUP-1)];
+	frame->sequence = 0;	// not a base until it is complete
+	frame->first = hist->poolhead;
+	frame->count = 0;
+	hist->dropped = 0;
+
+	return frame;
+}
+
+/*
+==================
+Delta_AddEntity
+
+Entities have to be added in increasing order, returns false once the
+snapshot is full
+==================
+*/
+qboolean Delta_AddEntity (deltahistory_t *hist, deltaframe_t *frame, deltaentity_t *state)
+{
+	if (frame->count == DELTA_MAXENTS)
+		return false;
+
+	*DELTA_ENT(hist, frame->first + frame->count) = *state;
+	frame->count++;
+	return true;
+}
+
+/*
+==================
+Delta_EndFrame
+==================
+*/
+void Delta_EndFrame (deltahistory_t *hist, deltaframe_t *frame, int sequence)
+{
+	frame->sequence = sequence;
+	hist->sequence = sequence;
+	hist->poolhead += frame->count;
+}
+
+//===========================================================================
+
 void SZ_Alloc (sizebuf_t *buf, int startsize)
 {
 	if (startsize < 256)
@@ -878,6 +990,8 @@ void COM_CheckRegistered (void)
 
 	Cvar_SetROM ("registered", "1");
 	Con_Printf ("Playing registered version.\n");
+
+	COM_FlushFileIndex (); // directory walks are allowed now
 }
 
 
@@ -989,7 +1103,9 @@ void COM_Init (void)
 
 	Cvar_RegisterVariable (&registered);
 	Cvar_RegisterVariable (&cmdline);
+	Cvar_RegisterVariable (&com_mapfiles);
 	Cmd_AddCommand ("path", COM_Path_f);
+	Cmd_AddCommand ("path_flush", COM_PathFlush_f);
 	Cmd_AddCommand ("game", COM_Game_f); //johnfitz
 
 	COM_InitFilesystem ();
@@ -1244,6 +1360,25 @@ char    *homedir = NULL;
 searchpath_t    *com_searchpaths;
 searchpath_t	*com_base_searchpaths;
 
+#define	FILEINDEX_HASH_SIZE	1024	// must be a power of two
+#define	MAX_FILEINDEX		4096	// names remembered, must be a power of two
+
+typedef struct fileindex_s
+{
+	char			name[MAX_QPATH];
+	searchpath_t		*search;	// owning search path, NULL if the name was not found
+	int			fileindex;	// index into search->pack->files, -1 for a loose file
+	int			bucket;
+	struct fileindex_s	*next;
+} fileindex_t;
+
+fileindex_t	*com_fileindex[FILEINDEX_HASH_SIZE];
+fileindex_t	com_fileindexpool[MAX_FILEINDEX];
+int		com_fileindex_count;
+int		com_fileindex_next;	// next pool entry to hand out
+int		com_fileindex_hits;
+int		com_fileindex_misses;
+
 /*
 ============
 COM_Path_f
@@ -1262,6 +1397,8 @@ void COM_Path_f (void)
 		else
 			Con_Printf ("%s\n", s->filename);
 	}
+
+	Con_Printf ("File index: %i names, %i hits, %i misses\n", com_fileindex_count, com_fileindex_hits, com_fileindex_misses);
 }
 
 /*
@@ -1291,6 +1428,8 @@ void COM_WriteFile (char *filename, void *data, int len)
 
 	Sys_FileWrite (handle, data, len);
 	Sys_FileClose (handle);
+
+	COM_FlushFileIndex ();
 }
 
 /*
@@ -1346,6 +1485,188 @@ void COM_CopyFile (char *netpath, char *cachepath)
 	Sys_FileClose (out);    
 }
 
+/*
+=============================================================================
+
+FILE INDEX
+
+Every name looked up through COM_FindFile is remembered here with the
+search path that owns it, or the fact that none does, so repeated lookups
+don't walk the search path again.  Entries live until the search path
+changes or the engine writes a file into the game directory.  The walk
+itself uses the per pak directory hash built in COM_LoadPackFile.
+
+=============================================================================
+*/
+
+/*
+============
+COM_FlushFileIndex
+
+Forgets every resolved name; called whenever the search path
+or the contents of a loose game directory may have changed
+============
+*/
+void COM_FlushFileIndex (void)
+{
+	memset (com_fileindex, 0, sizeof(com_fileindex));
+	com_fileindex_count = 0;
+	com_fileindex_next = 0;
+}
+
+/*
+============
+COM_AllocFileIndex
+
+Hands out the next pool entry, unhashing it first if the pool has
+wrapped around
+============
+*/
+fileindex_t *COM_AllocFileIndex (void)
+{
+	fileindex_t	*entry, **link;
+
+	entry = &com_fileindexpool[com_fileindex_next];
+	com_fileindex_next = (com_fileindex_next + 1) & (MAX_FILEINDEX-1);
+
+	if (com_fileindex_count < MAX_FILEINDEX)
+	{
+		com_fileindex_count++;
+		return entry;
+	}
+
+	for (link = &com_fileindex[entry->bucket] ; *link ; link = &(*link)->next)
+	{
+		if (*link == entry)
+		{
+			*link = entry->next;
+			break;
+		}
+	}
+
+	return entry;
+}
+
+/*
+============
+COM_FindPackFile
+
+Returns the index of filename inside the pak, or -1
+============
+*/
+int COM_FindPackFile (pack_t *pak, char *filename, unsigned int hash)
+{
+	int		i;
+
+	for (i = pak->hashtable[hash & (PACK_HASH_SIZE-1)] ; i != -1 ; i = pak->files[i].hashnext)
+		if (!strcmp(pak->files[i].name, filename))
+			return i;
+
+	return -1;
+}
+
+/*
+============
+COM_ResolveFile
+
+Walks the search path for filename, the slow path behind the file index
+============
+*/
+searchpath_t *COM_ResolveFile (char *filename, unsigned int hash, int *fileindex)
+{
+	searchpath_t	*search;
+	char		netpath[MAX_OSPATH];
+	int		i;
+
+	for (search = com_searchpaths ; search ; search = search->next)
+	{
+	// is the element a pak file?
+		if (search->pack)
+		{
+			i = COM_FindPackFile (search->pack, filename, hash);
+			if (i == -1)
+				continue;
+
+			*fileindex = i;
+			return search;
+		}
+		else
+		{
+	// check a file in the directory tree
+			if (!registered.value)
+			{	// if not a registered version, don't ever go beyond base
+				if ( strchr (filename, '/') || strchr (filename,'\\'))
+					continue;
+			}
+
+			sprintf (netpath, "%s/%s",search->filename, filename);
+
+			if (Sys_FileTime (netpath) == -1)
+				continue;
+
+			*fileindex = -1;
+			return search;
+		}
+	}
+
+	*fileindex = -1;
+	return NULL;
+}
+
+/*
+============
+COM_LookupFile
+
+Returns the cached resolution of filename, resolving it on first use
+============
+*/
+searchpath_t *COM_LookupFile (char *filename, int *fileindex)
+{
+	fileindex_t	*entry;
+	unsigned int	hash;
+	int		bucket;
+
+	hash = COM_HashString (filename);
+
+	// too long to be a quake path, don't bother remembering it
+	if (strlen(filename) >= MAX_QPATH)
+		return COM_ResolveFile (filename, hash, fileindex);
+
+	bucket = hash & (FILEINDEX_HASH_SIZE-1);
+	for (entry = com_fileindex[bucket] ; entry ; entry = entry->next)
+	{
+		if (!strcmp(entry->name, filename))
+		{
+			com_fileindex_hits++;
+			*fileindex = entry->fileindex;
+			return entry->search;
+		}
+	}
+
+	com_fileindex_misses++;
+
+	entry = COM_AllocFileIndex ();
+	strcpy (entry->name, filename);
+	entry->search = COM_ResolveFile (filename, hash, &entry->fileindex);
+	entry->bucket = bucket;
+	entry->next = com_fileindex[bucket];
+	com_fileindex[bucket] = entry;
+
+	*fileindex = entry->fileindex;
+	return entry->search;
+}
+
+/*
+============
+COM_PathFlush_f
+============
+*/
+void COM_PathFlush_f (void)
+{
+	COM_FlushFileIndex ();
+	Con_Printf ("File index flushed\n");
+}
+
 /*
 ===========
 COM_FindFile
@@ -1369,57 +1690,48 @@ int COM_FindFile (char *filename, int *handle, FILE **file, unsigned int *path_i
 		Sys_Error ("COM_FindFile: neither handle or file set");
 
 //
-// search through the path, one element at a time
+// look the name up in the file index
 //
-	search = com_searchpaths;
-	for ( ; search ; search = search->next)
+	search = COM_LookupFile (filename, &i);
+	if (search)
 	{
 	// is the element a pak file?
 		if (search->pack)
 		{
-		// look through all the pak file elements
 			pak = search->pack;
-			for (i=0 ; i<pak->numfiles ; i++)
-			{
-				if (strcmp(pak->files[i].name, filename))
-					continue;
 
-				// found it!
-				if (developer.value > 3)
-					Con_DPrintf ("PackFile: %s : %s\n",pak->filename, filename);
+			// found it!
+			if (developer.value > 3)
+				Con_DPrintf ("PackFile: %s : %s\n",pak->filename, filename);
 
-				if (path_id)
-					*path_id = search->path_id;
+			if (path_id)
+				*path_id = search->path_id;
 
-				if (handle)
-				{
-					*handle = pak->handle;
-					Sys_FileSeek (pak->handle, pak->files[i].filepos);
-				}
-				else
-				{	// open a new file on the pakfile
-					*file = fopen (pak->filename, "rb");
-					if (*file)
-						fseek (*file, pak->files[i].filepos, SEEK_SET);
-				}
-				com_filesize = pak->files[i].filelen;
-				return com_filesize;
+			if (handle)
+			{
+				*handle = pak->handle;
+				Sys_FileSeek (pak->handle, pak->files[i].filepos);
+			}
+			else
+			{	// open a new file on the pakfile
+				*file = fopen (pak->filename, "rb");
+				if (*file)
+					fseek (*file, pak->files[i].filepos, SEEK_SET);
 			}
+			com_filesize = pak->files[i].filelen;
+			return com_filesize;
 		}
 		else
 		{
 	// check a file in the directory tree
-			if (!registered.value)
-			{	// if not a registered version, don't ever go beyond base
-				if ( strchr (filename, '/') || strchr (filename,'\\'))
-					continue;
-			}
-
 			sprintf (netpath, "%s/%s",search->filename, filename);
 
 			findtime = Sys_FileTime (netpath);
 			if (findtime == -1)
-				continue;
+			{	// removed behind our back, resolve it again
+				COM_FlushFileIndex ();
+				return COM_FindFile (filename, handle, file, path_id);
+			}
 
 		// see if the file needs to be updated in the cache
 			if (!com_cachedir[0])
@@ -1638,6 +1950,134 @@ byte *COM_LoadMallocFile (char *path, void *buffer, unsigned int *path_id)
 	return COM_LoadFile (path, LOADFILE_MALLOC, path_id);
 }
 
+/*
+============
+COM_MapFile
+
+Maps the file (or its slice of a pak file) straight into memory, so that
+large files can be parsed in place instead of being read into a buffer.
+The view is private, loaders may still swap data in place.  Unlike
+COM_LoadFile no 0 byte is appended.
+
+Returns NULL if com_mapfiles is off or the file can't be mapped,
+the caller then falls back to one of the COM_Load* functions.
+============
+*/
+#define	MAX_FILEMAPS	16
+
+typedef struct
+{
+	byte	*data;
+	int		offset, length;
+} filemap_t;
+
+filemap_t	com_filemaps[MAX_FILEMAPS];
+
+byte *COM_MapFile (char *path, unsigned int *path_id)
+{
+	searchpath_t	*search;
+	filemap_t		*map;
+	char			netpath[MAX_OSPATH];
+	int				i, h, offset, length;
+
+	if (!com_mapfiles.value)
+		return NULL;
+
+	for (i=0, map=com_filemaps ; i<MAX_FILEMAPS ; i++, map++)
+		if (!map->data)
+			break;
+	if (i == MAX_FILEMAPS)
+		return NULL;
+
+	search = COM_LookupFile (path, &i);
+	if (!search)
+		return NULL;
+
+	if (search->pack)
+	{
+		strcpy (netpath, search->pack->filename);
+		offset = search->pack->files[i].filepos;
+		length = search->pack->files[i].filelen;
+	}
+	else
+	{
+		if (com_cachedir[0])
+			return NULL;	// let COM_FindFile refresh the cache copy
+
+		sprintf (netpath, "%s/%s", search->filename, path);
+		offset = 0;
+		length = Sys_FileOpenRead (netpath, &h);
+		if (length == -1)
+			return NULL;
+		Sys_FileClose (h);
+	}
+
+	// the loaders read ints and floats straight out of the buffer
+	if (!length || (offset & 3))
+		return NULL;
+
+	map->data = Sys_MapFile (netpath, offset, length);
+	if (!map->data)
+		return NULL;
+
+	map->offset = offset;
+	map->length = length;
+
+	if (developer.value > 3)
+		Con_DPrintf ("MapFile: %s : %s\n", netpath, path);
+
+	if (path_id)
+		*path_id = search->path_id;
+
+	com_filesize = length;
+	return map->data;
+}
+
+/*
+============
+COM_UnmapFile
+
+Releases a view returned by COM_MapFile, anything else is ignored
+============
+*/
+void COM_UnmapFile (byte *data)
+{
+	filemap_t	*map;
+	int			i;
+
+	for (i=0, map=com_filemaps ; i<MAX_FILEMAPS ; i++, map++)
+	{
+		if (map->data == data)
+		{
+			Sys_UnmapFile (map->data, map->offset, map->length);
+			map->data = NULL;
+			return;
+		}
+	}
+}
+
+/*
+============
+COM_UnmapAllFiles
+
+Releases the views left behind by a load aborted with Host_Error
+============
+*/
+void COM_UnmapAllFiles (void)
+{
+	filemap_t	*map;
+	int			i;
+
+	for (i=0, map=com_filemaps ; i<MAX_FILEMAPS ; i++, map++)
+	{
+		if (map->data)
+		{
+			Sys_UnmapFile (map->data, map->offset, map->length);
+			map->data = NULL;
+		}
+	}
+}
+
 /*
 =================
 COM_LoadPackFile -- johnfitz -- modified based on topaz's tutorial
@@ -1658,6 +2098,7 @@ pack_t *COM_LoadPackFile (char *filename)
 	int                             packhandle;
 	dpackfile_t             info[MAX_FILES_IN_PACK];
 	unsigned short          crc;
+	int                             hash;
 
 	if (Sys_FileOpenRead (filename, &packhandle) == -1)
 	{
@@ -1720,6 +2161,17 @@ pack_t *COM_LoadPackFile (char *filename)
 	pack->numfiles = numpackfiles;
 	pack->files = newfiles;
 
+// hash the directory, walking it backwards so that the first of
+// any duplicated names heads its chain, as with the old linear search
+	for (i=0 ; i<PACK_HASH_SIZE ; i++)
+		pack->hashtable[i] = -1;
+	for (i=numpackfiles-1 ; i>=0 ; i--)
+	{
+		hash = COM_HashString (newfiles[i].name) & (PACK_HASH_SIZE-1);
+		newfiles[i].hashnext = pack->hashtable[hash];
+		pack->hashtable[hash] = i;
+	}
+
 	Con_Printf ("Added packfile %s (%i files)\n", filename, numpackfiles);
 	return pack;
 }
@@ -1777,6 +2229,8 @@ void COM_AddDirectory (char *dir)
 		search->next = com_searchpaths;
 		com_searchpaths = search;
 	}
+
+	COM_FlushFileIndex ();
 }
 
 /*
@@ -1951,6 +2405,7 @@ void COM_Game_f (void)
 			Z_Free (com_searchpaths);
 			com_searchpaths = search;
 		}
+		COM_FlushFileIndex ();
 		
 		com_modified = true;
 		
@@ -2302,6 +2757,7 @@ void COM_InitFilesystem (void)
 			search->next = com_searchpaths;
 			com_searchpaths = search;
 		}
+		COM_FlushFileIndex ();
 	}
 }
 
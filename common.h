@@ -106,6 +106,9 @@ size_t Q_strnlen (const char *s, size_t maxlen);
 #define strnlen Q_strnlen
 #endif
 
+unsigned int COM_HashString (const char *s);
+// case-insensitive string hash, the caller masks it to the table size
+
 //============================================================================
 
 extern	qboolean		bigendian;
@@ -215,14 +218,18 @@ typedef struct
 {
 	char    name[MAX_QPATH];
 	int             filepos, filelen;
+	int             hashnext;	// next file in the same hash chain, -1 ends the chain
 } packfile_t;
 
+#define PACK_HASH_SIZE          1024	// must be a power of two
+
 typedef struct pack_s
 {
 	char    filename[MAX_OSPATH];
 	int             handle;
 	int             numfiles;
 	packfile_t      *files;
+	int             hashtable[PACK_HASH_SIZE];	// first file index per chain, -1 if empty
 } pack_t;
 
 //
@@ -261,6 +268,8 @@ typedef struct searchpath_s
 extern	searchpath_t    *com_searchpaths;
 extern	searchpath_t	*com_base_searchpaths;
 
+void COM_FlushFileIndex (void);
+
 void COM_WriteFile (char *filename, void *data, int len);
 int COM_OpenFile (char *filename, int *handle, unsigned int *path_id);
 int COM_FOpenFile (char *filename, FILE **file, unsigned int *path_id);
@@ -274,10 +283,14 @@ byte *COM_LoadTempFile (char *path, unsigned int *path_id);
 byte *COM_LoadZoneFile (char *path, unsigned int *path_id);
 byte *COM_LoadHunkFile (char *path, unsigned int *path_id);
 void COM_LoadCacheFile (char *path, struct cache_user_s *cu, unsigned int *path_id);
+byte *COM_MapFile (char *path, unsigned int *path_id);
+void COM_UnmapFile (byte *data);
+void COM_UnmapAllFiles (void);
 
 void COM_CreatePath (char *path);
 
 extern	struct cvar_s	registered;
+extern	struct cvar_s	com_mapfiles;
 
 extern qboolean		standard_quake, rogue, hipnotic, nehahra, quoth;
 
@@ -45,6 +45,28 @@ int		mod_numknown;
 cvar_t	external_lit = {"external_lit","1", CVAR_NONE};
 cvar_t	external_vis = {"external_vis","1", CVAR_NONE};
 cvar_t	external_ent = {"external_ent","1", CVAR_NONE};
+cvar_t	mod_viscache = {"mod_viscache","1024", CVAR_NONE}; // kilobytes of decompressed pvs rows to keep, 0 = off
+
+// a decompressed pvs row, in the hash of its leaf and on the lru list
+typedef struct visrow_s
+{
+	model_t		*model;
+	mleaf_t		*leaf;
+	struct visrow_s	*hashnext;
+	struct visrow_s	*prev, *next;	// lru order, most recently used first
+	int			size;			// bytes charged against mod_viscache
+	byte		bits[4];		// variable sized
+} visrow_t;
+
+#define	VISCACHE_HASH	1024
+
+static visrow_t	*viscache_hash[VISCACHE_HASH];
+static visrow_t	viscache_lru = {NULL, NULL, NULL, &viscache_lru, &viscache_lru};
+static int		viscache_bytes, viscache_rows;
+static int		viscache_lookups, viscache_hits, viscache_evictions;
+
+static void Mod_TrimVisCache (int budget);
+void Mod_VisCacheStats_f (void);
 
 /*
 ===============
@@ -56,6 +78,16 @@ void Mod_External (void)
 	Con_Printf ("external resources change takes effect on map restart/change.\n");
 }
 
+/*
+===============
+Mod_VisCache
+===============
+*/
+void Mod_VisCache (void)
+{
+	Mod_TrimVisCache (mod_viscache.value > 0 ? (int)mod_viscache.value * 1024 : 0);
+}
+
 /*
 ===============
 Mod_Init
@@ -66,6 +98,9 @@ void Mod_Init (void)
 	Cvar_RegisterVariableCallback (&external_lit, Mod_External);
 	Cvar_RegisterVariableCallback (&external_vis, Mod_External);
 	Cvar_RegisterVariableCallback (&external_ent, Mod_External);
+	Cvar_RegisterVariableCallback (&mod_viscache, Mod_VisCache);
+
+	Cmd_AddCommand ("mod_viscachestats", Mod_VisCacheStats_f);
 }
 
 /*
@@ -123,10 +158,13 @@ mleaf_t *Mod_PointInLeaf (vec3_t p, model_t *model)
 
 /*
 ===================
-Mod_DecompressVis
+Mod_DecompressVisBuffer
+
+Decompresses into the caller's buffer of (numleafs+7)>>3 bytes,
+so it can be used away from the main thread
 ===================
 */
-byte *Mod_DecompressVis (byte *in, model_t *model)
+byte *Mod_DecompressVisBuffer (byte *in, model_t *model, byte *decompressed)
 {
 	int		c;
 	byte	*out;
@@ -134,15 +172,8 @@ byte *Mod_DecompressVis (byte *in, model_t *model)
 	int		row;
 
 	row = (model->numleafs+7)>>3;
-	if (mod_decompressed == NULL || row > mod_decompressed_capacity)
-	{
-		mod_decompressed_capacity = row;
-		mod_decompressed = (byte *) realloc (mod_decompressed, mod_decompressed_capacity);
-		if (!mod_decompressed)
-			Host_Error ("Mod_DecompressVis: realloc() failed on %d bytes", mod_decompressed_capacity);
-	}
-	out = mod_decompressed;
-	outend = mod_decompressed + row;
+	out = decompressed;
+	outend = decompressed + row;
 
 	if (!in || r_novis.value == 2)
 	{	// no vis info, so make all visible
@@ -151,7 +182,7 @@ byte *Mod_DecompressVis (byte *in, model_t *model)
 			*out++ = 0xff;
 			row--;
 		}
-		return mod_decompressed;
+		return decompressed;
 	}
 
 	do
@@ -168,32 +199,203 @@ byte *Mod_DecompressVis (byte *in, model_t *model)
 		{
 			if (out == outend)
 			{
-				if(!model->viswarn) {
-					model->viswarn = true;
-					Con_Warning("Mod_DecompressVis: output overrun on model \"%s\"\n", model->name);
-				}
-				return mod_decompressed;
+				model->viswarn = true; // reported by Mod_DecompressVis
+				return decompressed;
 			}
 			*out++ = 0;
 			c--;
 		}
-	} while (out - mod_decompressed < row);
+	} while (out - decompressed < row);
 	
+	return decompressed;
+}
+
+/*
+===================
+Mod_DecompressVis
+===================
+*/
+byte *Mod_DecompressVis (byte *in, model_t *model)
+{
+	int		row;
+	qboolean	viswarn;
+
+	row = (model->numleafs+7)>>3;
+	if (mod_decompressed == NULL || row > mod_decompressed_capacity)
+	{
+		mod_decompressed_capacity = row;
+		mod_decompressed = (byte *) realloc (mod_decompressed, mod_decompressed_capacity);
+		if (!mod_decompressed)
+			Host_Error ("Mod_DecompressVis: realloc() failed on %d bytes", mod_decompressed_capacity);
+	}
+
+	viswarn = model->viswarn;
+	Mod_DecompressVisBuffer (in, model, mod_decompressed);
+	if (model->viswarn && !viswarn)
+		Con_Warning("Mod_DecompressVis: output overrun on model \"%s\"\n", model->name);
+
 	return mod_decompressed;
 }
 
+/*
+===================
+Mod_FreeVisRow
+===================
+*/
+static void Mod_FreeVisRow (visrow_t *row)
+{
+	visrow_t	**link;
+
+	for (link = &viscache_hash[(row->leaf - row->model->leafs) & (VISCACHE_HASH-1)] ; *link != row ; link = &(*link)->hashnext)
+		;
+	*link = row->hashnext;
+	row->prev->next = row->next;
+	row->next->prev = row->prev;
+
+	viscache_bytes -= row->size;
+	viscache_rows--;
+	free (row);
+}
+
+/*
+===================
+Mod_TrimVisCache
+
+Drops the least recently used rows until the cache fits in budget bytes
+===================
+*/
+static void Mod_TrimVisCache (int budget)
+{
+	while (viscache_bytes > budget)
+	{
+		Mod_FreeVisRow (viscache_lru.prev);
+		viscache_evictions++;
+	}
+}
+
+/*
+===================
+Mod_FlushVisCache
+
+Leaf pointers go stale when the hunk is cleared
+===================
+*/
+static void Mod_FlushVisCache (void)
+{
+	while (viscache_lru.next != &viscache_lru)
+		Mod_FreeVisRow (viscache_lru.next);
+}
+
+/*
+===================
+Mod_CachedVis
+
+Returns the decompressed row of leaf, decoding it only if it isn't cached.
+Like Mod_DecompressVis the result is only good until the next call.
+===================
+*/
+static byte *Mod_CachedVis (mleaf_t *leaf, model_t *model)
+{
+	visrow_t	*row, **bucket;
+	byte		*bits;
+	int			rowbytes, size, budget;
+
+	viscache_lookups++;
+	bucket = &viscache_hash[(leaf - model->leafs) & (VISCACHE_HASH-1)];
+	for (row = *bucket ; row ; row = row->hashnext)
+	{
+		if (row->leaf != leaf || row->model != model)
+			continue;
+		viscache_hits++;
+		if (viscache_lru.next != row)
+		{	// move to the front
+			row->prev->next = row->next;
+			row->next->prev = row->prev;
+			row->next = viscache_lru.next;
+			row->prev = &viscache_lru;
+			row->next->prev = row;
+			viscache_lru.next = row;
+		}
+		return row->bits;
+	}
+
+	bits = Mod_DecompressVis (leaf->compressed_vis, model);
+
+	rowbytes = (model->numleafs+7)>>3;
+	size = sizeof(visrow_t) + rowbytes;
+	budget = (int)mod_viscache.value * 1024;
+	if (size > budget)
+		return bits;
+	Mod_TrimVisCache (budget - size);
+
+	row = (visrow_t *) malloc (size);
+	if (!row)
+		return bits;
+	row->model = model;
+	row->leaf = leaf;
+	row->size = size;
+	memcpy (row->bits, bits, rowbytes);
+
+	row->hashnext = *bucket;
+	*bucket = row;
+	row->next = viscache_lru.next;
+	row->prev = &viscache_lru;
+	row->next->prev = row;
+	viscache_lru.next = row;
+	viscache_bytes += size;
+	viscache_rows++;
+
+	return row->bits;
+}
+
+/*
+===================
+Mod_VisCacheStats_f
+===================
+*/
+void Mod_VisCacheStats_f (void)
+{
+	Con_Printf ("vis cache: %d rows, %.1fk of %.0fk\n", viscache_rows, viscache_bytes / 1024.0, mod_viscache.value > 0 ? mod_viscache.value : 0);
+	Con_Printf ("%d lookups, %d hits (%.1f%%), %d evictions\n", viscache_lookups, viscache_hits,
+		viscache_lookups ? viscache_hits * 100.0 / viscache_lookups : 0, viscache_evictions);
+
+	if (Cmd_Argc () > 1 && !strcmp (Cmd_Argv (1), "clear"))
+		viscache_lookups = viscache_hits = viscache_evictions = 0;
+}
+
 /*
 =================
 Mod_LeafPVS
+
+Callers only read the row, so it can come straight out of the cache
 =================
 */
 byte *Mod_LeafPVS (mleaf_t *leaf, model_t *model)
 {
 	if (leaf == model->leafs)
 		return Mod_NoVisPVS (model);
+	if (mod_viscache.value > 0 && r_novis.value != 2)
+		return Mod_CachedVis (leaf, model);
 	return Mod_DecompressVis (leaf->compressed_vis, model);
 }
 
+/*
+=================
+Mod_LeafPVSBuffer
+
+Mod_LeafPVS into the caller's buffer
+=================
+*/
+byte *Mod_LeafPVSBuffer (mleaf_t *leaf, model_t *model, byte *buffer)
+{
+	if (leaf == model->leafs)
+	{
+		memset (buffer, 0xff, (model->numleafs+7)>>3);
+		return buffer;
+	}
+	return Mod_DecompressVisBuffer (leaf->compressed_vis, model, buffer);
+}
+
 /*
 =================
 Mod_NoVisPVS
@@ -226,6 +428,8 @@ void Mod_ClearAll (void)
 	int		i;
 	model_t	*mod;
 
+	Mod_FlushVisCache ();
+
 	for (i=0 , mod=mod_known ; i<mod_numknown ; i++, mod++)
 	{
 		if (mod->type != mod_alias)
@@ -241,6 +445,8 @@ void Mod_ResetAll (void)
 	int		i;
 	model_t	*mod;
 
+	Mod_FlushVisCache ();
+
 	for (i=0 , mod=mod_known ; i<mod_numknown ; i++, mod++)
 	{
 		if (!mod->needload) // otherwise Mod_ClearAll() did it already
@@ -337,9 +543,11 @@ model_t *Mod_LoadModel (model_t *mod, qboolean crash)
 	}
 
 //
-// load the file
+// load the file, parsing it in place when it can be mapped
 //
-	buf = (unsigned *)COM_LoadStackFile (mod->name, stackbuf, sizeof(stackbuf), &mod->path_id);
+	buf = (unsigned *)COM_MapFile (mod->name, &mod->path_id);
+	if (!buf)
+		buf = (unsigned *)COM_LoadStackFile (mod->name, stackbuf, sizeof(stackbuf), &mod->path_id);
 	if (!buf)
 	{
 		if (crash)
@@ -376,6 +584,8 @@ model_t *Mod_LoadModel (model_t *mod, qboolean crash)
 		break;
 	}
 
+	COM_UnmapFile ((byte *)buf);
+
 	return mod;
 }
 
@@ -60,7 +60,11 @@ cvar_t	host_maxfps = {"host_maxfps", "72", CVAR_ARCHIVE};		// max fps cvar
 
 cvar_t	sys_ticrate = {"sys_ticrate","0.05", CVAR_NONE};
 cvar_t	sys_throttle = {"sys_throttle","0.02", CVAR_ARCHIVE};
+cvar_t	sys_wakeonpacket = {"sys_wakeonpacket","0", CVAR_NONE};	// dedicated server runs a frame as soon as a packet arrives
 cvar_t	serverprofile = {"serverprofile","0", CVAR_NONE};
+cvar_t	host_loadreport = {"host_loadreport","0", CVAR_NONE};	// seconds between load reports, 0 is off
+cvar_t	host_framestats = {"host_framestats","0", CVAR_NONE};	// time the parts of each server frame
+cvar_t	host_framestats_csv = {"host_framestats_csv","", CVAR_NONE};	// and log them to this file
 
 cvar_t	fraglimit = {"fraglimit","0", CVAR_SERVER};
 cvar_t	timelimit = {"timelimit","0", CVAR_SERVER};
@@ -182,6 +186,8 @@ void Host_Error (char *error, ...)
 	cls.demonum = -1;
 	cl.intermission = 0; // for errors during intermissions (changelevel with no map found, etc.)
 
+	COM_UnmapAllFiles ();
+
 	inerror = false;
 
 	longjmp (host_abortserver, 1);
@@ -286,7 +292,13 @@ void Host_InitLocal (void)
 
 	Cvar_RegisterVariable (&sys_ticrate);
 	Cvar_RegisterVariable (&sys_throttle);
+	Cvar_RegisterVariable (&sys_wakeonpacket);
 	Cvar_RegisterVariable (&serverprofile);
+	Cvar_RegisterVariable (&host_loadreport);
+	Cmd_AddCommand ("host_load", Host_Load_f);
+	Cvar_RegisterVariable (&host_framestats);
+	Cvar_RegisterVariableCallback (&host_framestats_csv, Host_FrameStatsCSV);
+	Cmd_AddCommand ("host_framereport", Host_FrameStats_f);
 
 	Cvar_RegisterVariable (&fraglimit);
 	Cvar_RegisterVariable (&timelimit);
@@ -352,6 +364,7 @@ void Host_WriteConfiguration (char *configname)
 			fprintf (f, "+mlook\n");
 
 		fclose (f);
+		COM_FlushFileIndex ();
 		
 		Host_ConfigListRebuild (); // EER1 -- update
 	}
@@ -551,7 +564,7 @@ void Host_ShutdownServer (qboolean crash)
 	MSG_WriteByte(&buf, svc_disconnect);
 	count = NET_SendToAll(&buf, 5, false);
 	if (count)
-		Con_Printf("Host_ShutdownServer: NET_SendToAll failed for %u clients\n", count);
+		Con_DPrintf("Host_ShutdownServer: disconnect still on its way to %u clients\n", count);
 
 	for (i=0, host_client = svs.clients ; i<svs.maxclients ; i++, host_client++)
 		if (host_client->active)
@@ -577,6 +590,7 @@ void Host_ClearMemory (void)
 {
 	Con_DPrintf ("Clearing memory\n");
 	Mod_ClearAll ();
+	SV_ClearFatPVS ();
 	if (host_hunklevel)
 		Hunk_FreeToLowMark (host_hunklevel);
 
@@ -643,6 +657,214 @@ void Host_GetConsoleCommands (void)
 }
 
 
+/*
+===============================================================================
+
+SERVER FRAME STATS
+
+===============================================================================
+*/
+
+#define	FRAMESTATS_WINDOW	1024		// frames kept for the percentiles
+
+static char *framestat_names[NUM_FRAMESTATS] =
+{
+	"frame",
+	"newclients",
+	"runclients",
+	"physics",
+	" client",
+	" push",
+	" none",
+	" follow",
+	" noclip",
+	" step",
+	" walk",
+	" toss",
+	"quakec",
+	"send",
+	"net"
+};
+
+static	qboolean	framestats_active;		// inside a timed frame
+static	double		framestats_current[NUM_FRAMESTATS];
+static	float		framestats_window[NUM_FRAMESTATS][FRAMESTATS_WINDOW];	// ms
+static	int			framestats_frames;		// since the last clear
+static	int			framestats_overruns;	// frames that took longer than the tic
+static	float		framestats_max[NUM_FRAMESTATS];
+static	FILE		*framestats_csv;
+
+/*
+==================
+Host_FrameStatStart
+==================
+*/
+double Host_FrameStatStart (void)
+{
+	return framestats_active ? Sys_DoubleTime () : 0;
+}
+
+/*
+==================
+Host_FrameStatStop
+==================
+*/
+void Host_FrameStatStop (framestat_t stat, double start)
+{
+	if (start)
+		framestats_current[stat] += Sys_DoubleTime () - start;
+}
+
+/*
+==================
+Host_FrameStatsCSV
+
+Opens the log named by host_framestats_csv, closes the old one
+==================
+*/
+void Host_FrameStatsCSV (void)
+{
+	char	name[MAX_OSPATH];
+	int		i;
+
+	if (framestats_csv)
+	{
+		fclose (framestats_csv);
+		framestats_csv = NULL;
+	}
+
+	if (!host_framestats_csv.string[0])
+		return;
+	if (strstr(host_framestats_csv.string, ".."))
+	{
+		Con_Printf ("Relative pathnames are not allowed.\n");
+		return;
+	}
+
+	sprintf (name, "%s/%s", com_gamedir, host_framestats_csv.string);
+	COM_DefaultExtension (name, ".csv");
+
+	framestats_csv = fopen (name, "w");
+	if (!framestats_csv)
+	{
+		Con_Error ("couldn't open %s\n", name);
+		return;
+	}
+
+	fprintf (framestats_csv, "realtime");
+	for (i=0 ; i<NUM_FRAMESTATS ; i++)
+		fprintf (framestats_csv, ",%s", framestat_names[i][0] == ' ' ? va("phys_%s", framestat_names[i] + 1) : framestat_names[i]);
+	fprintf (framestats_csv, "\n");
+}
+
+/*
+==================
+Host_EndFrameStats
+==================
+*/
+static void Host_EndFrameStats (double start)
+{
+	int		i, slot;
+	float	ms;
+	double	tic;
+
+	framestats_active = false;
+	framestats_current[FS_FRAME] = Sys_DoubleTime () - start;
+
+	tic = host_netinterval ? host_netinterval : host_frametime;
+	if (framestats_current[FS_FRAME] > tic)
+		framestats_overruns++;
+
+	slot = framestats_frames++ & (FRAMESTATS_WINDOW - 1);
+	for (i=0 ; i<NUM_FRAMESTATS ; i++)
+	{
+		ms = framestats_current[i] * 1000;
+		framestats_window[i][slot] = ms;
+		if (framestats_max[i] < ms)
+			framestats_max[i] = ms;
+	}
+
+	if (framestats_csv)
+	{
+		fprintf (framestats_csv, "%.4f", realtime);
+		for (i=0 ; i<NUM_FRAMESTATS ; i++)
+			fprintf (framestats_csv, ",%.4f", framestats_window[i][slot]);
+		fprintf (framestats_csv, "\n");
+	}
+}
+
+static int Host_FrameStatsCompare (const void *a, const void *b)
+{
+	float	d;
+
+	d = *(float *)a - *(float *)b;
+	return (d > 0) - (d < 0);
+}
+
+/*
+==================
+Host_FrameStats_f
+
+Prints the percentiles of the last FRAMESTATS_WINDOW server frames and a
+histogram of the frame times
+==================
+*/
+void Host_FrameStats_f (void)
+{
+	static float	sorted[FRAMESTATS_WINDOW];
+	static float	limits[] = {0.5, 1, 2, 4, 8, 16, 32, 64};
+	int		i, j, n, count;
+	double	total;
+
+	if (Cmd_Argc () > 1 && !strcmp (Cmd_Argv(1), "clear"))
+	{
+		framestats_frames = framestats_overruns = 0;
+		memset (framestats_max, 0, sizeof(framestats_max));
+		return;
+	}
+
+	if (!framestats_frames)
+	{
+		Con_Printf ("no server frames timed, set host_framestats 1\n");
+		return;
+	}
+
+	n = min(framestats_frames, FRAMESTATS_WINDOW);
+	Con_Printf ("%i frames, %i over the tic, last %i:\n", framestats_frames, framestats_overruns, n);
+	Con_Printf ("              avg     p50     p99     max  all-time max (ms)\n");
+	for (i=0 ; i<NUM_FRAMESTATS ; i++)
+	{
+		total = 0;
+		for (j=0 ; j<n ; j++)
+		{
+			sorted[j] = framestats_window[i][j];
+			total += sorted[j];
+		}
+		qsort (sorted, n, sizeof(float), Host_FrameStatsCompare);
+
+		Con_Printf ("%-11s %7.3f %7.3f %7.3f %7.3f %7.3f\n", framestat_names[i], total / n,
+			sorted[n / 2], sorted[(n * 99) / 100], sorted[n - 1], framestats_max[i]);
+	}
+
+	Con_Printf ("\nframe time histogram:\n");
+	for (i=0 ; i<=sizeof(limits)/sizeof(limits[0]) ; i++)
+	{
+		count = 0;
+		for (j=0 ; j<n ; j++)
+		{
+			if (i < sizeof(limits)/sizeof(limits[0]) && framestats_window[FS_FRAME][j] >= limits[i])
+				continue;
+			if (i > 0 && framestats_window[FS_FRAME][j] < limits[i - 1])
+				continue;
+			count++;
+		}
+		if (i < sizeof(limits)/sizeof(limits[0]))
+			Con_Printf ("  < %4.1f ms %5i\n", limits[i], count);
+		else
+			Con_Printf (" >= %4.1f ms %5i\n", limits[i - 1], count);
+	}
+}
+
 /*
 ==================
 Host_ServerFrame
@@ -650,6 +872,15 @@ Host_ServerFrame
 */
 void Host_ServerFrame (void)
 {
+	double	framestart = 0, start;
+
+	framestats_active = (host_framestats.value != 0);
+	if (framestats_active)
+	{
+		memset (framestats_current, 0, sizeof(framestats_current));
+		framestart = Sys_DoubleTime ();
+	}
+
 // run the world state	
 	pr_global_struct->frametime = host_frametime;
 
@@ -657,18 +888,35 @@ void Host_ServerFrame (void)
 	SV_ClearDatagram ();
 
 // check for new clients
+	start = Host_FrameStatStart ();
 	SV_CheckForNewClients ();
+	Host_FrameStatStop (FS_NEWCLIENTS, start);
 
 // read client messages
+	start = Host_FrameStatStart ();
 	SV_RunClients ();
+	Host_FrameStatStop (FS_RUNCLIENTS, start);
 
 // move things around and think
 // always pause in single player if in console or menus
 	if ( !(sv.paused || (svs.maxclients == 1 && key_dest != key_game) ) )
+	{
+		start = Host_FrameStatStart ();
 		SV_Physics ();
+		Host_FrameStatStop (FS_PHYSICS, start);
+	}
 
 // send all messages to the clients
+	start = Host_FrameStatStart ();
 	SV_SendClientMessages ();
+	Host_FrameStatStop (FS_SEND, start);
+
+	NET_Flush ();
+
+	SV_TraceRecordFrame ();
+
+	if (framestats_active)
+		Host_EndFrameStats (framestart);
 }
 
 
@@ -799,6 +1047,50 @@ void _Host_Frame (double time)
 	host_framecount++;
 }
 
+/*
+==================
+Host_Idle
+
+Called by the system main loop with the time it spent waiting for the
+next frame
+==================
+*/
+static double	load_busytime, load_idletime, load_start;
+static int		load_frames;
+
+void Host_Idle (double time)
+{
+	load_idletime += time;
+}
+
+/*
+==================
+Host_Load_f
+
+Prints the busy and idle time per frame since the last report
+==================
+*/
+void Host_Load_f (void)
+{
+	double	total;
+
+	total = load_busytime + load_idletime;
+	if (!load_frames || total <= 0)
+	{
+		Con_Printf ("no frames since the last report\n");
+		return;
+	}
+
+	Con_Printf ("load: %i frames in %.1fs, busy %.3f ms, idle %.3f ms per frame (%.1f%% busy)\n",
+		load_frames, Sys_DoubleTime () - load_start,
+		load_busytime * 1000.0 / load_frames, load_idletime * 1000.0 / load_frames,
+		load_busytime * 100.0 / total);
+
+	load_busytime = load_idletime = 0;
+	load_frames = 0;
+	load_start = Sys_DoubleTime ();
+}
+
 void Host_Frame (double time)
 {
 	double	time1, time2;
@@ -806,15 +1098,19 @@ void Host_Frame (double time)
 	static int		timecount;
 	int		i, c, m;
 
-	if (!serverprofile.value)
-	{
-		_Host_Frame (time);
-		return;
-	}
-	
 	time1 = Sys_DoubleTime ();
 	_Host_Frame (time);
 	time2 = Sys_DoubleTime ();	
+
+	load_busytime += time2 - time1;
+	load_frames++;
+	if (!load_start)
+		load_start = time1;
+	if (host_loadreport.value > 0 && time2 - load_start >= host_loadreport.value)
+		Host_Load_f ();
+
+	if (!serverprofile.value)
+		return;
 	
 	timetotal += time2 - time1;
 	timecount++;
@@ -964,6 +1260,8 @@ void Host_Shutdown(void)
 		VID_Shutdown ();
 	}
 
+	if (framestats_csv)
+		fclose (framestats_csv);
 	LOG_Close ();
     
     host_initialized = false;
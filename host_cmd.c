@@ -1176,6 +1176,8 @@ void Host_Loadgame_f (void)
 	
 	sv.num_edicts = entnum;
 	sv.time = time;
+	ED_RebuildFreeList ();
+	ED_ClearFindIndexes ();	// still hold the edicts the spawn made past entnum
 
 	fclose (f);
 
@@ -1226,6 +1228,7 @@ void Host_Name_f (void)
 			Sys_Printf ("%s renamed to %s\n", host_client->name, newName); // was Con_Printf
 	strcpy (host_client->name, newName);
 	host_client->edict->v.netname = PR_SetString(host_client->name);
+	ED_UpdateFindIndex (host_client->edict, -1);
 	
 // send notification to all clients
 	
@@ -1562,6 +1565,7 @@ void Host_Spawn_f (void)
 		ent->v.colormap = NUM_FOR_EDICT(ent);
 		ent->v.team = (host_client->colors & 15) + 1;
 		ent->v.netname = PR_SetString(host_client->name);
+		ED_UpdateFindIndex (ent, -1);
 
 		// copy spawn parms out of the client_t
 
@@ -1864,7 +1868,7 @@ void Host_Give_f (void)
 	case 's':
 		if (rogue)
 		{
-			val = GetEdictFieldValue(sv_player, "ammo_shells1");
+			val = GetEdictFieldValue(sv_player, pr_extfields.ammo_shells1);
 			if (val)
 				val->_float = v;
 		}
@@ -1874,7 +1878,7 @@ void Host_Give_f (void)
 	case 'n':
 		if (rogue)
 		{
-			val = GetEdictFieldValue(sv_player, "ammo_nails1");
+			val = GetEdictFieldValue(sv_player, pr_extfields.ammo_nails1);
 			if (val)
 			{
 				val->_float = v;
@@ -1891,7 +1895,7 @@ void Host_Give_f (void)
 	case 'l':
 		if (rogue)
 		{
-			val = GetEdictFieldValue(sv_player, "ammo_lava_nails");
+			val = GetEdictFieldValue(sv_player, pr_extfields.ammo_lava_nails);
 			if (val)
 			{
 				val->_float = v;
@@ -1904,7 +1908,7 @@ void Host_Give_f (void)
 	case 'r':
 		if (rogue)
 		{
-			val = GetEdictFieldValue(sv_player, "ammo_rockets1");
+			val = GetEdictFieldValue(sv_player, pr_extfields.ammo_rockets1);
 			if (val)
 			{
 				val->_float = v;
@@ -1921,7 +1925,7 @@ void Host_Give_f (void)
 	case 'm':
 		if (rogue)
 		{
-			val = GetEdictFieldValue(sv_player, "ammo_multi_rockets");
+			val = GetEdictFieldValue(sv_player, pr_extfields.ammo_multi_rockets);
 			if (val)
 			{
 				val->_float = v;
@@ -1938,7 +1942,7 @@ void Host_Give_f (void)
 	case 'c':
 		if (rogue)
 		{
-			val = GetEdictFieldValue(sv_player, "ammo_cells1");
+			val = GetEdictFieldValue(sv_player, pr_extfields.ammo_cells1);
 			if (val)
 			{
 				val->_float = v;
@@ -1955,7 +1959,7 @@ void Host_Give_f (void)
 	case 'p':
 		if (rogue)
 		{
-			val = GetEdictFieldValue(sv_player, "ammo_plasma");
+			val = GetEdictFieldValue(sv_player, pr_extfields.ammo_plasma);
 			if (val)
 			{
 				val->_float = v;
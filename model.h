@@ -505,6 +505,7 @@ void	Mod_TouchModel (char *name);
 
 mleaf_t *Mod_PointInLeaf (float *p, model_t *model);
 byte	*Mod_LeafPVS (mleaf_t *leaf, model_t *model);
+byte	*Mod_LeafPVSBuffer (mleaf_t *leaf, model_t *model, byte *buffer);
 byte	*Mod_NoVisPVS (model_t *model);
 
 void	Mod_FloodFillSkin (byte *skin, int skinwidth, int skinheight, char *name);
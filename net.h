@@ -90,6 +90,7 @@ struct qsockaddr
 #define NET_NAMELEN			64
 
 #define NET_MAXMESSAGE		65536 // was 8192
+#define NET_QUEUESIZE		1024 // NET_SendToAll data waiting on one connection
 #define NET_HEADERSIZE		(2 * sizeof(unsigned int)) // 8
 #define NET_DATAGRAMSIZE	(MAX_DATAGRAM + NET_HEADERSIZE)
 
@@ -183,6 +184,16 @@ struct qsockaddr
 #define MOD_NONE		0x00
 #define MOD_PROQUAKE		0x01
 
+// mod_flags in CCREQ_CONNECT / CCREP_ACCEPT
+#define MODF_WINDOW		0x80	// windowed reliable channel, the server echoes it if it agrees
+
+// On a windowed connection every fragment of a reliable message can be in
+// flight at once. NETFLAG_DATA packets carry a long with the fragment's
+// offset into the message ahead of the data, and each fragment is acked on
+// its own: the NETFLAG_ACK carries the fragment sequence plus a long below
+// which every sequence has arrived.
+#define NET_MAXFRAGS		128		// fragments of one reliable message
+
 struct net_landriver_s;
 struct net_driver_s;
 
@@ -211,6 +222,7 @@ typedef struct qsocket_s
 	unsigned int			sendSequence;
 	unsigned int			unreliableSendSequence;
 	int						sendMessageLength;
+	int						sendOffset;		// start of the part not acked yet
 	byte					sendMessage[NET_MAXMESSAGE];
 
 	unsigned int			receiveSequence;
@@ -227,11 +239,47 @@ typedef struct qsocket_s
 	byte					mod_flags; // reserved (compat. with PQ)
 	int						client_port; // ProQuake NAT fix
 	qboolean				net_wait; // wait for the client to send a packet to the private port
+
+	// shared server socket, see net_dgrm.c
+	qboolean				shared; // talks over the listen socket instead of its own
+	int						sharedhead, sharedtail; // queued incoming datagrams, -1 when empty
+	int						sharedcount;
+
+	// windowed reliable channel (MODF_WINDOW), see net_dgrm.c
+	qboolean				windowed;
+	int						fragSize;		// message bytes per fragment
+	int						sendFrags;		// fragments in sendMessage
+	int						sendAcked;
+	int						sendLow;		// first unacked fragment
+	byte					fragAcked[NET_MAXFRAGS];
+	byte					fragResent[NET_MAXFRAGS];
+	double					fragSentTime[NET_MAXFRAGS];	// -1 until sent
+	double					srtt, rttvar, rto;
+	int						recvContig;		// fragments of the message received in order
+	int						recvLast;		// the EOM fragment, -1 until it arrives
+	int						recvLength;
+	byte					fragReceived[NET_MAXFRAGS];
+
+	// NET_SendToAll queue, see net_main.c
+	int						queuedLength;
+	byte					queuedMessage[NET_QUEUESIZE];
+	qboolean				queueSent;		// handed to the driver, waiting for the ack
+	double					queueTimeout;
+	qboolean				lingering;		// closed, kept open until the queue is acked
 } qsocket_t;
 
 extern qsocket_t	*net_activeSockets;
 extern qsocket_t	*net_freeSockets;
 
+// one datagram for the batched driver calls; length is the buffer size
+// going into ReadMany and the datagram size coming out
+typedef struct
+{
+	byte				*data;
+	int					length;
+	struct qsockaddr	addr;
+} netpacket_t;
+
 typedef struct net_landriver_s
 {
 	char		*name;
@@ -255,6 +303,12 @@ typedef struct net_landriver_s
 	int			(*AddrCompare) (struct qsockaddr *addr1, struct qsockaddr *addr2);
 	int			(*GetSocketPort) (struct qsockaddr *addr);
 	int			(*SetSocketPort) (struct qsockaddr *addr, int port);
+
+	// optional batched and gathered i/o, NULL if the driver can't
+	sys_socket_t	(*AcceptSocket) (void);
+	int			(*ReadMany) (sys_socket_t net_socket, netpacket_t *packets, int count);
+	int			(*WriteMany) (sys_socket_t net_socket, netpacket_t *packets, int count);
+	int			(*WriteParts) (sys_socket_t net_socket, byte *head, int headlen, byte *data, int datalen, struct qsockaddr *addr);
 } net_landriver_t;
 
 #define	MAX_NET_DRIVERS		8
@@ -277,6 +331,7 @@ typedef struct net_driver_s
 	qboolean	(*CanSendUnreliableMessage) (qsocket_t *sock);
 	void		(*Close) (qsocket_t *sock);
 	void		(*Shutdown) (void);
+	void		(*Flush) (void);
 	sys_socket_t		controlSock;
 } net_driver_t;
 
@@ -354,7 +409,10 @@ int			NET_SendUnreliableMessage (struct qsocket_s *sock, sizebuf_t *data);
 // returns -1 if the connection died
 
 int			NET_SendToAll (sizebuf_t *data, int blocktime, qboolean nolocals);
-// This is a reliable *blocking* send to all attached clients.
+// This is a reliable send to all attached clients. The message is queued on
+// each connection ahead of anything sent to it later and goes out from the
+// frame loop; a client that hasn't taken it after blocktime seconds is given
+// up on. Returns the number of clients it is still on its way to.
 
 
 void		NET_Close (struct qsocket_s *sock);
@@ -366,6 +424,10 @@ void		NET_Close (struct qsocket_s *sock);
 // from a server.
 // A netcon_t number will not be reused until this function is called for it
 
+void		NET_Flush (void);
+// sends any datagrams the drivers held back to batch them, called once
+// at the end of every server frame
+
 void NET_Poll(void);
 
 
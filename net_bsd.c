@@ -57,7 +57,8 @@ net_driver_t net_drivers[MAX_NET_DRIVERS] =
 		Datagram_CanSendMessage,
 		Datagram_CanSendUnreliableMessage,
 		Datagram_Close,
-		Datagram_Shutdown
+		Datagram_Shutdown,
+		Datagram_Flush
 	}
 };
 
@@ -86,7 +87,11 @@ net_landriver_t	net_landrivers[MAX_NET_DRIVERS] =
 		UDP_GetDefaultMTU,
 		UDP_AddrCompare,
 		UDP_GetSocketPort,
-		UDP_SetSocketPort
+		UDP_SetSocketPort,
+		UDP_AcceptSocket,
+		UDP_ReadMany,
+		UDP_WriteMany,
+		UDP_WriteParts
 	}
 };
 
@@ -46,6 +46,18 @@ static struct
 	byte			data[MAX_DATAGRAM];
 } packetBuffer;
 
+// what goes in front of the data of a datagram we send; the third long is
+// only there on windowed reliable fragments and their acks
+typedef struct
+{
+	unsigned int	length;
+	unsigned int	sequence;
+	unsigned int	extra;
+} packetheader_t;
+
+// header and data are put together here for lan drivers without WriteParts
+static byte	stageBuffer[NET_DATAGRAMSIZE];
+
 #ifdef DEBUG
 char *StrAddr (struct qsockaddr *addr)
 {
@@ -117,11 +129,569 @@ void NET_Ban_f (void)
 	}
 }
 
+/*
+=============================================================================
+
+SHARED SERVER SOCKET
+
+With net_sharedsocket, accepted clients don't get a socket of their own and
+everything goes over the listen socket. Datagram_DrainShared empties it a
+batch at a time with the lan driver's ReadMany and queues each datagram on
+the qsocket with the same address; control requests get a queue of their
+own for _Datagram_CheckNewConnections. Outgoing datagrams are collected and
+sent with one WriteMany from Datagram_Flush at the end of the server frame.
+CCREP_ACCEPT just carries the listen port, so clients can't tell.
+
+=============================================================================
+*/
+
+cvar_t	net_sharedsocket = {"net_sharedsocket", "0", CVAR_NONE}; // takes effect once no shared clients are left
+
+#define	SHARED_QUEUE		16		// datagrams held per queue before the oldest is dropped
+#define	SHARED_PACKETSIZE	2048	// clients never send more than DATAGRAM_MTU
+#define	SHARED_BATCH		64		// datagrams per ReadMany
+#define	SHARED_SENDS		128
+
+typedef struct
+{
+	int					next;	// next in the queue or on the free list, -1 ends
+	int					length;
+	struct qsockaddr	addr;
+	byte				data[SHARED_PACKETSIZE];
+} sharedpacket_t;
+
+static sharedpacket_t	*shared_packets;
+static int	shared_numpackets;
+static int	shared_free = -1;
+static int	shared_numfree;
+
+// control requests that came in on the listen socket, per lan driver
+static int	shared_ctlhead[MAX_NET_DRIVERS];
+static int	shared_ctltail[MAX_NET_DRIVERS];
+static int	shared_ctlcount[MAX_NET_DRIVERS];
+
+static int		dgrm_numshared;		// qsockets on a listen socket right now
+static qboolean	dgrm_listening;		// the listen sockets stay open for shared qsockets regardless
+static double	shared_lastdrain;
+static qboolean	shared_lastfull;
+
+static netpacket_t		shared_sends[SHARED_SENDS];
+static byte				shared_sendbuf[SHARED_SENDS][SHARED_PACKETSIZE];
+static int				shared_numsends;
+static net_landriver_t	*shared_senddriver;
+
+static qboolean Datagram_SharedMode (net_landriver_t *driver)
+{
+	if (!driver->AcceptSocket || !driver->ReadMany || !driver->WriteMany)
+		return false;
+
+	return net_sharedsocket.value || dgrm_numshared;
+}
+
+static void Datagram_InitShared (void)
+{
+	int i;
+
+	if (shared_packets)
+		return;
+
+	// every queue is capped, so there is always room for all of them to be full
+	shared_numpackets = SHARED_QUEUE * (svs.maxclientslimit + MAX_NET_DRIVERS);
+	shared_packets = (sharedpacket_t *) malloc (shared_numpackets * sizeof(sharedpacket_t));
+	if (!shared_packets)
+		Sys_Error ("Datagram_InitShared: couldn't allocate %d packets", shared_numpackets);
+
+	for (i = 0; i < shared_numpackets; i++)
+		shared_packets[i].next = i + 1;
+	shared_packets[shared_numpackets - 1].next = -1;
+	shared_free = 0;
+	shared_numfree = shared_numpackets;
+
+	for (i = 0; i < MAX_NET_DRIVERS; i++)
+	{
+		shared_ctlhead[i] = shared_ctltail[i] = -1;
+		shared_ctlcount[i] = 0;
+	}
+}
+
+static void Datagram_FreePacket (int slot)
+{
+	shared_packets[slot].next = shared_free;
+	shared_free = slot;
+	shared_numfree++;
+}
+
+static void Datagram_FreeQueue (int *head, int *tail, int *count)
+{
+	int slot;
+
+	while ((slot = *head) != -1)
+	{
+		*head = shared_packets[slot].next;
+		Datagram_FreePacket (slot);
+	}
+	*tail = -1;
+	*count = 0;
+}
+
+static void Datagram_QueuePacket (int slot, int *head, int *tail, int *count)
+{
+	int old;
+
+	// a qsocket nobody reads can't hold on to more than its share
+	if (*count == SHARED_QUEUE)
+	{
+		old = *head;
+		*head = shared_packets[old].next;
+		if (*head == -1)
+			*tail = -1;
+		(*count)--;
+		Datagram_FreePacket (old);
+	}
+
+	shared_packets[slot].next = -1;
+	if (*tail == -1)
+		*head = slot;
+	else
+		shared_packets[*tail].next = slot;
+	*tail = slot;
+	(*count)++;
+}
+
+static int Datagram_PopPacket (int *head, int *tail, int *count, byte *buf, int len, struct qsockaddr *addr)
+{
+	sharedpacket_t	*p;
+	int				slot;
+
+	if ((slot = *head) == -1)
+		return 0;
+
+	p = &shared_packets[slot];
+	*head = p->next;
+	if (*head == -1)
+		*tail = -1;
+	(*count)--;
+
+	len = min(len, p->length);
+	memcpy (buf, p->data, len);
+	*addr = p->addr;
+	Datagram_FreePacket (slot);
+
+	return len;
+}
+
+/*
+==================
+Datagram_DrainShared
+
+Reads what is waiting on the listen socket and sorts it into the queues.
+Returns the number of datagrams read, or -1 if the socket is gone.
+==================
+*/
+static int Datagram_DrainShared (net_landriver_t *driver)
+{
+	netpacket_t		batch[SHARED_BATCH];
+	int				slots[SHARED_BATCH];
+	sharedpacket_t	*p;
+	sys_socket_t	acceptsock;
+	qsocket_t		*s;
+	int				i, n, count, control, d;
+
+	// a client waiting for a reliable message (NET_SendToAll) needs it sent
+	// before its ack can come back
+	Datagram_Flush ();
+
+	// unless the last batch came back full the socket is most likely empty,
+	// so don't ask the kernel again within the same millisecond
+	if (!shared_lastfull && net_time - shared_lastdrain < 0.001)
+		return 0;
+	shared_lastdrain = net_time;
+	shared_lastfull = false;
+
+	acceptsock = driver->AcceptSocket ();
+	if (acceptsock == INVALID_SOCKET)
+		return -1;
+
+	n = min(shared_numfree, SHARED_BATCH);
+	for (i = 0; i < n; i++)
+	{
+		slots[i] = shared_free;
+		shared_free = shared_packets[shared_free].next;
+		shared_numfree--;
+		batch[i].data = shared_packets[slots[i]].data;
+		batch[i].length = SHARED_PACKETSIZE;
+	}
+
+	count = driver->ReadMany (acceptsock, batch, n);
+	shared_lastfull = (n > 0 && count == n);
+
+	d = driver - net_landrivers;
+	for (i = 0; i < n; i++)
+	{
+		if (i >= count || batch[i].length < (int)sizeof(int))
+		{
+			Datagram_FreePacket (slots[i]);
+			continue;
+		}
+
+		p = &shared_packets[slots[i]];
+		p->length = batch[i].length;
+		p->addr = batch[i].addr;
+
+		control = BigLong(*((int *)p->data));
+		if (control != -1 && (control & (~NETFLAG_LENGTH_MASK)) == (int)NETFLAG_CTL)
+		{
+			Datagram_QueuePacket (slots[i], &shared_ctlhead[d], &shared_ctltail[d], &shared_ctlcount[d]);
+			continue;
+		}
+
+		for (s = net_activeSockets; s; s = s->next)
+			if (s->shared && s->landriver == driver && driver->AddrCompare(&p->addr, &s->addr) == 0)
+				break;
+		if (!s)
+		{
+			// nobody we know
+			Datagram_FreePacket (slots[i]);
+			continue;
+		}
+		Datagram_QueuePacket (slots[i], &s->sharedhead, &s->sharedtail, &s->sharedcount);
+	}
+
+	return count;
+}
+
+static int Datagram_Read (qsocket_t *sock, byte *buf, int len, struct qsockaddr *addr)
+{
+	if (!sock->shared)
+		return sock->landriver->Read(sock->net_socket, buf, len, addr);
+
+	if (sock->sharedhead == -1 && Datagram_DrainShared (sock->landriver) == -1)
+		return -1;
+
+	return Datagram_PopPacket (&sock->sharedhead, &sock->sharedtail, &sock->sharedcount, buf, len, addr);
+}
+
+/*
+==================
+Datagram_WritePacket
+
+Sends a header and a slice of a message as one datagram. The slice is
+gathered straight from where it lies (usually sock->sendMessage) when the
+lan driver has WriteParts; otherwise the two are copied together once.
+==================
+*/
+static int Datagram_WritePacket (qsocket_t *sock, packetheader_t *header, int headerLen, byte *data, int dataLen, struct qsockaddr *addr)
+{
+	netpacket_t	*p;
+	int			len;
+
+	len = headerLen + dataLen;
+
+	if (sock->shared)
+	{
+		if (shared_numsends == SHARED_SENDS || (shared_senddriver && shared_senddriver != sock->landriver))
+			Datagram_Flush ();
+
+		// the batch has to own its data until the flush
+		if (len <= SHARED_PACKETSIZE)
+		{
+			p = &shared_sends[shared_numsends];
+			p->data = shared_sendbuf[shared_numsends];
+			p->length = len;
+			p->addr = *addr;
+			memcpy (p->data, header, headerLen);
+			memcpy (p->data + headerLen, data, dataLen);
+			shared_senddriver = sock->landriver;
+			shared_numsends++;
+			return len;
+		}
+
+		// too big to batch, keep it in order with the rest
+		Datagram_Flush ();
+	}
+
+	if (sock->landriver->WriteParts)
+		return sock->landriver->WriteParts(sock->net_socket, (byte *)header, headerLen, data, dataLen, addr);
+
+	memcpy (stageBuffer, header, headerLen);
+	memcpy (stageBuffer + headerLen, data, dataLen);
+	return sock->landriver->Write(sock->net_socket, stageBuffer, len, addr);
+}
+
+/*
+==================
+Datagram_Flush
+
+Send errors are not reported back: a lost reliable datagram is resent like
+any other, and a client that is really gone times out.
+==================
+*/
+void Datagram_Flush (void)
+{
+	sys_socket_t	acceptsock;
+
+	if (!shared_numsends)
+		return;
+
+	acceptsock = shared_senddriver->AcceptSocket ();
+	if (acceptsock != INVALID_SOCKET)
+		shared_senddriver->WriteMany (acceptsock, shared_sends, shared_numsends);
+
+	shared_numsends = 0;
+	shared_senddriver = NULL;
+}
+
+/*
+=============================================================================
+
+WINDOWED RELIABLE CHANNEL
+
+The classic channel has one fragment of a reliable message in flight and
+resends it after a fixed second. When both ends set MODF_WINDOW at connect
+time up to net_window fragments go out at once, each one is acked on its
+own, and lost ones are resent on a timer taken from the measured round trip.
+There is still only one message outstanding, so canSend means what it did.
+
+=============================================================================
+*/
+
+cvar_t	net_window = {"net_window", "16", CVAR_NONE}; // reliable fragments in flight, below 2 asks for the classic channel
+
+#define	WINDOW_MINRTO	0.1
+#define	WINDOW_MAXRTO	3.0
+
+static void Datagram_InitWindow (qsocket_t *sock)
+{
+	// the offset long comes out of each fragment; even at DATAGRAM_MTU_NQ
+	// NET_MAXFRAGS of them hold NET_MAXMESSAGE
+	sock->windowed = true;
+	sock->fragSize = sock->mtu - 4;
+	sock->sendFrags = 0;
+	sock->sendAcked = 0;
+	sock->sendLow = 0;
+	sock->srtt = 0;
+	sock->rttvar = 0;
+	sock->rto = 1.0;
+	sock->recvContig = 0;
+	sock->recvLast = -1;
+	sock->recvLength = 0;
+	memset (sock->fragReceived, 0, sizeof(sock->fragReceived));
+}
+
+static int Datagram_SendFragment (qsocket_t *sock, int frag)
+{
+	packetheader_t	header;
+	unsigned int	packetLen;
+	unsigned int	eom;
+	int				offset;
+	int				dataLen;
+
+	offset = frag * sock->fragSize;
+	dataLen = sock->sendMessageLength - offset;
+	if (dataLen <= sock->fragSize)
+		eom = NETFLAG_EOM;
+	else
+	{
+		dataLen = sock->fragSize;
+		eom = 0;
+	}
+	packetLen = NET_HEADERSIZE + 4 + dataLen;
+
+	header.length = BigLong(packetLen | (NETFLAG_DATA | eom));
+	header.sequence = BigLong(sock->ackSequence + frag);
+	header.extra = BigLong(offset);
+
+	if (Datagram_WritePacket(sock, &header, NET_HEADERSIZE + 4, sock->sendMessage + offset, dataLen, &sock->addr) == -1)
+		return -1;
+
+	if (sock->fragSentTime[frag] < 0)
+		packetsSent++;
+	else
+	{
+		sock->fragResent[frag] = true;
+		packetsReSent++;
+	}
+	sock->fragSentTime[frag] = net_time;
+	sock->lastSendTime = net_time;
+
+	return 1;
+}
+
+/*
+==================
+Datagram_WindowSend
+
+Sends the fragments that fit in the window and haven't gone out yet, and
+resends the ones whose timer ran out.
+==================
+*/
+static int Datagram_WindowSend (qsocket_t *sock)
+{
+	int			frag, window;
+	qboolean	timedout = false;
+
+	if (sock->canSend)
+		return 1;
+
+	window = CLAMP(1, (int)net_window.value, NET_MAXFRAGS);
+
+	while (sock->sendLow < sock->sendFrags && sock->fragAcked[sock->sendLow])
+		sock->sendLow++;
+
+	for (frag = sock->sendLow; frag < sock->sendFrags && frag < sock->sendLow + window; frag++)
+	{
+		if (sock->fragAcked[frag])
+			continue;
+		if (sock->fragSentTime[frag] >= 0)
+		{
+			if (net_time - sock->fragSentTime[frag] < sock->rto)
+				continue;
+			timedout = true;
+		}
+		if (Datagram_SendFragment (sock, frag) == -1)
+			return -1;
+	}
+
+	// back off until a fragment that went out only once brings a new sample
+	if (timedout)
+		sock->rto = min(sock->rto * 2, WINDOW_MAXRTO);
+
+	return 1;
+}
+
+static void Datagram_AckFragment (qsocket_t *sock, int frag)
+{
+	if (sock->fragAcked[frag])
+		return;
+	sock->fragAcked[frag] = true;
+	sock->sendAcked++;
+}
+
+static void Datagram_WindowAck (qsocket_t *sock, unsigned int sequence, unsigned int cumulative)
+{
+	unsigned int	frag;
+	int				upto;
+	double			rtt;
+
+	if (sock->canSend)
+	{
+		Con_DPrintf("Stale ACK received\n");
+		return;
+	}
+
+	frag = sequence - sock->ackSequence;
+	if (frag < (unsigned int)sock->sendFrags && !sock->fragAcked[frag])
+	{
+		// the ack of a resent fragment can't tell which copy it answers
+		if (!sock->fragResent[frag])
+		{
+			rtt = net_time - sock->fragSentTime[frag];
+			if (sock->srtt == 0)
+			{
+				sock->srtt = rtt;
+				sock->rttvar = rtt / 2;
+			}
+			else
+			{
+				sock->rttvar = 0.75 * sock->rttvar + 0.25 * fabs(sock->srtt - rtt);
+				sock->srtt = 0.875 * sock->srtt + 0.125 * rtt;
+			}
+			sock->rto = CLAMP(WINDOW_MINRTO, sock->srtt + 4 * sock->rttvar, WINDOW_MAXRTO);
+		}
+		Datagram_AckFragment (sock, frag);
+	}
+
+	// everything below cumulative arrived, which covers acks that were lost
+	upto = (int)(cumulative - sock->ackSequence);
+	if (upto > sock->sendFrags)
+		upto = sock->sendFrags;
+	for (frag = 0; (int)frag < upto; frag++)
+		Datagram_AckFragment (sock, frag);
+
+	if (sock->sendAcked == sock->sendFrags)
+	{
+		sock->ackSequence = sock->sendSequence;
+		sock->sendMessageLength = 0;
+		sock->canSend = true;
+	}
+}
+
+/*
+==================
+Datagram_WindowData
+
+Puts a reliable fragment in place and acks it. Returns 1 with the message
+in net_message once all of it is in, -1 on a bad fragment, else 0.
+==================
+*/
+static int Datagram_WindowData (qsocket_t *sock, unsigned int sequence, unsigned int flags, unsigned int length, struct qsockaddr *readaddr)
+{
+	packetheader_t	header;
+	int				frag;
+	int				offset;
+
+	frag = (int)(sequence - sock->receiveSequence);
+	if (frag >= NET_MAXFRAGS)
+		return 0;
+
+	if (frag < 0 || sock->fragReceived[frag])
+		receivedDuplicateCount++;
+	else
+	{
+		if (length < NET_HEADERSIZE + 4)
+		{
+			shortPacketCount++;
+			return 0;
+		}
+		length -= NET_HEADERSIZE + 4;
+
+		offset = BigLong(*((int *)packetBuffer.data));
+		if (offset < 0 || offset + length > NET_MAXMESSAGE)
+		{
+			Con_Warning ("Datagram_GetMessage: bad fragment offset (%d, length %d)\n", offset, length);
+			return -1;
+		}
+
+		memcpy (sock->receiveMessage + offset, packetBuffer.data + 4, length);
+		sock->fragReceived[frag] = true;
+		if (flags & NETFLAG_EOM)
+		{
+			sock->recvLast = frag;
+			sock->recvLength = offset + length;
+		}
+		while (sock->recvContig < NET_MAXFRAGS && sock->fragReceived[sock->recvContig])
+			sock->recvContig++;
+	}
+
+	// every copy is acked, the ack of the first one may have been lost
+	header.length = BigLong((NET_HEADERSIZE + 4) | NETFLAG_ACK);
+	header.sequence = BigLong(sequence);
+	header.extra = BigLong(sock->receiveSequence + sock->recvContig);
+	Datagram_WritePacket(sock, &header, NET_HEADERSIZE + 4, NULL, 0, readaddr);
+
+	if (sock->recvLast < 0 || sock->recvContig <= sock->recvLast)
+		return 0;
+
+	SZ_Clear(net_message->message);
+	SZ_Write(net_message->message, sock->receiveMessage, sock->recvLength);
+
+	sock->receiveSequence += sock->recvLast + 1;
+	sock->recvContig = 0;
+	sock->recvLast = -1;
+	sock->recvLength = 0;
+	memset (sock->fragReceived, 0, sizeof(sock->fragReceived));
+
+	return 1;
+}
+
+
 int Datagram_SendMessage (qsocket_t *sock, sizebuf_t *data)
 {
+	packetheader_t	header;
 	unsigned int	packetLen;
 	unsigned int	dataLen;
 	unsigned int	eom;
+	int				i;
 
 #ifdef DEBUG
 	if (data->cursize == 0)
@@ -134,8 +704,27 @@ int Datagram_SendMessage (qsocket_t *sock, sizebuf_t *data)
 		Host_Error ("SendMessage: called with canSend == false");
 #endif
 
+	// the caller reuses its buffer, so this is the one copy the message gets
 	memcpy(sock->sendMessage, data->data, data->cursize);
 	sock->sendMessageLength = data->cursize;
+	sock->sendOffset = 0;
+
+	if (sock->windowed)
+	{
+		sock->sendFrags = (data->cursize + sock->fragSize - 1) / sock->fragSize;
+		sock->sendAcked = 0;
+		sock->sendLow = 0;
+		for (i = 0; i < sock->sendFrags; i++)
+		{
+			sock->fragAcked[i] = false;
+			sock->fragResent[i] = false;
+			sock->fragSentTime[i] = -1;
+		}
+		sock->sendSequence = sock->ackSequence + sock->sendFrags;
+		sock->canSend = false;
+
+		return Datagram_WindowSend (sock);
+	}
 
 	if (data->cursize <= sock->mtu)
 	{
@@ -149,13 +738,12 @@ int Datagram_SendMessage (qsocket_t *sock, sizebuf_t *data)
 	}
 	packetLen = NET_HEADERSIZE + dataLen;
 
-	packetBuffer.length = BigLong(packetLen | (NETFLAG_DATA | eom));
-	packetBuffer.sequence = BigLong(sock->sendSequence++);
-	memcpy (packetBuffer.data, sock->sendMessage, dataLen);
+	header.length = BigLong(packetLen | (NETFLAG_DATA | eom));
+	header.sequence = BigLong(sock->sendSequence++);
 
 	sock->canSend = false;
 
-	if (sock->landriver->Write(sock->net_socket, (byte *)&packetBuffer, packetLen, &sock->addr) == -1)
+	if (Datagram_WritePacket(sock, &header, NET_HEADERSIZE, sock->sendMessage, dataLen, &sock->addr) == -1)
 		return -1;
 
 	sock->lastSendTime = net_time;
@@ -167,13 +755,15 @@ int Datagram_SendMessage (qsocket_t *sock, sizebuf_t *data)
 
 int SendMessageNext (qsocket_t *sock)
 {
+	packetheader_t	header;
 	unsigned int	packetLen;
 	unsigned int	dataLen;
 	unsigned int	eom;
 
-	if (sock->sendMessageLength <= sock->mtu)
+	// the acked part of the message is skipped, not shifted out
+	if (sock->sendMessageLength - sock->sendOffset <= sock->mtu)
 	{
-		dataLen = sock->sendMessageLength;
+		dataLen = sock->sendMessageLength - sock->sendOffset;
 		eom = NETFLAG_EOM;
 	}
 	else
@@ -183,13 +773,12 @@ int SendMessageNext (qsocket_t *sock)
 	}
 	packetLen = NET_HEADERSIZE + dataLen;
 
-	packetBuffer.length = BigLong(packetLen | (NETFLAG_DATA | eom));
-	packetBuffer.sequence = BigLong(sock->sendSequence++);
-	memcpy (packetBuffer.data, sock->sendMessage, dataLen);
+	header.length = BigLong(packetLen | (NETFLAG_DATA | eom));
+	header.sequence = BigLong(sock->sendSequence++);
 
 	sock->sendNext = false;
 
-	if (sock->landriver->Write(sock->net_socket, (byte *)&packetBuffer, packetLen, &sock->addr) == -1)
+	if (Datagram_WritePacket(sock, &header, NET_HEADERSIZE, sock->sendMessage + sock->sendOffset, dataLen, &sock->addr) == -1)
 		return -1;
 
 	sock->lastSendTime = net_time;
@@ -201,13 +790,15 @@ int SendMessageNext (qsocket_t *sock)
 
 int ReSendMessage (qsocket_t *sock)
 {
+	packetheader_t	header;
 	unsigned int	packetLen;
 	unsigned int	dataLen;
 	unsigned int	eom;
 
-	if (sock->sendMessageLength <= sock->mtu)
+	// the acked part of the message is skipped, not shifted out
+	if (sock->sendMessageLength - sock->sendOffset <= sock->mtu)
 	{
-		dataLen = sock->sendMessageLength;
+		dataLen = sock->sendMessageLength - sock->sendOffset;
 		eom = NETFLAG_EOM;
 	}
 	else
@@ -217,13 +808,12 @@ int ReSendMessage (qsocket_t *sock)
 	}
 	packetLen = NET_HEADERSIZE + dataLen;
 
-	packetBuffer.length = BigLong(packetLen | (NETFLAG_DATA | eom));
-	packetBuffer.sequence = BigLong(sock->sendSequence - 1);
-	memcpy (packetBuffer.data, sock->sendMessage, dataLen);
+	header.length = BigLong(packetLen | (NETFLAG_DATA | eom));
+	header.sequence = BigLong(sock->sendSequence - 1);
 
 	sock->sendNext = false;
 
-	if (sock->landriver->Write(sock->net_socket, (byte *)&packetBuffer, packetLen, &sock->addr) == -1)
+	if (Datagram_WritePacket(sock, &header, NET_HEADERSIZE, sock->sendMessage + sock->sendOffset, dataLen, &sock->addr) == -1)
 		return -1;
 
 	sock->lastSendTime = net_time;
@@ -235,7 +825,9 @@ int ReSendMessage (qsocket_t *sock)
 
 qboolean Datagram_CanSendMessage (qsocket_t *sock)
 {
-	if (sock->sendNext)
+	if (sock->windowed)
+		Datagram_WindowSend (sock);
+	else if (sock->sendNext)
 		SendMessageNext (sock);
 
 	return sock->canSend;
@@ -250,6 +842,7 @@ qboolean Datagram_CanSendUnreliableMessage (qsocket_t *sock)
 
 int Datagram_SendUnreliableMessage (qsocket_t *sock, sizebuf_t *data)
 {
+	packetheader_t	header;
 	int 	packetLen;
 
 #ifdef DEBUG
@@ -262,11 +855,10 @@ int Datagram_SendUnreliableMessage (qsocket_t *sock, sizebuf_t *data)
 
 	packetLen = NET_HEADERSIZE + data->cursize;
 
-	packetBuffer.length = BigLong(packetLen | NETFLAG_UNRELIABLE);
-	packetBuffer.sequence = BigLong(sock->unreliableSendSequence++);
-	memcpy (packetBuffer.data, data->data, data->cursize);
+	header.length = BigLong(packetLen | NETFLAG_UNRELIABLE);
+	header.sequence = BigLong(sock->unreliableSendSequence++);
 
-	if (sock->landriver->Write(sock->net_socket, (byte *)&packetBuffer, packetLen, &sock->addr) == -1)
+	if (Datagram_WritePacket(sock, &header, NET_HEADERSIZE, data->data, data->cursize, &sock->addr) == -1)
 		return -1;
 
 	packetsSent++;
@@ -276,6 +868,7 @@ int Datagram_SendUnreliableMessage (qsocket_t *sock, sizebuf_t *data)
 
 int	Datagram_GetMessage (qsocket_t *sock)
 {
+	packetheader_t	header;
 	unsigned int	length;
 	unsigned int	flags;
 	int				ret = 0;
@@ -284,13 +877,15 @@ int	Datagram_GetMessage (qsocket_t *sock)
 	unsigned int	count;
 
 	// If there is an outstanding reliable packet and more than 1 second has passed, resend the packet.
-	if (!sock->canSend)
+	if (sock->windowed)
+		Datagram_WindowSend (sock);
+	else if (!sock->canSend)
 		if ((net_time - sock->lastSendTime) > 1.0)
 			ReSendMessage (sock);
 
 	while(1)
 	{
-		length = sock->landriver->Read(sock->net_socket, (byte *)&packetBuffer, NET_DATAGRAMSIZE, &readaddr);
+		length = Datagram_Read(sock, (byte *)&packetBuffer, NET_DATAGRAMSIZE, &readaddr);
 /*
 		// for testing packet loss effects
 		if ((rand() & 255) > 220)
@@ -375,6 +970,11 @@ int	Datagram_GetMessage (qsocket_t *sock)
 
 		if (flags & NETFLAG_ACK)
 		{
+			if (sock->windowed)
+			{
+				Datagram_WindowAck (sock, sequence, (length >= NET_HEADERSIZE + 4) ? BigLong(*((int *)packetBuffer.data)) : sock->ackSequence);
+				continue;
+			}
 			if (sequence != (sock->sendSequence - 1))
 			{
 				Con_DPrintf("Stale ACK received\n");
@@ -391,16 +991,13 @@ int	Datagram_GetMessage (qsocket_t *sock)
 				Con_DPrintf("Duplicate ACK received\n");
 				continue;
 			}
-			sock->sendMessageLength -= sock->mtu;
-			if (sock->sendMessageLength > 0)
-			{
-				// using memcpy within the same buffer is not safe, replaced by memmove
-				memmove(sock->sendMessage, sock->sendMessage + sock->mtu, sock->sendMessageLength);
+			sock->sendOffset += sock->mtu;
+			if (sock->sendOffset < sock->sendMessageLength)
 				sock->sendNext = true;
-			}
 			else
 			{
 				sock->sendMessageLength = 0;
+				sock->sendOffset = 0;
 				sock->canSend = true;
 			}
 			continue;
@@ -408,9 +1005,19 @@ int	Datagram_GetMessage (qsocket_t *sock)
 
 		if (flags & NETFLAG_DATA)
 		{
-			packetBuffer.length = BigLong(NET_HEADERSIZE | NETFLAG_ACK);
-			packetBuffer.sequence = BigLong(sequence);
-			sock->landriver->Write(sock->net_socket, (byte *)&packetBuffer, NET_HEADERSIZE, &readaddr);
+			if (sock->windowed)
+			{
+				ret = Datagram_WindowData (sock, sequence, flags, length, &readaddr);
+				if (ret == -1)
+					return -1;
+				if (ret == 1)
+					break;
+				continue;
+			}
+
+			header.length = BigLong(NET_HEADERSIZE | NETFLAG_ACK);
+			header.sequence = BigLong(sequence);
+			Datagram_WritePacket(sock, &header, NET_HEADERSIZE, NULL, 0, &readaddr);
 
 			if (sequence != sock->receiveSequence)
 			{
@@ -439,7 +1046,9 @@ int	Datagram_GetMessage (qsocket_t *sock)
 		}
 	}
 
-	if (sock->sendNext)
+	if (sock->windowed)
+		Datagram_WindowSend (sock);
+	else if (sock->sendNext)
 		SendMessageNext (sock);
 
 	return ret;
@@ -1010,6 +1619,8 @@ int Datagram_Init (void)
 
 	dgrm_driver = net_driver;
 	Cmd_AddCommand ("net_stats", NET_Stats_f);
+	Cvar_RegisterVariable (&net_sharedsocket);
+	Cvar_RegisterVariable (&net_window);
 
 	if (COM_CheckParm("-nolan"))
 		return -1;
@@ -1044,6 +1655,8 @@ void Datagram_Shutdown (void)
 {
 	int i;
 
+	Datagram_Flush ();
+
 //
 // shutdown the lan drivers
 //
@@ -1060,6 +1673,17 @@ void Datagram_Shutdown (void)
 
 void Datagram_Close (qsocket_t *sock)
 {
+	if (sock->shared)
+	{
+		// the listen socket stays open for everyone else
+		Datagram_Flush ();
+		Datagram_FreeQueue (&sock->sharedhead, &sock->sharedtail, &sock->sharedcount);
+		dgrm_numshared--;
+		if (!dgrm_numshared && !dgrm_listening)
+			Datagram_Listen (false);	// was put off until the last one left
+		return;
+	}
+
 	sock->landriver->CloseSocket(sock->net_socket);
 }
 
@@ -1068,6 +1692,13 @@ void Datagram_Listen (qboolean state)
 {
 	int i;
 
+	dgrm_listening = state;
+
+	// shared qsockets live on the listen socket, closing it would drop them;
+	// new connections aren't checked for while not listening anyway
+	if (!state && dgrm_numshared)
+		return;
+
 	for (i = 0; i < net_numlandrivers; i++)
 		if (net_landrivers[i].initialized)
 			net_landrivers[i].Listen (state);
@@ -1088,15 +1719,30 @@ static qsocket_t *_Datagram_CheckNewConnections (net_landriver_t *driver)
 	int			command;
 	int			control;
 	int			ret;
+	int			d;
+	qboolean	shared;
 	byte		mod, mod_version, mod_flags; // bugfix!
 
-	acceptsock = driver->CheckNewConnections();
+	shared = Datagram_SharedMode (driver);
+	if (shared)
+		acceptsock = driver->AcceptSocket();
+	else
+		acceptsock = driver->CheckNewConnections();
 	if (acceptsock == INVALID_SOCKET)
 		return NULL;
 
 	SZ_Clear(net_message->message);
 
-	len = driver->Read(acceptsock, net_message->message->data, net_message->message->maxsize, &clientaddr);
+	if (shared)
+	{
+		// the listen socket is read by Datagram_DrainShared, requests wait in their queue
+		Datagram_InitShared ();
+		Datagram_DrainShared (driver);
+		d = driver - net_landrivers;
+		len = Datagram_PopPacket (&shared_ctlhead[d], &shared_ctltail[d], &shared_ctlcount[d], net_message->message->data, net_message->message->maxsize, &clientaddr);
+	}
+	else
+		len = driver->Read(acceptsock, net_message->message->data, net_message->message->maxsize, &clientaddr);
 	if (len < (int)sizeof(int))
 		return NULL;
 
@@ -1291,6 +1937,10 @@ static qsocket_t *_Datagram_CheckNewConnections (net_landriver_t *driver)
 				MSG_WriteByte(net_message->message, CCREP_ACCEPT);
 				driver->GetSocketAddr(s->net_socket, &newaddr);
 				MSG_WriteLong(net_message->message, driver->GetSocketPort(&newaddr));
+				// the flags must match the first reply or the client may pick the wrong channel
+				MSG_WriteByte(net_message->message, MOD_PROQUAKE); // (compat. with PQ)
+				MSG_WriteByte(net_message->message, PROQUAKE_VERSION * 10); // (compat. with PQ)
+				MSG_WriteByte(net_message->message, s->windowed ? MODF_WINDOW : 0);
 				*((int *)net_message->message->data) = BigLong(NETFLAG_CTL | (net_message->message->cursize & NETFLAG_LENGTH_MASK));
 				driver->Write(acceptsock, net_message->message->data, net_message->message->cursize, &clientaddr);
 				SZ_Clear(net_message->message);
@@ -1347,19 +1997,30 @@ static qsocket_t *_Datagram_CheckNewConnections (net_landriver_t *driver)
 	}
 
 	// allocate a network socket
-	newsock = driver->OpenSocket(0);
-	if (newsock == INVALID_SOCKET)
+	if (shared)
 	{
-		NET_FreeQSocket(sock);
-		return NULL;
+		newsock = acceptsock;
+		sock->shared = true;
+		sock->sharedhead = sock->sharedtail = -1;
+		sock->sharedcount = 0;
+		dgrm_numshared++;
+	}
+	else
+	{
+		newsock = driver->OpenSocket(0);
+		if (newsock == INVALID_SOCKET)
+		{
+			NET_FreeQSocket(sock);
+			return NULL;
+		}
 	}
 
 	// support for mods
 	sock->mod = mod;
 	sock->mod_version = mod_version;
 	sock->mod_flags = mod_flags;
-	if (mod == MOD_PROQUAKE && mod_version >= 34)
-		sock->net_wait = true; // ProQuake NAT fix
+	if (mod == MOD_PROQUAKE && mod_version >= 34 && !shared)
+		sock->net_wait = true; // ProQuake NAT fix (no private port when shared)
 
 	// everything is allocated, just fill in the details	
 	sock->net_socket = newsock;
@@ -1367,6 +2028,8 @@ static qsocket_t *_Datagram_CheckNewConnections (net_landriver_t *driver)
 	sock->addr = clientaddr;
 	strcpy(sock->address, driver->AddrToString(&clientaddr));
 	sock->mtu = driver->GetDefaultMTU() - NET_HEADERSIZE;
+	if (mod == MOD_PROQUAKE && (mod_flags & MODF_WINDOW) && net_window.value > 1)
+		Datagram_InitWindow (sock);
 
 	// send him back the info about the server connection he has been allocated
 	SZ_Clear(net_message->message);
@@ -1378,7 +2041,7 @@ static qsocket_t *_Datagram_CheckNewConnections (net_landriver_t *driver)
 	MSG_WriteLong(net_message->message, sock->client_port);
 	MSG_WriteByte(net_message->message, MOD_PROQUAKE); // (compat. with PQ)
 	MSG_WriteByte(net_message->message, PROQUAKE_VERSION * 10); // (compat. with PQ)
-	MSG_WriteByte(net_message->message, 0); // reserved (flags) (compat. with PQ) 
+	MSG_WriteByte(net_message->message, sock->windowed ? MODF_WINDOW : 0); // flags (compat. with PQ)
 	*((int *)net_message->message->data) = BigLong(NETFLAG_CTL | (net_message->message->cursize & NETFLAG_LENGTH_MASK));
 	driver->Write(acceptsock, net_message->message->data, net_message->message->cursize, &clientaddr);
 	SZ_Clear(net_message->message);
@@ -1534,6 +2197,7 @@ static qsocket_t *_Datagram_Connect (char *host, net_landriver_t *driver)
 	double		start_time;
 	int			control;
 	char		*reason;
+	qboolean	askwindow;
 
 	// see if we can resolve the host name
 	if (driver->GetAddrFromName(host, &sendaddr) == -1)
@@ -1553,6 +2217,8 @@ static qsocket_t *_Datagram_Connect (char *host, net_landriver_t *driver)
 	sock->landriver = driver;
 	sock->mtu = driver->GetDefaultMTU() - NET_HEADERSIZE;
 
+	askwindow = (net_window.value > 1);
+
 	// send the connection request
 	Con_Printf("trying...\n"); 
 	SCR_UpdateScreen ();
@@ -1568,7 +2234,7 @@ static qsocket_t *_Datagram_Connect (char *host, net_landriver_t *driver)
 		MSG_WriteByte(net_message->message, NET_PROTOCOL_VERSION);
 		MSG_WriteByte(net_message->message, MOD_PROQUAKE); // (compat. with PQ)
 		MSG_WriteByte(net_message->message, PROQUAKE_VERSION * 10); // (compat. with PQ)
-		MSG_WriteByte(net_message->message, 0); // reserverd (flags) (compat. with PQ)
+		MSG_WriteByte(net_message->message, askwindow ? MODF_WINDOW : 0); // flags (compat. with PQ)
 		MSG_WriteLong(net_message->message, pq_password.value); // password protected servers
 		*((int *)net_message->message->data) = BigLong(NETFLAG_CTL | (net_message->message->cursize & NETFLAG_LENGTH_MASK));
 		driver->Write(newsock, net_message->message->data, net_message->message->cursize, &sendaddr);
@@ -1674,6 +2340,9 @@ static qsocket_t *_Datagram_Connect (char *host, net_landriver_t *driver)
 			sock->mod_flags = MSG_ReadByte(net_message);
 		else
 			sock->mod_flags = 0;
+
+		if (askwindow && sock->mod == MOD_PROQUAKE && (sock->mod_flags & MODF_WINDOW))
+			Datagram_InitWindow (sock);
 	}
 	else
 	{
@@ -46,6 +46,10 @@ static void Slist_Poll(void);
 static PollProcedure	slistSendProcedure = {NULL, 0.0, Slist_Send};
 static PollProcedure	slistPollProcedure = {NULL, 0.0, Slist_Poll};
 
+static void SendAll_Poll(void);
+static PollProcedure	sendAllPollProcedure = {NULL, 0.0, SendAll_Poll};
+static qboolean	sendAllScheduled;
+
 
 static sizebuf_t _net_message_message;
 static qmsg_t _net_message = { 0, false, &_net_message_message };
@@ -121,9 +125,15 @@ qsocket_t *NET_NewQSocket (void)
 	sock->sendSequence = 0;
 	sock->unreliableSendSequence = 0;
 	sock->sendMessageLength = 0;
+	sock->sendOffset = 0;
 	sock->receiveSequence = 0;
 	sock->unreliableReceiveSequence = 0;
 	sock->receiveMessageLength = 0;
+	sock->shared = false;
+	sock->windowed = false;
+	sock->queuedLength = 0;
+	sock->queueSent = false;
+	sock->lingering = false;
 
 	return sock;
 }
@@ -461,8 +471,10 @@ qsocket_t *NET_CheckNewConnections (void)
 {
 	int i;
 	qsocket_t *ret = NULL;
+	double start;
 
 	SetNetTime();
+	start = Host_FrameStatStart ();
 
 	for (i = 0; i < net_numdrivers; i++) 
 	{
@@ -477,9 +489,126 @@ qsocket_t *NET_CheckNewConnections (void)
 			break;
 	}
 
+	Host_FrameStatStop (FS_NET, start);
 	return ret;
 }
 
+/*
+===================
+NET_Flush
+===================
+*/
+void NET_Flush (void)
+{
+	double	start;
+	int		i;
+
+	start = Host_FrameStatStart ();
+	for (i = 0; i < net_numdrivers; i++)
+		if (net_drivers[i].initialized && net_drivers[i].Flush)
+			net_drivers[i].Flush ();
+	Host_FrameStatStop (FS_NET, start);
+}
+
+/*
+===================
+NET_PumpQueue
+
+Hands what NET_SendToAll queued to the driver once the socket can take a
+reliable message, and sees it acked. Returns true when nothing is left on
+its way, which includes giving up on a client after its timeout.
+===================
+*/
+static qboolean NET_PumpQueue (qsocket_t *sock)
+{
+	sizebuf_t	buf;
+
+	if (!sock->queuedLength && !sock->queueSent)
+		return true;
+
+	if (sock->driver->CanSendMessage(sock))
+	{
+		sock->queueSent = false;
+		if (!sock->queuedLength)
+			return true; // acked
+
+		memset (&buf, 0, sizeof(buf));
+		buf.data = sock->queuedMessage;
+		buf.maxsize = buf.cursize = sock->queuedLength;
+		sock->queuedLength = 0;
+
+		// a dead connection is left for NET_GetMessage to report
+		if (sock->driver->QSendMessage(sock, &buf) == -1)
+			return true;
+
+		messagesSent++;
+		sock->queueSent = true;
+		return false;
+	}
+
+	if (net_time > sock->queueTimeout)
+	{
+		// a slow client doesn't hold up anybody else
+		if (sock->queuedLength)
+			Con_DPrintf ("NET_SendToAll: gave up on %s\n", sock->address);
+		sock->queuedLength = 0;
+		sock->queueSent = false;
+		return true;
+	}
+
+	return false;
+}
+
+static void NET_ScheduleSendAll (void)
+{
+	if (sendAllScheduled)
+		return;
+	sendAllScheduled = true;
+	SchedulePollProcedure(&sendAllPollProcedure, 0.01);
+}
+
+/*
+===================
+SendAll_Poll
+
+Runs from NET_Poll every frame while anything NET_SendToAll queued is on
+its way. Live sockets are also pumped by NET_CanSendMessage, but closed
+ones that linger for their acks have nobody else reading them.
+===================
+*/
+static void SendAll_Poll(void)
+{
+	qsocket_t	*sock;
+	qsocket_t	*next;
+	qboolean	waiting = false;
+	int			ret;
+
+	sendAllScheduled = false;
+
+	for (sock = net_activeSockets; sock; sock = next)
+	{
+		next = sock->next;
+
+		if (sock->lingering)
+		{
+			while ((ret = sock->driver->QGetMessage(sock)) > 0)
+				;
+			if (ret == -1 || NET_PumpQueue (sock))
+			{
+				sock->driver->Close(sock);
+				NET_FreeQSocket(sock);
+				continue;
+			}
+			waiting = true;
+		}
+		else if (!NET_PumpQueue (sock))
+			waiting = true;
+	}
+
+	if (waiting)
+		NET_ScheduleSendAll ();
+}
+
 /*
 ===================
 NET_Close
@@ -495,6 +624,14 @@ void NET_Close (qsocket_t *sock)
 
 	SetNetTime();
 
+	// keep it open until what NET_SendToAll queued has been acked
+	if (!sock->lingering && !NET_PumpQueue (sock))
+	{
+		sock->lingering = true;
+		NET_ScheduleSendAll ();
+		return;
+	}
+
 	// call the driver_Close function
 	sock->driver->Close(sock);
 
@@ -516,6 +653,7 @@ returns -1 if connection is invalid
 int NET_GetMessage (qsocket_t *sock)
 {
 	int ret;
+	double start;
 
 	if (!sock)
 		return -1;
@@ -528,7 +666,9 @@ int NET_GetMessage (qsocket_t *sock)
 
 	SetNetTime();
 
+	start = Host_FrameStatStart ();
 	ret = sock->driver->QGetMessage(sock);
+	Host_FrameStatStop (FS_NET, start);
 
 	// see if this connection has timed out (not for loop)
 	if (ret == 0 && (!IS_LOOP_DRIVER(sock->driver)))
@@ -579,6 +719,7 @@ returns -1 if the connection died
 int NET_SendMessage (qsocket_t *sock, sizebuf_t *data)
 {
 	int r;
+	double start;
 	
 	if (!sock)
 		return -1;
@@ -591,7 +732,9 @@ int NET_SendMessage (qsocket_t *sock, sizebuf_t *data)
 
 	SetNetTime();
 
+	start = Host_FrameStatStart ();
 	r = sock->driver->QSendMessage(sock, data);
+	Host_FrameStatStop (FS_NET, start);
 
 	if (r == 1 && !IS_LOOP_DRIVER(sock->driver))
 		messagesSent++;
@@ -603,6 +746,7 @@ int NET_SendMessage (qsocket_t *sock, sizebuf_t *data)
 int NET_SendUnreliableMessage (qsocket_t *sock, sizebuf_t *data)
 {
 	int r;
+	double start;
 
 	if (!sock)
 		return -1;
@@ -615,7 +759,9 @@ int NET_SendUnreliableMessage (qsocket_t *sock, sizebuf_t *data)
 
 	SetNetTime();
 
+	start = Host_FrameStatStart ();
 	r = sock->driver->SendUnreliableMessage(sock, data);
+	Host_FrameStatStop (FS_NET, start);
 
 	if (r == 1 && !IS_LOOP_DRIVER(sock->driver))
 		unreliableMessagesSent++;
@@ -644,6 +790,10 @@ qboolean NET_CanSendMessage (qsocket_t *sock)
 
 	SetNetTime();
 
+	// anything NET_SendToAll queued goes out ahead of the caller's message
+	if (!NET_PumpQueue (sock))
+		return false;
+
 	r = sock->driver->CanSendMessage(sock);
 
 	return r;
@@ -654,80 +804,48 @@ qboolean NET_CanSendMessage (qsocket_t *sock)
 NET_SendToAll
 
 added nolocals parameter
+queued instead of blocking until every client acked it
 ==================
 */
 int NET_SendToAll (sizebuf_t *data, int blocktime, qboolean nolocals)
 {
-	double		start;
+	qsocket_t	*sock;
 	int			i;
 	int			count = 0;
-	qboolean msg_init[MAX_SCOREBOARD]; /* data written */
-	qboolean msg_sent[MAX_SCOREBOARD]; /* send completed */
+
+	SetNetTime();
 
 	for (i = 0, host_client = svs.clients ; i < svs.maxclients ; i++, host_client++)
 	{
-		if (host_client->netconnection && host_client->active) 
-		{
-
-			// Loopback driver guarantees delivery, skip checks
-			if (IS_LOOP_DRIVER(host_client->netconnection->driver))
-			{
-				if (!nolocals)
-					NET_SendMessage(host_client->netconnection, data);
+		sock = host_client->netconnection;
+		if (!sock || !host_client->active)
+			continue;
 
-				msg_init[i] = true;
-				msg_sent[i] = true;
-				continue;
-			}
-			count++;
-			msg_init[i] = false;
-			msg_sent[i] = false;
-		}
-		else
+		// Loopback driver guarantees delivery, skip checks
+		if (IS_LOOP_DRIVER(sock->driver))
 		{
-			msg_init[i] = true;
-			msg_sent[i] = true;
+			if (!nolocals)
+				NET_SendMessage(sock, data);
+			continue;
 		}
-	}
 
-	start = Sys_DoubleTime();
-	while (count)
-	{
-		count = 0;
-		for (i = 0, host_client = svs.clients ; i < svs.maxclients ; i++, host_client++)
+		if (sock->queuedLength + data->cursize > NET_QUEUESIZE)
 		{
-			if (!msg_init[i])
-			{
-				if (NET_CanSendMessage (host_client->netconnection))
-				{
-					msg_init[i] = true;
-					NET_SendMessage(host_client->netconnection, data);
-				}
-				else
-				{
-					NET_GetMessage (host_client->netconnection);
-				}
-				count++;
-				continue;
-			}
-
-			if (!msg_sent[i])
-			{
-				if (NET_CanSendMessage (host_client->netconnection))
-				{
-					msg_sent[i] = true;
-				}
-				else
-				{
-					NET_GetMessage (host_client->netconnection);
-				}
-				count++;
-				continue;
-			}
+			Con_DPrintf ("NET_SendToAll: queue full for %s\n", sock->address);
+			count++;
+			continue;
 		}
-		if ((Sys_DoubleTime() - start) > blocktime)
-			break;
+		memcpy (sock->queuedMessage + sock->queuedLength, data->data, data->cursize);
+		sock->queuedLength += data->cursize;
+		sock->queueTimeout = net_time + blocktime;
+
+		if (!NET_PumpQueue (sock))
+			count++;
 	}
+
+	if (count)
+		NET_ScheduleSendAll ();
+
 	return count;
 }
 
@@ -828,7 +946,12 @@ void		NET_Shutdown (void)
 	SetNetTime();
 
 	for (sock = net_activeSockets; sock; sock = sock->next)
+	{
+		// no time left to wait for acks
+		sock->queuedLength = 0;
+		sock->queueSent = false;
 		NET_Close(sock);
+	}
 
 
 	// shutdown the drivers
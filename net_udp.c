@@ -19,6 +19,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 // net_udp.c
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE	// recvmmsg, sendmmsg
+#endif
+
 #include "quakedef.h"
 #include "unixquake.h"
 
@@ -30,6 +34,11 @@ static sys_socket_t net_controlsocket;
 static sys_socket_t net_broadcastsocket = 0;
 static struct sockaddr_in broadcastaddr;
 
+// every open socket, for UDP_Wait
+#define	MAX_UDP_SOCKETS		(MAX_SCOREBOARD + 8)
+static struct pollfd	udp_pollfds[MAX_UDP_SOCKETS];
+static int	udp_numpollfds;
+
 /*
 There are three addresses that we may use in different ways:
 	myAddr	- This is the "default" address returned by the OS
@@ -260,8 +269,17 @@ sys_socket_t UDP_OpenSocket (int port)
 
 	if (bind(newsocket, (struct sockaddr *)&address, sizeof(address)) == -1)
 		goto ErrorReturn;
+
+	if (udp_numpollfds < MAX_UDP_SOCKETS)
+	{
+		udp_pollfds[udp_numpollfds].fd = newsocket;
+		udp_pollfds[udp_numpollfds].events = POLLIN;
+		udp_numpollfds++;
+	}
 	else
-		return newsocket;
+		Con_DPrintf ("UDP_OpenSocket: too many sockets to wait on\n");
+
+	return newsocket;
 
 ErrorReturn:
 	if (tcpipAvailable)
@@ -277,12 +295,44 @@ ErrorReturn:
 
 int UDP_CloseSocket (sys_socket_t net_socket)
 {
+	int		i;
+
 	if (net_socket == net_broadcastsocket)
 		net_broadcastsocket = 0;
 
+	for (i=0 ; i<udp_numpollfds ; i++)
+	{
+		if (udp_pollfds[i].fd == net_socket)
+		{
+			udp_pollfds[i] = udp_pollfds[--udp_numpollfds];
+			break;
+		}
+	}
+
 	return close(net_socket);
 }
 
+//=============================================================================
+
+/*
+============
+UDP_Wait
+
+Blocks until a packet arrives on any open socket or timeout seconds have
+passed, returns true if there is something to read
+============
+*/
+qboolean UDP_Wait (double timeout)
+{
+	int		ms;
+
+	ms = (int)ceil(timeout * 1000.0);
+	if (ms < 0)
+		ms = 0;
+
+	return poll (udp_pollfds, udp_numpollfds, ms) > 0;
+}
+
 
 //=============================================================================
 /*
@@ -379,6 +429,120 @@ int UDP_Read (sys_socket_t net_socket, byte *buf, int len, struct qsockaddr *add
 
 //=============================================================================
 
+sys_socket_t UDP_AcceptSocket (void)
+{
+	return net_acceptsocket;
+}
+
+//=============================================================================
+
+#define	UDP_BATCH	64	// datagrams per recvmmsg/sendmmsg call
+
+int UDP_ReadMany (sys_socket_t net_socket, netpacket_t *packets, int count)
+{
+#ifdef __linux__
+	struct mmsghdr	msgs[UDP_BATCH];
+	struct iovec	iovs[UDP_BATCH];
+	int i, ret;
+
+	if (count > UDP_BATCH)
+		count = UDP_BATCH;
+
+	memset (msgs, 0, count * sizeof(msgs[0]));
+	for (i = 0; i < count; i++)
+	{
+		iovs[i].iov_base = packets[i].data;
+		iovs[i].iov_len = packets[i].length;
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_name = &packets[i].addr;
+		msgs[i].msg_hdr.msg_namelen = sizeof(struct qsockaddr);
+	}
+
+	ret = recvmmsg(net_socket, msgs, count, 0, NULL);
+	if (ret == SOCKET_ERROR)
+	{
+		if (errno == EWOULDBLOCK || errno == ECONNREFUSED)
+			return 0;
+		return -1;
+	}
+
+	// a truncated datagram comes back empty so the caller drops it
+	for (i = 0; i < ret; i++)
+		packets[i].length = (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) ? 0 : (int)msgs[i].msg_len;
+
+	return ret;
+#else
+	int i, ret;
+
+	for (i = 0; i < count; i++)
+	{
+		ret = UDP_Read (net_socket, packets[i].data, packets[i].length, &packets[i].addr);
+		if (ret == -1 && i == 0)
+			return -1;
+		if (ret <= 0)
+			break;
+		packets[i].length = ret;
+	}
+
+	return i;
+#endif
+}
+
+//=============================================================================
+
+int UDP_WriteMany (sys_socket_t net_socket, netpacket_t *packets, int count)
+{
+#ifdef __linux__
+	struct mmsghdr	msgs[UDP_BATCH];
+	struct iovec	iovs[UDP_BATCH];
+	int i, n, ret, sent;
+
+	for (sent = 0; sent < count; sent += ret)
+	{
+		n = count - sent;
+		if (n > UDP_BATCH)
+			n = UDP_BATCH;
+
+		memset (msgs, 0, n * sizeof(msgs[0]));
+		for (i = 0; i < n; i++)
+		{
+			iovs[i].iov_base = packets[sent + i].data;
+			iovs[i].iov_len = packets[sent + i].length;
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			msgs[i].msg_hdr.msg_name = &packets[sent + i].addr;
+			msgs[i].msg_hdr.msg_namelen = sizeof(struct qsockaddr);
+		}
+
+		ret = sendmmsg(net_socket, msgs, n, 0);
+		if (ret == SOCKET_ERROR)
+		{
+			// like UDP_Write, a full send buffer just loses the datagrams
+			if (errno == EWOULDBLOCK)
+				return sent;
+			return (sent > 0) ? sent : -1;
+		}
+		if (ret == 0)
+			break;
+	}
+
+	return sent;
+#else
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		if (UDP_Write (net_socket, packets[i].data, packets[i].length, &packets[i].addr) == -1)
+			return (i > 0) ? i : -1;
+	}
+
+	return count;
+#endif
+}
+
+//=============================================================================
+
 int UDP_MakeSocketBroadcastCapable (sys_socket_t net_socket)
 {
 	int	i = 1;
@@ -432,6 +596,35 @@ int UDP_Write (sys_socket_t net_socket, byte *buf, int len, struct qsockaddr *ad
 
 //=============================================================================
 
+int UDP_WriteParts (sys_socket_t net_socket, byte *head, int headlen, byte *data, int datalen, struct qsockaddr *addr)
+{
+	struct msghdr	msg;
+	struct iovec	iov[2];
+	int ret;
+
+	iov[0].iov_base = head;
+	iov[0].iov_len = headlen;
+	iov[1].iov_base = data;
+	iov[1].iov_len = datalen;
+
+	memset (&msg, 0, sizeof(msg));
+	msg.msg_name = addr;
+	msg.msg_namelen = sizeof(struct qsockaddr);
+	msg.msg_iov = iov;
+	msg.msg_iovlen = (datalen > 0) ? 2 : 1;
+
+	ret = (int)sendmsg(net_socket, &msg, 0);
+	if (ret == SOCKET_ERROR)
+	{
+		if (errno == EWOULDBLOCK)
+			return 0;
+	}
+
+	return ret;
+}
+
+//=============================================================================
+
 char *UDP_AddrToString (struct qsockaddr *addr)
 {
 	static char buffer[22];
@@ -37,3 +37,8 @@ int  UDP_GetDefaultMTU (void);
 int  UDP_AddrCompare (struct qsockaddr *addr1, struct qsockaddr *addr2);
 int  UDP_GetSocketPort (struct qsockaddr *addr);
 int  UDP_SetSocketPort (struct qsockaddr *addr, int port);
+sys_socket_t  UDP_AcceptSocket (void);
+int  UDP_ReadMany (sys_socket_t net_socket, netpacket_t *packets, int count);
+int  UDP_WriteMany (sys_socket_t net_socket, netpacket_t *packets, int count);
+int  UDP_WriteParts (sys_socket_t net_socket, byte *head, int headlen, byte *data, int datalen, struct qsockaddr *addr);
+qboolean UDP_Wait (double timeout);
@@ -57,7 +57,8 @@ net_driver_t net_drivers[MAX_NET_DRIVERS] =
 		Datagram_CanSendMessage,
 		Datagram_CanSendUnreliableMessage,
 		Datagram_Close,
-		Datagram_Shutdown
+		Datagram_Shutdown,
+		Datagram_Flush
 	}
 };
 
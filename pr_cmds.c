@@ -264,6 +264,7 @@ void PF_setmodel (void)
 
 	e->v.model = PR_SetString(m);
 	e->v.modelindex = i; //SV_ModelIndex (m);
+	ED_UpdateFindIndex (e, -1);
 
 	mod = sv.models[ (int)e->v.modelindex];  // Mod_ForName (m, true);
 
@@ -547,7 +548,7 @@ void PF_ambientsound (void)
 	//johnfitz -- PROTOCOL_FITZQUAKE
 	if (soundnum > 255)
 	{
-		if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ)
+		if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ || sv.protocol == PROTOCOL_DELTA)
 			large = true;
 		else
 			return; // don't send any info protocol can't support
@@ -907,12 +908,30 @@ void PF_cvar_set (void)
 	Cvar_Set (var, val);
 }
 
+cvar_t	sv_fastfindradius = {"sv_fastfindradius", "0", CVAR_NONE};	// 1 = only look at linked edicts near org, for mods that always relink what they move
+
+static	edict_t	**findradius_list;
+static	int		findradius_size;
+
+static int FindRadiusCompare (const void *a, const void *b)
+{
+	byte	*ea = *(byte **)a;
+	byte	*eb = *(byte **)b;
+
+	return (ea > eb) - (ea < eb);
+}
+
 /*
 =================
 PF_findradius
 
 Returns a chain of entities that have origins within a spherical area
 
+The center of an entity's box is always inside the abs box it was linked
+with, so only the edicts the area tree has within the radius on each axis
+need to be looked at.  They are put back in edict order so the chain comes
+out the same as from a scan of every edict.
+
 findradius (origin, radius)
 =================
 */
@@ -921,17 +940,39 @@ void PF_findradius (void)
 	edict_t	*ent, *chain;
 	float	rad;
 	float	*org;
-	vec3_t	eorg;
-	int	i, j;
+	vec3_t	eorg, mins, maxs;
+	int	i, j, count;
 
 	chain = (edict_t *)sv.edicts;
 
 	org = G_VECTOR(OFS_PARM0);
 	rad = G_FLOAT(OFS_PARM1);
 
+	if (sv_fastfindradius.value)
+	{
+		if (findradius_size < sv.num_edicts)
+		{
+			findradius_size = sv.max_edicts;
+			findradius_list = Z_Realloc (findradius_list, findradius_size * sizeof(edict_t *));
+		}
+
+		for (j=0 ; j<3 ; j++)
+		{
+			mins[j] = org[j] - rad;
+			maxs[j] = org[j] + rad;
+		}
+
+		count = SV_AreaEdicts (mins, maxs, findradius_list, sv.num_edicts);
+		qsort (findradius_list, count, sizeof(edict_t *), FindRadiusCompare);
+	}
+	else
+		count = sv.num_edicts - 1;
+
 	ent = NEXT_EDICT(sv.edicts);
-	for (i=1 ; i<sv.num_edicts ; i++, ent = NEXT_EDICT(ent))
+	for (i=0 ; i<count ; i++, ent = NEXT_EDICT(ent))
 	{
+		if (sv_fastfindradius.value)
+			ent = findradius_list[i];
 		if (ent->free)
 			continue;
 		if (ent->v.solid == SOLID_NOT)
@@ -1071,6 +1112,14 @@ void PF_Find (void)
 	if (!s)
 		PR_RunError ("PF_Find: bad search string");
 
+	pr_findcalls++;
+	if (ED_FindIndexed (e, f, s, &ed))
+	{
+		pr_findindexed++;
+		RETURN_EDICT(ed);
+		return;
+	}
+
 	for (e++ ; e < sv.num_edicts ; e++)
 	{
 		ed = EDICT_NUM(e);
@@ -1500,7 +1549,7 @@ void PF_changepitch (void)
 		return; // just fail silently
 
 	current = anglemod( ent->v.angles[0] );
-	val = GetEdictFieldValue(ent, "idealpitch");
+	val = GetEdictFieldValue(ent, pr_extfields.idealpitch);
 	if (val)
 		ideal = val->_float;
 	else
@@ -1508,7 +1557,7 @@ void PF_changepitch (void)
 		PR_RunError ("PF_changepitch: idealpitch and pitch_speed must be defined to use changepitch");
 		return;
 	}
-	val = GetEdictFieldValue(ent, "pitch_speed");
+	val = GetEdictFieldValue(ent, pr_extfields.pitch_speed);
 	if (val)
 		speed = val->_float;
 	else
@@ -1650,7 +1699,7 @@ void PF_makestatic (void)
 	//johnfitz
 
 	//johnfitz -- PROTOCOL_FITZQUAKE
-	if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ)
+	if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ || sv.protocol == PROTOCOL_DELTA)
 	{
 		if (SV_ModelIndex(PR_GetString(ent->v.model)) & 0xFF00)
 			bits |= B_LARGEMODEL;
@@ -1659,10 +1708,10 @@ void PF_makestatic (void)
 		if (ent->alpha != ENTALPHA_DEFAULT)
 			bits |= B_ALPHA;
 		
-		if (sv.protocol == PROTOCOL_RMQ)
+		if (sv.protocol == PROTOCOL_RMQ || sv.protocol == PROTOCOL_DELTA)
 		{
 			eval_t	*val; // PROTOCOL_RMQ
-			val = GetEdictFieldValue(ent, "scale");
+			val = GetEdictFieldValue(ent, pr_extfields.scale);
 			if (val)
 				ent->scale = ENTSCALE_ENCODE(val->_float);
 			else
@@ -122,7 +122,9 @@ enum
 	OP_OR,
 	
 	OP_BITAND,
-	OP_BITOR
+	OP_BITOR,
+
+	OP_NUMOPS
 };
 
 typedef struct statement_s
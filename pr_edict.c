@@ -24,6 +24,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 qboolean	pr_alpha_supported;
 qboolean	pr_fullbright_supported;
 
+pr_extfields_t	pr_extfields;
+
 dprograms_t	*progs;
 dfunction_t	*pr_functions;
 char		*pr_strings;
@@ -55,15 +57,82 @@ cvar_t	saved2 = {"saved2", "0", CVAR_ARCHIVE};
 cvar_t	saved3 = {"saved3", "0", CVAR_ARCHIVE};
 cvar_t	saved4 = {"saved4", "0", CVAR_ARCHIVE};
 
-#define	MAX_FIELD_LEN	64
-#define GEFV_CACHESIZE	2
+// the free edicts past the client slots, kept in freetime order so the
+// first one is the only one that needs to be checked for reuse
+static	int		ed_freenext[MAX_EDICTS];	// circular, edict 0 is the head since the
+static	int		ed_freeprev[MAX_EDICTS];	// world is never freed, -1 = not in the list
+
+/*
+=================
+ED_ClearFreeList
+=================
+*/
+void ED_ClearFreeList (void)
+{
+	int		i;
+
+	for (i=1 ; i<MAX_EDICTS ; i++)
+		ed_freenext[i] = ed_freeprev[i] = -1;
+	ed_freenext[0] = ed_freeprev[0] = 0;
+}
+
+/*
+=================
+ED_UnlinkFree
+=================
+*/
+static void ED_UnlinkFree (int e)
+{
+	if (e <= 0 || ed_freenext[e] < 0)
+		return;
+
+	ed_freenext[ed_freeprev[e]] = ed_freenext[e];
+	ed_freeprev[ed_freenext[e]] = ed_freeprev[e];
+	ed_freenext[e] = ed_freeprev[e] = -1;
+}
+
+/*
+=================
+ED_LinkFree
+=================
+*/
+static void ED_LinkFree (edict_t *ed)
+{
+	int		e, after;
+
+	e = ((byte *)ed - (byte *)sv.edicts) / pr_edict_size;
+	if (e <= svs.maxclients || e >= MAX_EDICTS)
+		return;
+
+	ED_UnlinkFree (e);
 
-typedef struct {
-	ddef_t	*pcache;
-	char	field[MAX_FIELD_LEN];
-} gefv_cache;
+	// sv.time only goes forward, so this is almost always the end
+	for (after = ed_freeprev[0] ; after && EDICT_NUM(after)->freetime > ed->freetime ; after = ed_freeprev[after])
+		;
 
-static gefv_cache	gefvCache[GEFV_CACHESIZE] = {{NULL, ""}, {NULL, ""}};
+	ed_freeprev[e] = after;
+	ed_freenext[e] = ed_freenext[after];
+	ed_freeprev[ed_freenext[after]] = e;
+	ed_freenext[after] = e;
+}
+
+/*
+=================
+ED_RebuildFreeList
+
+After a savegame replaced the edicts, the list can still hold edicts the
+map spawn freed past the new sv.num_edicts
+=================
+*/
+void ED_RebuildFreeList (void)
+{
+	int		e;
+
+	ED_ClearFreeList ();
+	for (e=svs.maxclients+1 ; e<sv.num_edicts ; e++)
+		if (EDICT_NUM(e)->free)
+			ED_LinkFree (EDICT_NUM(e));
+}
 
 /*
 =================
@@ -76,6 +145,31 @@ void ED_ClearEdict (edict_t *e)
 {
 	memset (&e->v, 0, progs->entityfields * 4);
 	e->free = false;
+	ED_UnlinkFree (((byte *)e - (byte *)sv.edicts) / pr_edict_size);
+	ED_UpdateFindIndex (e, -1);
+	ED_SyncHot (e);
+}
+
+/*
+=================
+ED_SyncHot
+
+Copies the hot fields of ed into sv.edicthot
+=================
+*/
+void ED_SyncHot (edict_t *ed)
+{
+	edicthot_t	*hot;
+	int			i;
+
+	if (!sv.edicthot)
+		return;
+
+	hot = sv.edicthot + ((byte *)ed - (byte *)sv.edicts) / pr_edict_size;
+	hot->free = ed->free;
+	hot->num_leafs = ed->num_leafs;
+	for (i=0 ; i<ed->num_leafs && i<HOT_LEAFS ; i++)
+		hot->leafnums[i] = ed->leafnums[i];
 }
 
 /*
@@ -94,18 +188,21 @@ edict_t *ED_Alloc (void)
 	int	i;
 	edict_t	*e;
 
-	for ( i=svs.maxclients+1 ; i<sv.num_edicts ; i++)
+	// the longest freed edict is the only candidate, if it is too recent
+	// all the others are as well
+	if ((i = ed_freenext[0]))
 	{
 		e = EDICT_NUM(i);
 		// the first couple seconds of server time can involve a lot of
 		// freeing and allocating, so relax the replacement policy
-		if (e->free && ( e->freetime < 2 || sv.time - e->freetime > 0.5 ) )
+		if ( e->freetime < 2 || sv.time - e->freetime > 0.5 )
 		{
 			ED_ClearEdict (e);
 			return e;
 		}
 	}
 
+	i = sv.num_edicts;
 	if (i == MAX_EDICTS)
 		Host_Error ("ED_Alloc: no free edicts, max = %d", MAX_EDICTS);
 
@@ -144,6 +241,238 @@ void ED_Free (edict_t *ed)
 	ed->scale = ENTSCALE_DEFAULT;
 
 	ed->freetime = sv.time;
+
+	ED_LinkFree (ed);
+	ED_UpdateFindIndex (ed, -1);
+	ED_SyncHot (ed);
+}
+
+/*
+=============================================================================
+
+FIND INDEX
+
+PF_Find is called in loops by the trigger and path code of most progs.  The
+first time it is used on a string field that field gets a hash from string
+to the edicts holding it, and every later search on it is answered from
+there.  All the places that write string fields into edicts have to call
+ED_UpdateFindIndex afterwards to keep it right.  Engine strings can change
+without being stored again, so edicts holding one are kept on a chain of
+their own that every search looks through.
+=============================================================================
+*/
+
+#define	MAX_FIND_INDEXES	8
+#define	FIND_HASH_SIZE		1024
+#define	FIND_ENGINE_CHAIN	FIND_HASH_SIZE	// edicts holding engine strings
+
+typedef struct
+{
+	int		field;						// word offset into entvars
+	int		head[FIND_HASH_SIZE + 1];	// chains are kept in edict order,
+	int		tail[FIND_HASH_SIZE + 1];	// 0 ends them since the world is never in one
+	int		next[MAX_EDICTS];
+	int		prev[MAX_EDICTS];
+	int		bucket[MAX_EDICTS];		// -1 = not in the index
+} findindex_t;
+
+cvar_t	pr_findindex = {"pr_findindex", "1", CVAR_NONE};
+
+static	findindex_t	ed_findindexes[MAX_FIND_INDEXES];
+static	int			ed_numfindindexes;
+
+int		pr_findcalls;		// PF_Find calls since the last profile command
+int		pr_findindexed;		// and the ones answered from an index
+
+/*
+=================
+ED_UnindexEdict
+=================
+*/
+static void ED_UnindexEdict (findindex_t *index, int e)
+{
+	int		b;
+
+	b = index->bucket[e];
+	if (b < 0)
+		return;
+
+	if (index->prev[e])
+		index->next[index->prev[e]] = index->next[e];
+	else
+		index->head[b] = index->next[e];
+	if (index->next[e])
+		index->prev[index->next[e]] = index->prev[e];
+	else
+		index->tail[b] = index->prev[e];
+
+	index->bucket[e] = -1;
+}
+
+/*
+=================
+ED_IndexEdict
+=================
+*/
+static void ED_IndexEdict (findindex_t *index, int e)
+{
+	int		b, after;
+	string_t	str;
+
+	str = ((string_t *)&EDICT_NUM(e)->v)[index->field];
+	if (str < 0)
+		b = FIND_ENGINE_CHAIN;	// may change in place, can't be hashed
+	else
+		b = COM_HashString (PR_GetString(str)) & (FIND_HASH_SIZE - 1);
+
+	// edicts are mostly added after everything already in the chain
+	for (after = index->tail[b] ; after > e ; after = index->prev[after])
+		;
+
+	index->prev[e] = after;
+	if (after)
+	{
+		index->next[e] = index->next[after];
+		index->next[after] = e;
+	}
+	else
+	{
+		index->next[e] = index->head[b];
+		index->head[b] = e;
+	}
+	if (index->next[e])
+		index->prev[index->next[e]] = e;
+	else
+		index->tail[b] = e;
+
+	index->bucket[e] = b;
+}
+
+/*
+=================
+ED_UpdateFindIndex
+
+Call after a string field of ed changes, field is a word offset into
+entvars, or -1 for all of them
+=================
+*/
+void ED_UpdateFindIndex (edict_t *ed, int field)
+{
+	findindex_t	*index;
+	int			i, e;
+
+	if (!ed_numfindindexes)
+		return;
+
+	e = ((byte *)ed - (byte *)sv.edicts) / pr_edict_size;
+	if (e <= 0 || e >= sv.max_edicts)
+		return;
+
+	for (i=0, index=ed_findindexes ; i<ed_numfindindexes ; i++, index++)
+	{
+		if (field >= 0 && index->field != field)
+			continue;
+		ED_UnindexEdict (index, e);
+		if (!ed->free)
+			ED_IndexEdict (index, e);
+	}
+}
+
+/*
+=================
+ED_StringStored
+
+The interpreter calls this after a STOREP_S, ofs is the byte offset of the
+field from sv.edicts
+=================
+*/
+void ED_StringStored (int ofs)
+{
+	int		e;
+
+	if (!ed_numfindindexes)
+		return;
+
+	e = ofs / pr_edict_size;
+	ED_UpdateFindIndex ((edict_t *)((byte *)sv.edicts + e * pr_edict_size), (ofs - e * pr_edict_size - (int)offsetof(edict_t, v)) / 4);
+}
+
+/*
+=================
+ED_ClearFindIndexes
+=================
+*/
+void ED_ClearFindIndexes (void)
+{
+	ed_numfindindexes = 0;
+}
+
+/*
+=================
+ED_FindInChain
+
+First edict after start on chain b with the string s in field, or 0
+=================
+*/
+static int ED_FindInChain (findindex_t *index, int b, int start, char *s)
+{
+	int		e;
+
+	for (e = index->head[b] ; e ; e = index->next[e])
+	{
+		if (e <= start)
+			continue;
+		if (e >= sv.num_edicts)
+			break;		// chains are in edict order
+		if (!strcmp(E_STRING(EDICT_NUM(e), index->field), s))
+			return e;
+	}
+
+	return 0;
+}
+
+/*
+=================
+ED_FindIndexed
+
+Returns false if field has no index and can't get one, else puts the first
+edict after start with the string s in field, or the world, in result
+=================
+*/
+qboolean ED_FindIndexed (int start, int field, char *s, edict_t **result)
+{
+	findindex_t	*index;
+	int			i, e, engine;
+
+	for (i=0, index=ed_findindexes ; i<ed_numfindindexes ; i++, index++)
+		if (index->field == field)
+			break;
+
+	if (i == ed_numfindindexes)
+	{
+		if (!pr_findindex.value || ed_numfindindexes == MAX_FIND_INDEXES)
+			return false;
+		if (field < 0 || field >= progs->entityfields)
+			return false;
+
+		ed_numfindindexes++;
+		index->field = field;
+		memset (index->head, 0, sizeof(index->head));
+		memset (index->tail, 0, sizeof(index->tail));
+		for (e=0 ; e<MAX_EDICTS ; e++)
+			index->bucket[e] = -1;
+		for (e=1 ; e<sv.num_edicts ; e++)
+			if (!EDICT_NUM(e)->free)
+				ED_IndexEdict (index, e);
+	}
+
+	e = ED_FindInChain (index, COM_HashString (s) & (FIND_HASH_SIZE - 1), start, s);
+	engine = ED_FindInChain (index, FIND_ENGINE_CHAIN, start, s);
+	if (engine && (!e || engine < e))
+		e = engine;
+
+	*result = EDICT_NUM(e);
+	return true;
 }
 
 //===========================================================================
@@ -247,38 +576,20 @@ dfunction_t *ED_FindFunction (char *name)
 
 /*
 ============
-GetEdictFieldValue
+ED_FindFieldOffset
+
+Returns the offset of a field for GetEdictFieldValue, -1 if not found
 ============
 */
-eval_t *GetEdictFieldValue(edict_t *ed, char *field)
+int ED_FindFieldOffset (char *name)
 {
-	ddef_t		*def = NULL;
-	int		i;
-	static int		rep = 0;
-
-	for (i=0 ; i<GEFV_CACHESIZE ; i++)
-	{
-		if (!strcmp(field, gefvCache[i].field))
-		{
-			def = gefvCache[i].pcache;
-			goto Done;
-		}
-	}
-
-	def = ED_FindField (field);
-
-	if (strlen(field) < MAX_FIELD_LEN)
-	{
-		gefvCache[rep].pcache = def;
-		strcpy (gefvCache[rep].field, field);
-		rep ^= 1;
-	}
+	ddef_t	*def;
 
-Done:
+	def = ED_FindField (name);
 	if (!def)
-		return NULL;
+		return -1;
 
-	return (eval_t *)((char *)&ed->v + def->ofs*4);
+	return def->ofs;
 }
 
 
@@ -713,6 +1024,43 @@ void ED_ParseGlobals (char *data)
 //============================================================================
 
 
+// the strings ED_NewString made for this map, by contents, so that the same
+// classname or target on a hundred entities is stored once
+#define	NEWSTRING_HASH	1024
+
+typedef struct newstring_s
+{
+	struct newstring_s	*next;
+	char				*string;
+} newstring_t;
+
+static	newstring_t	*ed_newstrings[NEWSTRING_HASH];
+static	int			ed_numnewstrings;
+static	int			ed_sharedstrings, ed_sharedbytes;
+
+/*
+=============
+ED_ClearNewStrings
+
+Called when the hunk the strings were on has been freed
+=============
+*/
+void ED_ClearNewStrings (void)
+{
+	memset (ed_newstrings, 0, sizeof(ed_newstrings));
+	ed_numnewstrings = ed_sharedstrings = ed_sharedbytes = 0;
+}
+
+/*
+=============
+ED_NewStringStats
+=============
+*/
+void ED_NewStringStats (void)
+{
+	Con_Printf ("%i map strings, %i copies shared, %i bytes saved\n", ed_numnewstrings, ed_sharedstrings, ed_sharedbytes);
+}
+
 /*
 =============
 ED_NewString
@@ -721,9 +1069,11 @@ ED_NewString
 char *ED_NewString (char *string)
 {
 	char	*new, *new_p;
-	int		i,l;
+	int		i,l, mark, h;
+	newstring_t	*ns;
 
 	l = strlen(string) + 1;
+	mark = Hunk_LowMark ();
 	new = Hunk_AllocName (l, "string");
 	new_p = new;
 
@@ -741,6 +1091,25 @@ char *ED_NewString (char *string)
 			*new_p++ = string[i];
 	}
 
+	h = COM_HashString (new) & (NEWSTRING_HASH - 1);
+	for (ns = ed_newstrings[h] ; ns ; ns = ns->next)
+	{
+		if (!strcmp (ns->string, new))
+		{
+			// nothing writes to these, so one copy will do
+			Hunk_FreeToLowMark (mark);
+			ed_sharedstrings++;
+			ed_sharedbytes += l;
+			return ns->string;
+		}
+	}
+
+	ns = Hunk_AllocName (sizeof(newstring_t), "string");
+	ns->string = new;
+	ns->next = ed_newstrings[h];
+	ed_newstrings[h] = ns;
+	ed_numnewstrings++;
+
 	return new;
 }
 
@@ -929,7 +1298,13 @@ char *ED_ParseEdict (char *data, edict_t *ent)
 	}
 
 	if (!init)
+	{
 		ent->free = true;
+		ED_LinkFree (ent);
+	}
+
+	ED_UpdateFindIndex (ent, -1);
+	ED_SyncHot (ent);
 
 	return data;
 }
@@ -1043,10 +1418,6 @@ void PR_LoadProgs (void)
 {
 	int		i;
 
-// flush the non-C variable lookup cache
-	for (i=0 ; i<GEFV_CACHESIZE ; i++)
-		gefvCache[i].field[0] = 0;
-
 	progs = (dprograms_t *)COM_LoadHunkFile ("progs.dat", NULL);
 	if (!progs)
 		Host_Error ("PR_LoadProgs: couldn't load progs.dat");
@@ -1055,6 +1426,7 @@ void PR_LoadProgs (void)
 
 // add prog crc to the serverinfo
 	pr_crc = CRC_Block ((byte *)progs, com_filesize);
+	PR_ProfileProgsLoaded ();
 
 // byte swap the header
 	for (i=0 ; i<sizeof(*progs)/4 ; i++)
@@ -1074,6 +1446,7 @@ void PR_LoadProgs (void)
 
 // initialize the strings
 	PR_InitStringTable();
+	ED_ClearNewStrings ();
 
 	pr_globaldefs = (ddef_t *)((byte *)progs + progs->ofs_globaldefs);
 	pr_fielddefs = (ddef_t *)((byte *)progs + progs->ofs_fielddefs);
@@ -1110,9 +1483,6 @@ void PR_LoadProgs (void)
 		pr_globaldefs[i].s_name = LittleLong (pr_globaldefs[i].s_name);
 	}
 
-	pr_alpha_supported = false;
-	pr_fullbright_supported = false;
-
 	for (i=0 ; i<progs->numfielddefs ; i++)
 	{
 		pr_fielddefs[i].type = LittleShort (pr_fielddefs[i].type);
@@ -1120,17 +1490,38 @@ void PR_LoadProgs (void)
 			Host_Error ("PR_LoadProgs: pr_fielddefs[i].type & DEF_SAVEGLOBAL");
 		pr_fielddefs[i].ofs = LittleShort (pr_fielddefs[i].ofs);
 		pr_fielddefs[i].s_name = LittleLong (pr_fielddefs[i].s_name);
-
-		// detect alpha support in progs.dat
-		if (!strcmp(PR_GetString(pr_fielddefs[i].s_name), "alpha"))
-			pr_alpha_supported = true;
-		// the same for fullbright
-		if (!strcmp(PR_GetString(pr_fielddefs[i].s_name), "fullbright"))
-			pr_fullbright_supported = true;
 	}
 
+// resolve the fields the engine looks up on every frame
+	pr_extfields.items2 = ED_FindFieldOffset ("items2");
+	pr_extfields.gravity = ED_FindFieldOffset ("gravity");
+	pr_extfields.alpha = ED_FindFieldOffset ("alpha");
+	pr_extfields.scale = ED_FindFieldOffset ("scale");
+	pr_extfields.fullbright = ED_FindFieldOffset ("fullbright");
+	pr_extfields.idealpitch = ED_FindFieldOffset ("idealpitch");
+	pr_extfields.pitch_speed = ED_FindFieldOffset ("pitch_speed");
+	pr_extfields.ammo_shells1 = ED_FindFieldOffset ("ammo_shells1");
+	pr_extfields.ammo_nails1 = ED_FindFieldOffset ("ammo_nails1");
+	pr_extfields.ammo_lava_nails = ED_FindFieldOffset ("ammo_lava_nails");
+	pr_extfields.ammo_rockets1 = ED_FindFieldOffset ("ammo_rockets1");
+	pr_extfields.ammo_multi_rockets = ED_FindFieldOffset ("ammo_multi_rockets");
+	pr_extfields.ammo_cells1 = ED_FindFieldOffset ("ammo_cells1");
+	pr_extfields.ammo_plasma = ED_FindFieldOffset ("ammo_plasma");
+
+	// detect alpha and fullbright (Nehahra) support in progs.dat
+	pr_alpha_supported = (pr_extfields.alpha != -1);
+	pr_fullbright_supported = (pr_extfields.fullbright != -1);
+
 	for (i=0 ; i<progs->numglobals ; i++)
 		((int *)pr_globals)[i] = LittleLong (((int *)pr_globals)[i]);
+
+// the interpreter runs a translated copy of the statements
+	PR_TranslateProgs ();
+
+// the field offsets may have changed, and the edicts are about to be
+// allocated again
+	ED_ClearFindIndexes ();
+	ED_ClearFreeList ();
 }
 
 
@@ -1156,6 +1547,8 @@ void PR_Init (void)
 	Cmd_AddCommand ("edicts", ED_PrintEdicts);
 	Cmd_AddCommand ("edictcount", ED_Count);
 	Cmd_AddCommand ("profile", PR_Profile_f);
+	Cmd_AddCommand ("pr_bench", PR_Bench_f);
+	Cmd_AddCommand ("pr_profiler", PR_Profiler_f);
 
 	Cvar_RegisterVariableCallback (&nomonsters, ED_Nomonsters);
 	Cvar_RegisterVariable (&gamecfg);
@@ -1168,6 +1561,8 @@ void PR_Init (void)
 	Cvar_RegisterVariable (&saved2);
 	Cvar_RegisterVariable (&saved3);
 	Cvar_RegisterVariable (&saved4);
+	Cvar_RegisterVariable (&pr_findindex);
+	Cmd_AddCommand ("pr_stringstats", PR_StringStats_f);
 }
 
 
@@ -21,6 +21,11 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 
+// the threaded dispatch needs the labels as values extension of gcc and clang
+#if defined(__GNUC__) && !defined(PR_SWITCH_DISPATCH)
+#define PR_THREADED_DISPATCH
+#endif
+
 typedef struct
 {
 	int				s;
@@ -251,6 +256,519 @@ void PR_Profile_f (void)
 			best->profile = 0;
 		}
 	} while (best);
+
+	if (pr_findcalls)
+		Con_SafePrintf ("%i find calls, %i answered from the index\n", pr_findcalls, pr_findindexed);
+	pr_findcalls = pr_findindexed = 0;
+}
+
+/*
+============
+PR_Bench_f
+
+Calls a QuakeC function a number of times and reports how many statements
+per second the interpreter ran.  Builtins and anything they call are in
+the time but not in the statement count.
+============
+*/
+void PR_Bench_f (void)
+{
+	dfunction_t	*f;
+	int		i, calls;
+	double	statements, start, time;
+
+	if (!sv.active)
+	{
+		Con_Printf ("Not running a server\n");
+		return;
+	}
+
+	if (Cmd_Argc() < 2)
+	{
+		Con_Printf ("usage: pr_bench <function> [calls]\n");
+		return;
+	}
+
+	if (!(f = ED_FindFunction (Cmd_Argv(1))) || f->first_statement < 0)
+	{
+		Con_Printf ("no QuakeC function \"%s\"\n", Cmd_Argv(1));
+		return;
+	}
+
+	calls = (Cmd_Argc() > 2) ? max(1, atoi(Cmd_Argv(2))) : 1000;
+
+	statements = 0;
+	for (i=0 ; i<progs->numfunctions ; i++)
+		statements -= pr_functions[i].profile;
+
+	start = Sys_DoubleTime ();
+	for (i=0 ; i<calls ; i++)
+	{
+		pr_global_struct->self = EDICT_TO_PROG(sv.edicts);
+		PR_ExecuteProgram ((func_t)(f - pr_functions));
+	}
+	time = Sys_DoubleTime () - start;
+
+	for (i=0 ; i<progs->numfunctions ; i++)
+		statements += pr_functions[i].profile;
+
+#ifdef PR_THREADED_DISPATCH
+	Con_Printf ("threaded dispatch: ");
+#else
+	Con_Printf ("switch dispatch: ");
+#endif
+	Con_Printf ("%i calls, %.0f statements in %.3f s, %.2f million statements/s\n",
+		calls, statements, time, time > 0 ? statements / time / 1000000.0 : 0);
+}
+
+/*
+============================================================================
+PROFILER
+
+While pr_profiler is on, every QuakeC function and builtin call is entered
+in a calling context tree, one node for each distinct stack of functions,
+with the calls, wall time and statements run at that point.  The reports
+fold the tree back into per function, per builtin and per call edge totals,
+and the folded stacks can be fed to flame graph tools.
+============================================================================
+*/
+
+#define	MAX_PROFILE_NODES	16384
+#define	PROFILE_HASH		4096
+#define	MAX_PROFILE_DEPTH	(MAX_STACK_DEPTH * 2)	// a builtin between each QuakeC call
+
+typedef struct
+{
+	int		func;		// index into pr_functions, builtins included
+	int		parent;		// node index, the root is 0
+	int		child, sibling;
+	int		hashnext;
+	int		calls;
+	double	statements;	// run in this function at this point of the tree
+	double	time;		// inclusive wall time
+} profnode_t;
+
+qboolean	pr_profiling;
+
+static	profnode_t	prof_nodes[MAX_PROFILE_NODES];
+static	int			prof_numnodes;
+static	int			prof_hash[PROFILE_HASH];
+static	int			prof_stack[MAX_PROFILE_DEPTH + 1];
+static	double		prof_starttime[MAX_PROFILE_DEPTH + 1];
+static	int			prof_depth;
+static	int			prof_overflow;		// calls past MAX_PROFILE_DEPTH that weren't pushed
+static	unsigned short	prof_crc;		// of the progs the tree was made with
+static	double		prof_enabledtime, prof_totaltime;
+
+/*
+====================
+PR_ProfileClear
+====================
+*/
+static void PR_ProfileClear (void)
+{
+	memset (prof_hash, -1, sizeof(prof_hash));
+	memset (&prof_nodes[0], 0, sizeof(prof_nodes[0]));
+	prof_numnodes = 1;
+	prof_depth = prof_overflow = 0;
+	prof_crc = pr_crc;
+	prof_totaltime = 0;
+	prof_enabledtime = Sys_DoubleTime ();
+}
+
+/*
+====================
+PR_ProfileEnter
+====================
+*/
+void PR_ProfileEnter (int func)
+{
+	profnode_t	*node;
+	int			parent, n, h;
+
+	if (prof_depth == MAX_PROFILE_DEPTH)
+	{
+		prof_overflow++;
+		return;
+	}
+
+	parent = prof_stack[prof_depth];
+	h = (parent * 31 + func) & (PROFILE_HASH - 1);
+	for (n = prof_hash[h] ; n >= 0 ; n = prof_nodes[n].hashnext)
+		if (prof_nodes[n].parent == parent && prof_nodes[n].func == func)
+			break;
+
+	if (n < 0)
+	{
+		if (prof_numnodes == MAX_PROFILE_NODES)
+			n = parent;		// out of nodes, charge it to the caller
+		else
+		{
+			n = prof_numnodes++;
+			node = &prof_nodes[n];
+			memset (node, 0, sizeof(*node));
+			node->func = func;
+			node->parent = parent;
+			node->sibling = prof_nodes[parent].child;
+			prof_nodes[parent].child = n;
+			node->hashnext = prof_hash[h];
+			prof_hash[h] = n;
+		}
+	}
+
+	prof_nodes[n].calls++;
+	prof_depth++;
+	prof_stack[prof_depth] = n;
+	prof_starttime[prof_depth] = Sys_DoubleTime ();
+}
+
+/*
+====================
+PR_ProfileLeave
+====================
+*/
+void PR_ProfileLeave (void)
+{
+	if (prof_overflow)
+	{
+		prof_overflow--;
+		return;
+	}
+	if (prof_depth <= 0)
+		return;		// profiling was turned on inside the call
+
+	prof_nodes[prof_stack[prof_depth]].time += Sys_DoubleTime () - prof_starttime[prof_depth];
+	prof_depth--;
+}
+
+/*
+====================
+PR_ProfileStatements
+
+Charges statements to the function on top of the stack
+====================
+*/
+void PR_ProfileStatements (int count)
+{
+	prof_nodes[prof_stack[prof_depth]].statements += count;
+}
+
+/*
+====================
+PR_ProfileReset
+
+Called before a QuakeC call from the engine, which also gets the stack back
+in step after a program error
+====================
+*/
+void PR_ProfileReset (void)
+{
+	prof_depth = prof_overflow = 0;
+}
+
+/*
+====================
+PR_ProfileProgsLoaded
+
+The tree refers to functions by number, so it has to go if the progs changed
+====================
+*/
+void PR_ProfileProgsLoaded (void)
+{
+	if (prof_numnodes && prof_crc != pr_crc)
+		PR_ProfileClear ();
+}
+
+typedef struct
+{
+	int		func;
+	int		calls;
+	double	inclusive, exclusive;			// statements
+	double	inclusivetime, exclusivetime;
+} proffunc_t;
+
+static	proffunc_t	*prof_funcs;
+static	int			*prof_onstack;
+
+/*
+====================
+PR_ProfileTotals_r
+
+Adds a node and everything under it to the function totals, returns the
+statements run in the subtree.  Recursive calls only count once towards
+the inclusive totals.
+====================
+*/
+static double PR_ProfileTotals_r (int n)
+{
+	profnode_t	*node;
+	proffunc_t	*pf;
+	double		statements, childtime;
+	int			c;
+
+	node = &prof_nodes[n];
+	pf = &prof_funcs[node->func];
+
+	prof_onstack[node->func]++;
+	statements = node->statements;
+	childtime = 0;
+	for (c = node->child ; c ; c = prof_nodes[c].sibling)
+	{
+		statements += PR_ProfileTotals_r (c);
+		childtime += prof_nodes[c].time;
+	}
+	prof_onstack[node->func]--;
+
+	pf->calls += node->calls;
+	pf->exclusive += node->statements;
+	pf->exclusivetime += node->time - childtime;
+	if (!prof_onstack[node->func])
+	{
+		pf->inclusive += statements;
+		pf->inclusivetime += node->time;
+	}
+
+	return statements;
+}
+
+static int PR_ProfileCompareTime (const void *a, const void *b)
+{
+	double	d;
+
+	d = ((proffunc_t *)b)->inclusivetime - ((proffunc_t *)a)->inclusivetime;
+	return (d > 0) - (d < 0);
+}
+
+typedef struct
+{
+	int		caller, callee;
+	int		calls;
+	double	time;
+} profedge_t;
+
+static int PR_ProfileCompareEdge (const void *a, const void *b)
+{
+	profedge_t	*ea = (profedge_t *)a;
+	profedge_t	*eb = (profedge_t *)b;
+
+	if (ea->caller != eb->caller)
+		return ea->caller - eb->caller;
+	return ea->callee - eb->callee;
+}
+
+static int PR_ProfileCompareEdgeTime (const void *a, const void *b)
+{
+	double	d;
+
+	d = ((profedge_t *)b)->time - ((profedge_t *)a)->time;
+	return (d > 0) - (d < 0);
+}
+
+/*
+====================
+PR_ProfileReport
+====================
+*/
+static void PR_ProfileReport (int count)
+{
+	proffunc_t	*pf;
+	profedge_t	*edges;
+	profnode_t	*node;
+	int			i, j, n, numedges;
+
+	prof_funcs = (proffunc_t *) calloc (progs->numfunctions, sizeof(proffunc_t));
+	prof_onstack = (int *) calloc (progs->numfunctions, sizeof(int));
+	edges = (profedge_t *) malloc (prof_numnodes * sizeof(profedge_t));
+	if (!prof_funcs || !prof_onstack || !edges)
+	{
+		free (prof_funcs);
+		free (prof_onstack);
+		free (edges);
+		Con_Printf ("profile: couldn't allocate the report for %i functions\n", progs->numfunctions);
+		return;
+	}
+
+	for (i=0 ; i<progs->numfunctions ; i++)
+		prof_funcs[i].func = i;
+	for (n = prof_nodes[0].child ; n ; n = prof_nodes[n].sibling)
+		PR_ProfileTotals_r (n);
+	qsort (prof_funcs, progs->numfunctions, sizeof(proffunc_t), PR_ProfileCompareTime);
+
+	Con_Printf ("%.3f s profiled, %i call contexts%s\n", prof_totaltime + (pr_profiling ? Sys_DoubleTime () - prof_enabledtime : 0),
+		prof_numnodes - 1, prof_numnodes == MAX_PROFILE_NODES ? " (full)" : "");
+
+	Con_Printf ("\n     calls  incl stmts  excl stmts  incl ms  excl ms function\n");
+	for (i=0, j=0, pf=prof_funcs ; i<progs->numfunctions && j<count ; i++, pf++)
+	{
+		if (!pf->calls || pr_functions[pf->func].first_statement < 0)
+			continue;
+		Con_Printf ("%10i %11.0f %11.0f %8.2f %8.2f %s\n", pf->calls, pf->inclusive, pf->exclusive,
+			pf->inclusivetime * 1000, pf->exclusivetime * 1000, PR_GetString(pr_functions[pf->func].s_name));
+		j++;
+	}
+
+	Con_Printf ("\n     calls       ms builtin\n");
+	for (i=0, j=0, pf=prof_funcs ; i<progs->numfunctions && j<count ; i++, pf++)
+	{
+		if (!pf->calls || pr_functions[pf->func].first_statement >= 0)
+			continue;
+		Con_Printf ("%10i %8.2f #%i %s\n", pf->calls, pf->inclusivetime * 1000,
+			-pr_functions[pf->func].first_statement, PR_GetString(pr_functions[pf->func].s_name));
+		j++;
+	}
+
+// call edges, summed over every context the caller was called in
+	numedges = 0;
+	for (n=1, node=&prof_nodes[1] ; n<prof_numnodes ; n++, node++)
+	{
+		if (!node->parent)
+			continue;
+		edges[numedges].caller = prof_nodes[node->parent].func;
+		edges[numedges].callee = node->func;
+		edges[numedges].calls = node->calls;
+		edges[numedges].time = node->time;
+		numedges++;
+	}
+	qsort (edges, numedges, sizeof(profedge_t), PR_ProfileCompareEdge);
+	for (i=0, j=-1 ; i<numedges ; i++)
+	{
+		if (j >= 0 && edges[j].caller == edges[i].caller && edges[j].callee == edges[i].callee)
+		{
+			edges[j].calls += edges[i].calls;
+			edges[j].time += edges[i].time;
+		}
+		else
+			edges[++j] = edges[i];
+	}
+	numedges = j + 1;
+	qsort (edges, numedges, sizeof(profedge_t), PR_ProfileCompareEdgeTime);
+
+	Con_Printf ("\n     calls       ms call\n");
+	for (i=0 ; i<numedges && i<count ; i++)
+		Con_Printf ("%10i %8.2f %s -> %s\n", edges[i].calls, edges[i].time * 1000,
+			PR_GetString(pr_functions[edges[i].caller].s_name), PR_GetString(pr_functions[edges[i].callee].s_name));
+
+	free (edges);
+	free (prof_onstack);
+	free (prof_funcs);
+}
+
+/*
+====================
+PR_ProfileFolded_r
+====================
+*/
+static void PR_ProfileFolded_r (FILE *f, int n, char *stack, int length, qboolean time)
+{
+	profnode_t	*node;
+	double		weight, childtime;
+	int			c;
+	char		*name;
+
+	node = &prof_nodes[n];
+	name = PR_GetString(pr_functions[node->func].s_name);
+	if (length + strlen(name) + 2 >= MAX_PRINTMSG)
+		return;
+	if (length)
+		stack[length++] = ';';
+	strcpy (stack + length, name);
+	length += strlen(name);
+
+	childtime = 0;
+	for (c = node->child ; c ; c = prof_nodes[c].sibling)
+		childtime += prof_nodes[c].time;
+
+	if (time)
+		weight = (node->time - childtime) * 1000000;	// microseconds
+	else
+		weight = node->statements;
+	if (weight >= 1)
+		fprintf (f, "%s %.0f\n", stack, weight);
+
+	for (c = node->child ; c ; c = prof_nodes[c].sibling)
+	{
+		PR_ProfileFolded_r (f, c, stack, length, time);
+		stack[length] = 0;
+	}
+}
+
+/*
+====================
+PR_Profiler_f
+====================
+*/
+void PR_Profiler_f (void)
+{
+	char	name[MAX_OSPATH];
+	char	stack[MAX_PRINTMSG];
+	char	*cmd;
+	FILE	*f;
+	int		n;
+
+	if (Cmd_Argc () < 2)
+	{
+		Con_Printf ("usage: pr_profiler on | off | clear | report [count] | folded <file> [time]\n");
+		Con_Printf ("the profiler is %s\n", pr_profiling ? "on" : "off");
+		return;
+	}
+
+	cmd = Cmd_Argv (1);
+	if (!strcmp (cmd, "on"))
+	{
+		if (!pr_profiling)
+		{
+			if (prof_numnodes)
+				prof_enabledtime = Sys_DoubleTime ();
+			else
+				PR_ProfileClear ();
+			prof_depth = 0;
+			pr_profiling = true;
+		}
+	}
+	else if (!strcmp (cmd, "off"))
+	{
+		if (pr_profiling)
+			prof_totaltime += Sys_DoubleTime () - prof_enabledtime;
+		pr_profiling = false;
+	}
+	else if (!strcmp (cmd, "clear"))
+		PR_ProfileClear ();
+	else if (!progs)
+		Con_Printf ("No progs loaded\n");
+	else if (!prof_numnodes)
+		Con_Printf ("Nothing has been profiled\n");
+	else if (!strcmp (cmd, "report"))
+		PR_ProfileReport ((Cmd_Argc () > 2) ? max(1, atoi(Cmd_Argv(2))) : 10);
+	else if (!strcmp (cmd, "folded"))
+	{
+		if (Cmd_Argc () < 3)
+		{
+			Con_Printf ("usage: pr_profiler folded <file> [time]\n");
+			return;
+		}
+		if (strstr(Cmd_Argv(2), ".."))
+		{
+			Con_Printf ("Relative pathnames are not allowed.\n");
+			return;
+		}
+
+		sprintf (name, "%s/%s", com_gamedir, Cmd_Argv(2));
+		COM_DefaultExtension (name, ".txt");
+
+		f = fopen (name, "w");
+		if (!f)
+		{
+			Con_Error ("couldn't open %s\n", name);
+			return;
+		}
+		for (n = prof_nodes[0].child ; n ; n = prof_nodes[n].sibling)
+			PR_ProfileFolded_r (f, n, stack, 0, Cmd_Argc () > 3 && !strcmp (Cmd_Argv(3), "time"));
+		fclose (f);
+
+		Con_Printf ("Wrote %s\n", name);
+	}
+	else
+		Con_Printf ("pr_profiler: unknown command \"%s\"\n", cmd);
 }
 
 
@@ -279,6 +797,133 @@ void PR_RunError (char *error, ...)
 	Host_Error ("Program error");
 }
 
+/*
+============================================================================
+TRANSLATED CODE
+
+PR_LoadProgs runs PR_TranslateProgs once to turn pr_statements into pr_code,
+which is what the interpreter runs.  pr_code has one entry for each
+statement, so a statement number is the same in both, and pr_statements is
+kept for PR_PrintStatement and the stack trace.
+============================================================================
+*/
+
+// opcodes that only exist in the translated code
+enum
+{
+	OP_LOADSTORE = OP_NUMOPS,	// OP_LOAD_x followed by an OP_STORE_x of the loaded value
+	OP_LOADSTORE_V,
+	OP_ADDRESSSTORE,		// OP_ADDRESS followed by an OP_STOREP_x through that address
+	OP_ADDRESSSTORE_V,
+	OP_CALLBUILTIN,		// OP_CALLn of a global that held a builtin when the progs were loaded
+	OP_BAD,
+
+	OP_NUMCODES
+};
+
+typedef struct
+{
+	unsigned short	op;			// what the interpreter runs
+	unsigned short	baseop;		// the untranslated opcode, run while tracing
+	int			arg;		// branch offset, or the function an OP_CALLBUILTIN was bound to
+	eval_t		*a, *b, *c;	// operands, already pointing into pr_globals
+	builtin_t	builtin;
+} prstatement_t;
+
+static prstatement_t	*pr_code;
+
+/*
+====================
+PR_WordOp
+
+True for the one word versions of the LOAD, STORE and STOREP opcodes, which
+all follow the same F, V, S, ENT, FLD, FNC order
+====================
+*/
+static qboolean PR_WordOp (int op, int first)
+{
+	return op >= first && op <= first + 5 && op != first + 1;
+}
+
+/*
+====================
+PR_TranslateProgs
+====================
+*/
+void PR_TranslateProgs (void)
+{
+	dstatement_t	*s;
+	prstatement_t	*st;
+	dfunction_t	*f;
+	int		i, fnum, fused, bound;
+
+	pr_code = Hunk_AllocName (progs->numstatements * sizeof(prstatement_t), "prcode");
+
+	for (i=0 ; i<progs->numstatements ; i++)
+	{
+		s = &pr_statements[i];
+		st = &pr_code[i];
+
+		st->op = st->baseop = (s->op < OP_NUMOPS) ? s->op : OP_BAD;
+		st->a = (eval_t *)&pr_globals[(unsigned short)s->a];
+		st->b = (eval_t *)&pr_globals[(unsigned short)s->b];
+		st->c = (eval_t *)&pr_globals[(unsigned short)s->c];
+
+		if (s->op == OP_GOTO)
+			st->arg = s->a;
+		else if (s->op == OP_IF || s->op == OP_IFNOT)
+			st->arg = s->b;
+	}
+
+// fuse the common pairs.  A jump can still land on the second statement of
+// a pair, which keeps its own translation.  OP_STOREP_S is left alone so the
+// find index hears about it
+	fused = bound = 0;
+	for (i=0 ; i<progs->numstatements ; i++)
+	{
+		s = &pr_statements[i];
+		st = &pr_code[i];
+
+		if (i + 1 < progs->numstatements)
+		{
+			if (PR_WordOp (s->op, OP_LOAD_F) && PR_WordOp (s[1].op, OP_STORE_F) && s[1].a == s->c)
+				st->op = OP_LOADSTORE;
+			else if (s->op == OP_LOAD_V && s[1].op == OP_STORE_V && s[1].a == s->c)
+				st->op = OP_LOADSTORE_V;
+			else if (s->op == OP_ADDRESS && PR_WordOp (s[1].op, OP_STOREP_F) && s[1].op != OP_STOREP_S && s[1].b == s->c)
+				st->op = OP_ADDRESSSTORE;
+			else if (s->op == OP_ADDRESS && s[1].op == OP_STOREP_V && s[1].b == s->c)
+				st->op = OP_ADDRESSSTORE_V;
+
+			if (st->op != st->baseop)
+			{
+				fused++;
+				continue;
+			}
+		}
+
+	// calls through a global that holds a builtin skip the function lookup,
+	// as long as the global still holds it when the call is made
+		if (s->op >= OP_CALL0 && s->op <= OP_CALL8 && (unsigned short)s->a < progs->numglobals)
+		{
+			fnum = ((int *)pr_globals)[(unsigned short)s->a];
+			if (fnum <= 0 || fnum >= progs->numfunctions)
+				continue;
+
+			f = &pr_functions[fnum];
+			if (f->first_statement < 0 && -f->first_statement < pr_numbuiltins)
+			{
+				st->op = OP_CALLBUILTIN;
+				st->arg = fnum;
+				st->builtin = pr_builtins[-f->first_statement];
+				bound++;
+			}
+		}
+	}
+
+	Con_DPrintf ("Translated %d statements, %d pairs fused, %d builtin calls bound\n", progs->numstatements, fused, bound);
+}
+
 /*
 ============================================================================
 PR_ExecuteProgram
@@ -328,6 +973,10 @@ int PR_EnterFunction (dfunction_t *f)
 	}
 
 	pr_xfunction = f;
+
+	if (pr_profiling)
+		PR_ProfileEnter (f - pr_functions);
+
 	return f->first_statement - 1;	// -1 to offset the st++
 }
 
@@ -352,6 +1001,9 @@ int PR_LeaveFunction (void)
 	for (i=0 ; i < c ; i++)
 		((int *)pr_globals)[pr_xfunction->parm_start + i] = localstack[localstack_used+i];
 
+	if (pr_profiling)
+		PR_ProfileLeave ();
+
 // up stack
 	pr_depth--;
 	pr_xfunction = pr_stack[pr_depth].f;
@@ -360,6 +1012,31 @@ int PR_LeaveFunction (void)
 
 #define RUNAWAY	     100000
 
+// statements are counted a block at a time, when the program jumps or
+// calls, which is also where a runaway loop has to pass through
+#define COUNT_STATEMENTS()	(profile += st - blockstart + 1)
+#define CHECK_RUNAWAY()	\
+	if (profile > RUNAWAY)	\
+	{	\
+		pr_xstatement = st - pr_code;	\
+		PR_RunError ("PR_ExecuteProgram: runaway loop error %d", RUNAWAY);	\
+	}
+
+// charges the statements counted so far to the current function
+#define PROFILE_STATEMENTS()	\
+	pr_xfunction->profile += profile - startprofile;	\
+	if (pr_profiling)	\
+		PR_ProfileStatements (profile - startprofile);	\
+	startprofile = profile
+
+#ifdef PR_THREADED_DISPATCH
+#define OPCODE(op)	op_##op:
+#define NEXT		do { st++; goto *dispatch[st->op]; } while (0)
+#else
+#define OPCODE(op)	case OP_##op:
+#define NEXT		continue
+#endif
+
 /*
 ====================
 PR_ExecuteProgram
@@ -367,14 +1044,45 @@ PR_ExecuteProgram
 */
 void PR_ExecuteProgram (func_t fnum)
 {
-	eval_t		*a, *b, *c;
-	dstatement_t	*st;
+	prstatement_t	*st, *blockstart;
 	dfunction_t	*f, *newf;
 	int		profile, startprofile;
 	int		i;
 	edict_t		*ed = NULL;
 	int		exitdepth;
 	eval_t		*ptr;
+	double		start;
+#ifdef PR_THREADED_DISPATCH
+	static void	*opcodes[OP_NUMCODES] =
+	{
+		&&op_DONE,
+		&&op_MUL_F, &&op_MUL_V, &&op_MUL_FV, &&op_MUL_VF,
+		&&op_DIV_F,
+		&&op_ADD_F, &&op_ADD_V,
+		&&op_SUB_F, &&op_SUB_V,
+		&&op_EQ_F, &&op_EQ_V, &&op_EQ_S, &&op_EQ_E, &&op_EQ_FNC,
+		&&op_NE_F, &&op_NE_V, &&op_NE_S, &&op_NE_E, &&op_NE_FNC,
+		&&op_LE, &&op_GE, &&op_LT, &&op_GT,
+		&&op_LOAD_F, &&op_LOAD_V, &&op_LOAD_S, &&op_LOAD_ENT, &&op_LOAD_FLD, &&op_LOAD_FNC,
+		&&op_ADDRESS,
+		&&op_STORE_F, &&op_STORE_V, &&op_STORE_S, &&op_STORE_ENT, &&op_STORE_FLD, &&op_STORE_FNC,
+		&&op_STOREP_F, &&op_STOREP_V, &&op_STOREP_S, &&op_STOREP_ENT, &&op_STOREP_FLD, &&op_STOREP_FNC,
+		&&op_RETURN,
+		&&op_NOT_F, &&op_NOT_V, &&op_NOT_S, &&op_NOT_ENT, &&op_NOT_FNC,
+		&&op_IF, &&op_IFNOT,
+		&&op_CALL0, &&op_CALL1, &&op_CALL2, &&op_CALL3, &&op_CALL4, &&op_CALL5, &&op_CALL6, &&op_CALL7, &&op_CALL8,
+		&&op_STATE,
+		&&op_GOTO,
+		&&op_AND, &&op_OR,
+		&&op_BITAND, &&op_BITOR,
+		&&op_LOADSTORE, &&op_LOADSTORE_V,
+		&&op_ADDRESSSTORE, &&op_ADDRESSSTORE_V,
+		&&op_CALLBUILTIN,
+		&&op_BAD
+	};
+	static void	*traceops[OP_NUMCODES];
+	void		**dispatch;
+#endif
 
 	if (!fnum || fnum < 0 || fnum >= progs->numfunctions)
 	{
@@ -395,307 +1103,460 @@ void PR_ExecuteProgram (func_t fnum)
 	exitdepth = pr_depth;
 	pr_peakdepth = 0;
 
-	st = &pr_statements[PR_EnterFunction (f)];
+	if (pr_profiling && !exitdepth)
+		PR_ProfileReset ();
+
+	// time the calls from the engine, the ones from builtins are inside them
+	start = exitdepth ? 0 : Host_FrameStatStart ();
+
+	st = &pr_code[PR_EnterFunction (f)];
+	blockstart = st + 1;
 	startprofile = profile = 0;
 
+#ifdef PR_THREADED_DISPATCH
+	if (!traceops[0])
+	{
+		for (i=0 ; i<OP_NUMCODES ; i++)
+			traceops[i] = &&op_trace;
+	}
+	dispatch = opcodes;
+
+	NEXT;
+
+// only reached through traceops, while pr_trace is set.  Fused statements
+// are run one at a time so each of them gets printed
+op_trace:
+	PR_PrintStatement (pr_statements + (st - pr_code));
+	goto *opcodes[st->baseop];
+#else
 while (1)
 {
 	st++;	// next statement
 
-	a = (eval_t *)&pr_globals[(unsigned short)st->a];
-	b = (eval_t *)&pr_globals[(unsigned short)st->b];
-	c = (eval_t *)&pr_globals[(unsigned short)st->c];
+	if (pr_trace)
+		PR_PrintStatement (pr_statements + (st - pr_code));
 
-	if (++profile > RUNAWAY)
+	switch (pr_trace ? st->baseop : st->op)
 	{
-		pr_xstatement = st - pr_statements;
-		PR_RunError ("PR_ExecuteProgram: runaway loop error %d", RUNAWAY);
-	}
-
-	if (pr_trace)
-		PR_PrintStatement (st);
-
-	switch (st->op)
-	{
-	case OP_ADD_F:
-		c->_float = a->_float + b->_float;
-		break;
-	case OP_ADD_V:
-		c->vector[0] = a->vector[0] + b->vector[0];
-		c->vector[1] = a->vector[1] + b->vector[1];
-		c->vector[2] = a->vector[2] + b->vector[2];
-		break;
-
-	case OP_SUB_F:
-		c->_float = a->_float - b->_float;
-		break;
-	case OP_SUB_V:
-		c->vector[0] = a->vector[0] - b->vector[0];
-		c->vector[1] = a->vector[1] - b->vector[1];
-		c->vector[2] = a->vector[2] - b->vector[2];
-		break;
-
-	case OP_MUL_F:
-		c->_float = a->_float * b->_float;
-		break;
-	case OP_MUL_V:
-		c->_float = a->vector[0]*b->vector[0]
-				+ a->vector[1]*b->vector[1]
-				+ a->vector[2]*b->vector[2];
-		break;
-	case OP_MUL_FV:
-		c->vector[0] = a->_float * b->vector[0];
-		c->vector[1] = a->_float * b->vector[1];
-		c->vector[2] = a->_float * b->vector[2];
-		break;
-	case OP_MUL_VF:
-		c->vector[0] = b->_float * a->vector[0];
-		c->vector[1] = b->_float * a->vector[1];
-		c->vector[2] = b->_float * a->vector[2];
-		break;
-
-	case OP_DIV_F:
-		c->_float = a->_float / b->_float;
-		break;
-
-	case OP_BITAND:
-		c->_float = (int)a->_float & (int)b->_float;
-		break;
-
-	case OP_BITOR:
-		c->_float = (int)a->_float | (int)b->_float;
-		break;
-
-
-	case OP_GE:
-		c->_float = a->_float >= b->_float;
-		break;
-	case OP_LE:
-		c->_float = a->_float <= b->_float;
-		break;
-	case OP_GT:
-		c->_float = a->_float > b->_float;
-		break;
-	case OP_LT:
-		c->_float = a->_float < b->_float;
-		break;
-	case OP_AND:
-		c->_float = a->_float && b->_float;
-		break;
-	case OP_OR:
-		c->_float = a->_float || b->_float;
-		break;
-
-	case OP_NOT_F:
-		c->_float = !a->_float;
-		break;
-	case OP_NOT_V:
-		c->_float = !a->vector[0] && !a->vector[1] && !a->vector[2];
-		break;
-	case OP_NOT_S:
-		c->_float = !a->string || !*PR_GetString(a->string);
-		break;
-	case OP_NOT_FNC:
-		c->_float = !a->function;
-		break;
-	case OP_NOT_ENT:
-		c->_float = (PROG_TO_EDICT(a->edict) == sv.edicts);
-		break;
-
-	case OP_EQ_F:
-		c->_float = a->_float == b->_float;
-		break;
-	case OP_EQ_V:
-		c->_float = (a->vector[0] == b->vector[0]) &&
-					(a->vector[1] == b->vector[1]) &&
-					(a->vector[2] == b->vector[2]);
-		break;
-	case OP_EQ_S:
-		c->_float = !strcmp(PR_GetString(a->string), PR_GetString(b->string));
-		break;
-	case OP_EQ_E:
-		c->_float = a->_int == b->_int;
-		break;
-	case OP_EQ_FNC:
-		c->_float = a->function == b->function;
-		break;
-
-
-	case OP_NE_F:
-		c->_float = a->_float != b->_float;
-		break;
-	case OP_NE_V:
-		c->_float = (a->vector[0] != b->vector[0]) ||
-					(a->vector[1] != b->vector[1]) ||
-					(a->vector[2] != b->vector[2]);
-		break;
-	case OP_NE_S:
-		c->_float = strcmp(PR_GetString(a->string), PR_GetString(b->string));
-		break;
-	case OP_NE_E:
-		c->_float = a->_int != b->_int;
-		break;
-	case OP_NE_FNC:
-		c->_float = a->function != b->function;
-		break;
+#endif
+
+	OPCODE(ADD_F)
+		st->c->_float = st->a->_float + st->b->_float;
+		NEXT;
+	OPCODE(ADD_V)
+		st->c->vector[0] = st->a->vector[0] + st->b->vector[0];
+		st->c->vector[1] = st->a->vector[1] + st->b->vector[1];
+		st->c->vector[2] = st->a->vector[2] + st->b->vector[2];
+		NEXT;
+
+	OPCODE(SUB_F)
+		st->c->_float = st->a->_float - st->b->_float;
+		NEXT;
+	OPCODE(SUB_V)
+		st->c->vector[0] = st->a->vector[0] - st->b->vector[0];
+		st->c->vector[1] = st->a->vector[1] - st->b->vector[1];
+		st->c->vector[2] = st->a->vector[2] - st->b->vector[2];
+		NEXT;
+
+	OPCODE(MUL_F)
+		st->c->_float = st->a->_float * st->b->_float;
+		NEXT;
+	OPCODE(MUL_V)
+		st->c->_float = st->a->vector[0]*st->b->vector[0]
+				+ st->a->vector[1]*st->b->vector[1]
+				+ st->a->vector[2]*st->b->vector[2];
+		NEXT;
+	OPCODE(MUL_FV)
+		st->c->vector[0] = st->a->_float * st->b->vector[0];
+		st->c->vector[1] = st->a->_float * st->b->vector[1];
+		st->c->vector[2] = st->a->_float * st->b->vector[2];
+		NEXT;
+	OPCODE(MUL_VF)
+		st->c->vector[0] = st->b->_float * st->a->vector[0];
+		st->c->vector[1] = st->b->_float * st->a->vector[1];
+		st->c->vector[2] = st->b->_float * st->a->vector[2];
+		NEXT;
+
+	OPCODE(DIV_F)
+		st->c->_float = st->a->_float / st->b->_float;
+		NEXT;
+
+	OPCODE(BITAND)
+		st->c->_float = (int)st->a->_float & (int)st->b->_float;
+		NEXT;
+
+	OPCODE(BITOR)
+		st->c->_float = (int)st->a->_float | (int)st->b->_float;
+		NEXT;
+
+
+	OPCODE(GE)
+		st->c->_float = st->a->_float >= st->b->_float;
+		NEXT;
+	OPCODE(LE)
+		st->c->_float = st->a->_float <= st->b->_float;
+		NEXT;
+	OPCODE(GT)
+		st->c->_float = st->a->_float > st->b->_float;
+		NEXT;
+	OPCODE(LT)
+		st->c->_float = st->a->_float < st->b->_float;
+		NEXT;
+	OPCODE(AND)
+		st->c->_float = st->a->_float && st->b->_float;
+		NEXT;
+	OPCODE(OR)
+		st->c->_float = st->a->_float || st->b->_float;
+		NEXT;
+
+	OPCODE(NOT_F)
+		st->c->_float = !st->a->_float;
+		NEXT;
+	OPCODE(NOT_V)
+		st->c->_float = !st->a->vector[0] && !st->a->vector[1] && !st->a->vector[2];
+		NEXT;
+	OPCODE(NOT_S)
+		st->c->_float = !st->a->string || !*PR_GetString(st->a->string);
+		NEXT;
+	OPCODE(NOT_FNC)
+		st->c->_float = !st->a->function;
+		NEXT;
+	OPCODE(NOT_ENT)
+		st->c->_float = (PROG_TO_EDICT(st->a->edict) == sv.edicts);
+		NEXT;
+
+	OPCODE(EQ_F)
+		st->c->_float = st->a->_float == st->b->_float;
+		NEXT;
+	OPCODE(EQ_V)
+		st->c->_float = (st->a->vector[0] == st->b->vector[0]) &&
+					(st->a->vector[1] == st->b->vector[1]) &&
+					(st->a->vector[2] == st->b->vector[2]);
+		NEXT;
+	OPCODE(EQ_S)
+		st->c->_float = !strcmp(PR_GetString(st->a->string), PR_GetString(st->b->string));
+		NEXT;
+	OPCODE(EQ_E)
+		st->c->_float = st->a->_int == st->b->_int;
+		NEXT;
+	OPCODE(EQ_FNC)
+		st->c->_float = st->a->function == st->b->function;
+		NEXT;
+
+
+	OPCODE(NE_F)
+		st->c->_float = st->a->_float != st->b->_float;
+		NEXT;
+	OPCODE(NE_V)
+		st->c->_float = (st->a->vector[0] != st->b->vector[0]) ||
+					(st->a->vector[1] != st->b->vector[1]) ||
+					(st->a->vector[2] != st->b->vector[2]);
+		NEXT;
+	OPCODE(NE_S)
+		st->c->_float = strcmp(PR_GetString(st->a->string), PR_GetString(st->b->string));
+		NEXT;
+	OPCODE(NE_E)
+		st->c->_float = st->a->_int != st->b->_int;
+		NEXT;
+	OPCODE(NE_FNC)
+		st->c->_float = st->a->function != st->b->function;
+		NEXT;
 
 //==================
-	case OP_STORE_F:
-	case OP_STORE_ENT:
-	case OP_STORE_FLD:		// integers
-	case OP_STORE_S:
-	case OP_STORE_FNC:		// pointers
-		b->_int = a->_int;
-		break;
-	case OP_STORE_V:
-		b->vector[0] = a->vector[0];
-		b->vector[1] = a->vector[1];
-		b->vector[2] = a->vector[2];
-		break;
-
-	case OP_STOREP_F:
-	case OP_STOREP_ENT:
-	case OP_STOREP_FLD:		// integers
-	case OP_STOREP_S:
-	case OP_STOREP_FNC:		// pointers
-		ptr = (eval_t *)((byte *)sv.edicts + b->_int);
-		ptr->_int = a->_int;
-		break;
-	case OP_STOREP_V:
-		ptr = (eval_t *)((byte *)sv.edicts + b->_int);
-		ptr->vector[0] = a->vector[0];
-		ptr->vector[1] = a->vector[1];
-		ptr->vector[2] = a->vector[2];
-		break;
-
-	case OP_ADDRESS:
-		ed = PROG_TO_EDICT(a->edict);
+	OPCODE(STORE_F)
+	OPCODE(STORE_ENT)
+	OPCODE(STORE_FLD)		// integers
+	OPCODE(STORE_S)
+	OPCODE(STORE_FNC)		// pointers
+		st->b->_int = st->a->_int;
+		NEXT;
+	OPCODE(STORE_V)
+		st->b->vector[0] = st->a->vector[0];
+		st->b->vector[1] = st->a->vector[1];
+		st->b->vector[2] = st->a->vector[2];
+		NEXT;
+
+	OPCODE(STOREP_F)
+	OPCODE(STOREP_ENT)
+	OPCODE(STOREP_FLD)		// integers
+	OPCODE(STOREP_FNC)		// pointers
+		ptr = (eval_t *)((byte *)sv.edicts + st->b->_int);
+		ptr->_int = st->a->_int;
+		NEXT;
+	OPCODE(STOREP_S)
+		ptr = (eval_t *)((byte *)sv.edicts + st->b->_int);
+		ptr->_int = st->a->_int;
+		ED_StringStored (st->b->_int);
+		NEXT;
+	OPCODE(STOREP_V)
+		ptr = (eval_t *)((byte *)sv.edicts + st->b->_int);
+		ptr->vector[0] = st->a->vector[0];
+		ptr->vector[1] = st->a->vector[1];
+		ptr->vector[2] = st->a->vector[2];
+		NEXT;
+
+	OPCODE(ADDRESS)
+		ed = PROG_TO_EDICT(st->a->edict);
 
 		if (ed == (edict_t *)sv.edicts && sv.state == ss_active)
 		{
-			pr_xstatement = st - pr_statements;
+			pr_xstatement = st - pr_code;
 			PR_RunError ("PR_ExecuteProgram: assignment to world entity");
 		}
 
-		c->_int = (byte *)((int *)&ed->v + b->_int) - (byte *)sv.edicts;
-		break;
+		st->c->_int = (byte *)((int *)&ed->v + st->b->_int) - (byte *)sv.edicts;
+		NEXT;
 
-	case OP_LOAD_F:
-	case OP_LOAD_FLD:
-	case OP_LOAD_ENT:
-	case OP_LOAD_S:
-	case OP_LOAD_FNC:
-		ed = PROG_TO_EDICT(a->edict);
+	OPCODE(LOAD_F)
+	OPCODE(LOAD_FLD)
+	OPCODE(LOAD_ENT)
+	OPCODE(LOAD_S)
+	OPCODE(LOAD_FNC)
+		ed = PROG_TO_EDICT(st->a->edict);
 
-		ptr = (eval_t *)((int *)&ed->v + b->_int);
-		c->_int = ptr->_int;
-		break;
+		ptr = (eval_t *)((int *)&ed->v + st->b->_int);
+		st->c->_int = ptr->_int;
+		NEXT;
 
-	case OP_LOAD_V:
-		ed = PROG_TO_EDICT(a->edict);
+	OPCODE(LOAD_V)
+		ed = PROG_TO_EDICT(st->a->edict);
 
-		ptr = (eval_t *)((int *)&ed->v + b->_int);
-		c->vector[0] = ptr->vector[0];
-		c->vector[1] = ptr->vector[1];
-		c->vector[2] = ptr->vector[2];
-		break;
+		ptr = (eval_t *)((int *)&ed->v + st->b->_int);
+		st->c->vector[0] = ptr->vector[0];
+		st->c->vector[1] = ptr->vector[1];
+		st->c->vector[2] = ptr->vector[2];
+		NEXT;
 
 //==================
+// fused pairs, the second statement is run from its own operands
+
+	OPCODE(LOADSTORE)
+		ed = PROG_TO_EDICT(st->a->edict);
+
+		ptr = (eval_t *)((int *)&ed->v + st->b->_int);
+		st->c->_int = ptr->_int;
+		st++;
+		st->b->_int = st->a->_int;
+		NEXT;
+
+	OPCODE(LOADSTORE_V)
+		ed = PROG_TO_EDICT(st->a->edict);
+
+		ptr = (eval_t *)((int *)&ed->v + st->b->_int);
+		st->c->vector[0] = ptr->vector[0];
+		st->c->vector[1] = ptr->vector[1];
+		st->c->vector[2] = ptr->vector[2];
+		st++;
+		st->b->vector[0] = st->a->vector[0];
+		st->b->vector[1] = st->a->vector[1];
+		st->b->vector[2] = st->a->vector[2];
+		NEXT;
 
-	case OP_IFNOT:
-		if (!a->_int)
-			st += st->b - 1;	// -1 to offset the st++
-		break;
-
-	case OP_IF:
-		if (a->_int)
-			st += st->b - 1;	// -1 to offset the st++
-		break;
-
-	case OP_GOTO:
-		st += st->a - 1;	// -1 to offset the st++
-		break;
-
-	case OP_CALL0:
-	case OP_CALL1:
-	case OP_CALL2:
-	case OP_CALL3:
-	case OP_CALL4:
-	case OP_CALL5:
-	case OP_CALL6:
-	case OP_CALL7:
-	case OP_CALL8:
-		pr_xfunction->profile += profile - startprofile;
-		startprofile = profile;
-		pr_xstatement = st - pr_statements;
-		pr_argc = st->op - OP_CALL0;
-		if (!a->function)
+	OPCODE(ADDRESSSTORE)
+		ed = PROG_TO_EDICT(st->a->edict);
+
+		if (ed == (edict_t *)sv.edicts && sv.state == ss_active)
+		{
+			pr_xstatement = st - pr_code;
+			PR_RunError ("PR_ExecuteProgram: assignment to world entity");
+		}
+
+		st->c->_int = (byte *)((int *)&ed->v + st->b->_int) - (byte *)sv.edicts;
+		st++;
+		ptr = (eval_t *)((byte *)sv.edicts + st->b->_int);
+		ptr->_int = st->a->_int;
+		NEXT;
+
+	OPCODE(ADDRESSSTORE_V)
+		ed = PROG_TO_EDICT(st->a->edict);
+
+		if (ed == (edict_t *)sv.edicts && sv.state == ss_active)
+		{
+			pr_xstatement = st - pr_code;
+			PR_RunError ("PR_ExecuteProgram: assignment to world entity");
+		}
+
+		st->c->_int = (byte *)((int *)&ed->v + st->b->_int) - (byte *)sv.edicts;
+		st++;
+		ptr = (eval_t *)((byte *)sv.edicts + st->b->_int);
+		ptr->vector[0] = st->a->vector[0];
+		ptr->vector[1] = st->a->vector[1];
+		ptr->vector[2] = st->a->vector[2];
+		NEXT;
+
+//==================
+
+	OPCODE(IFNOT)
+		if (!st->a->_int)
+		{
+			COUNT_STATEMENTS();
+			CHECK_RUNAWAY();
+			st += st->arg - 1;	// -1 to offset the st++
+			blockstart = st + 1;
+		}
+		NEXT;
+
+	OPCODE(IF)
+		if (st->a->_int)
+		{
+			COUNT_STATEMENTS();
+			CHECK_RUNAWAY();
+			st += st->arg - 1;	// -1 to offset the st++
+			blockstart = st + 1;
+		}
+		NEXT;
+
+	OPCODE(GOTO)
+		COUNT_STATEMENTS();
+		CHECK_RUNAWAY();
+		st += st->arg - 1;	// -1 to offset the st++
+		blockstart = st + 1;
+		NEXT;
+
+	OPCODE(CALLBUILTIN)
+		if (st->a->function != st->arg)
+			goto call;	// the global was changed since the call was bound
+
+		COUNT_STATEMENTS();
+		CHECK_RUNAWAY();
+		PROFILE_STATEMENTS();
+		pr_xstatement = st - pr_code;
+		pr_argc = st->baseop - OP_CALL0;
+		if (pr_profiling)
+		{
+			PR_ProfileEnter (st->arg);
+			st->builtin ();
+			PR_ProfileLeave ();
+		}
+		else
+			st->builtin ();
+	#ifdef PR_THREADED_DISPATCH
+		dispatch = pr_trace ? traceops : opcodes;	// traceon and traceoff are builtins
+	#endif
+		blockstart = st + 1;
+		NEXT;
+
+	OPCODE(CALL0)
+	OPCODE(CALL1)
+	OPCODE(CALL2)
+	OPCODE(CALL3)
+	OPCODE(CALL4)
+	OPCODE(CALL5)
+	OPCODE(CALL6)
+	OPCODE(CALL7)
+	OPCODE(CALL8)
+	call:
+		COUNT_STATEMENTS();
+		CHECK_RUNAWAY();
+		PROFILE_STATEMENTS();
+		pr_xstatement = st - pr_code;
+		pr_argc = st->baseop - OP_CALL0;
+		if (!st->a->function)
 			PR_RunError ("PR_ExecuteProgram: NULL function");
 
-		newf = &pr_functions[a->function];
+		newf = &pr_functions[st->a->function];
 		// negative statements are built in functions
 		if (newf->first_statement < 0)
 		{ // Built-in function
 			i = -newf->first_statement;
 			if (i >= pr_numbuiltins)
 				PR_RunError ("PR_ExecuteProgram: bad builtin call number (%d, max = %d)", i, pr_numbuiltins);
-			pr_builtins[i] ();
-			break;
+			if (pr_profiling)
+			{
+				PR_ProfileEnter (newf - pr_functions);
+				pr_builtins[i] ();
+				PR_ProfileLeave ();
+			}
+			else
+				pr_builtins[i] ();
+		#ifdef PR_THREADED_DISPATCH
+			dispatch = pr_trace ? traceops : opcodes;	// traceon and traceoff are builtins
+		#endif
 		}
-		// Normal function
-		st = &pr_statements[PR_EnterFunction (newf)];
-		break;
-
-	case OP_DONE:
-	case OP_RETURN:
-		pr_xfunction->profile += profile - startprofile;
-		startprofile = profile;
-		pr_xstatement = st - pr_statements;
-		pr_globals[OFS_RETURN] = pr_globals[(unsigned short)st->a];
-		pr_globals[OFS_RETURN+1] = pr_globals[(unsigned short)st->a+1];
-		pr_globals[OFS_RETURN+2] = pr_globals[(unsigned short)st->a+2];
-
-		st = &pr_statements[PR_LeaveFunction ()];
+		else
+		{ // Normal function
+			st = &pr_code[PR_EnterFunction (newf)];
+		}
+		blockstart = st + 1;
+		NEXT;
+
+	OPCODE(DONE)
+	OPCODE(RETURN)
+		COUNT_STATEMENTS();
+		PROFILE_STATEMENTS();
+		pr_xstatement = st - pr_code;
+		pr_globals[OFS_RETURN] = st->a->vector[0];
+		pr_globals[OFS_RETURN+1] = st->a->vector[1];
+		pr_globals[OFS_RETURN+2] = st->a->vector[2];
+
+		st = &pr_code[PR_LeaveFunction ()];
 		if (pr_depth == exitdepth)
 		{ // Done
 			// Check old limit
 			if (pr_peakdepth >= 32)
 				Con_DWarning ("PR_ExecuteProgram: stack depth exceeds standard limit (%d, normal max = %d)\n", pr_peakdepth, 32 - 1);
 
+			Host_FrameStatStop (FS_QUAKEC, start);
 			return;		// all done
 		}
-		break;
+		blockstart = st + 1;
+		NEXT;
 
-	case OP_STATE:
+	OPCODE(STATE)
 		ed = PROG_TO_EDICT(pr_global_struct->self);
 		ed->v.nextthink = pr_global_struct->time + 0.1;
-		ed->v.frame = a->_float;
-		ed->v.think = b->function;
-		break;
-
+		ed->v.frame = st->a->_float;
+		ed->v.think = st->b->function;
+		NEXT;
+
+#ifdef PR_THREADED_DISPATCH
+op_BAD:
+	pr_xstatement = st - pr_code;
+	PR_RunError ("PR_ExecuteProgram: bad opcode %i", pr_statements[pr_xstatement].op);
+}
+#else
 	default:
-		pr_xstatement = st - pr_statements;
-		PR_RunError ("PR_ExecuteProgram: bad opcode %i", st->op);
+		pr_xstatement = st - pr_code;
+		PR_RunError ("PR_ExecuteProgram: bad opcode %i", pr_statements[pr_xstatement].op);
 	}
 }
 
 }
+#endif
 
 /*----------------------*/
 
 #define PR_STRTBL_CHUNK 256
+#define PR_STRTBL_HASH 1024     // chains of slots by pointer, for PR_SetString
 char **pr_strtbl = NULL;
 int pr_strtbl_size;
 int num_prstr;
 
+static int *pr_strtbl_next = NULL;
+static int pr_strtbl_hash[PR_STRTBL_HASH];
+static int pr_strtbl_lookups, pr_strtbl_hits;
+
 void PR_InitStringTable(void)
 {
+    int i;
+
     if (pr_strtbl) {
         Z_Free (pr_strtbl);
+        Z_Free (pr_strtbl_next);
         pr_strtbl = NULL;
+        pr_strtbl_next = NULL;
     }
     pr_strtbl_size = 0;
     num_prstr = 0;
+
+    for (i = 0; i < PR_STRTBL_HASH; i++)
+        pr_strtbl_hash[i] = -1;
+    pr_strtbl_lookups = pr_strtbl_hits = 0;
+}
+
+static int PR_StringTableHash(char *s)
+{
+    return (int)((((size_t)s >> 2) * 2654435761u) >> 8) & (PR_STRTBL_HASH - 1);
 }
 
 char *PR_GetString(int num)
@@ -714,23 +1575,45 @@ char *PR_GetString(int num)
     return "";
 }
 
+// strings outside of the progs get a slot per pointer.  The engine only
+// hands out fixed buffers (temp strings, client names) and the strings
+// ED_NewString shares by contents, so the table stays small for as long
+// as a map runs
 int PR_SetString(char *s)
 {
-    int i;
+    int i, h;
     
     if (s - pr_strings < 0 || s - pr_strings > pr_strings_size - 2) {
-        for (i = 0; i < num_prstr; i++)
-            if (pr_strtbl[i] == s)
-                break;
-        if (i < num_prstr)
-            return -i - 1;
+        pr_strtbl_lookups++;
+        h = PR_StringTableHash(s);
+        for (i = pr_strtbl_hash[h]; i >= 0; i = pr_strtbl_next[i])
+            if (pr_strtbl[i] == s) {
+                pr_strtbl_hits++;
+                return -i - 1;
+            }
         if (num_prstr == pr_strtbl_size) {
             pr_strtbl_size += PR_STRTBL_CHUNK;
             pr_strtbl = Z_Realloc(pr_strtbl, pr_strtbl_size * sizeof(char *));
+            pr_strtbl_next = Z_Realloc(pr_strtbl_next, pr_strtbl_size * sizeof(int));
         }
         pr_strtbl[num_prstr] = s;
+        pr_strtbl_next[num_prstr] = pr_strtbl_hash[h];
+        pr_strtbl_hash[h] = num_prstr;
         num_prstr++;
         return -num_prstr;
     }
     return (int)(s - pr_strings);
 }
+
+void PR_StringStats_f(void)
+{
+    if (!progs) {
+        Con_Printf ("No progs loaded\n");
+        return;
+    }
+
+    Con_Printf ("%i string table slots, %i allocated\n", num_prstr, pr_strtbl_size);
+    Con_Printf ("%i lookups, %i found a slot (%.1f%%)\n", pr_strtbl_lookups, pr_strtbl_hits,
+        pr_strtbl_lookups ? 100.0 * pr_strtbl_hits / pr_strtbl_lookups : 0);
+    ED_NewStringStats ();
+}
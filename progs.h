@@ -50,12 +50,26 @@ typedef struct edict_s
 	float		oldthinktime;
 
 	float		freetime;			// sv.time when the object was freed
+	int			linkstamp;			// sv_linkstamp when last linked or unlinked
 	entvars_t	v;					// C exported fields from progs
 // other fields from progs come immediately after
 } edict_t;
 
 #define	EDICT_FROM_AREA(l) STRUCT_FROM_LINK(l,edict_t,area)
 
+// copies of the edict fields the loops over every edict test, packed by edict
+// number (sv.edicthot) so those loops don't pull whole edicts through the
+// cache.  Only fields QuakeC can't write are kept, set where the C code
+// changes them, in ED_ClearEdict, ED_Free and SV_LinkEdict
+#define	HOT_LEAFS	4
+
+typedef struct
+{
+	qboolean	free;
+	int			num_leafs;
+	int			leafnums[HOT_LEAFS];	// the first of the edict's leafnums
+} edicthot_t;
+
 //============================================================================
 
 extern	dprograms_t	*progs;
@@ -73,6 +87,28 @@ extern	int		pr_edict_size;	// in bytes
 extern	qboolean	pr_alpha_supported; // alpha
 extern	qboolean	pr_fullbright_supported; // fullbright
 
+// offsets of the fields the engine reads that are not part of entvars_t,
+// resolved once in PR_LoadProgs, -1 if the progs don't define them
+typedef struct
+{
+	int		items2;
+	int		gravity;
+	int		alpha;
+	int		scale;
+	int		fullbright;
+	int		idealpitch;
+	int		pitch_speed;
+	int		ammo_shells1;		// rogue
+	int		ammo_nails1;
+	int		ammo_lava_nails;
+	int		ammo_rockets1;
+	int		ammo_multi_rockets;
+	int		ammo_cells1;
+	int		ammo_plasma;
+} pr_extfields_t;
+
+extern	pr_extfields_t	pr_extfields;
+
 extern	cvar_t	nomonsters;
 
 //============================================================================
@@ -81,15 +117,36 @@ void PR_Init (void);
 
 void PR_ExecuteProgram (func_t fnum);
 void PR_LoadProgs (void);
+void PR_TranslateProgs (void);
 
 void PR_Profile_f (void);
+void PR_Bench_f (void);
+void PR_StringStats_f (void);
+void PR_Profiler_f (void);
+void PR_ProfileProgsLoaded (void);
 
 edict_t *ED_Alloc (void);
 void	ED_Free (edict_t *ed);
 void ED_ClearEdict (edict_t *e);
+void ED_ClearFreeList (void);
+void ED_RebuildFreeList (void);
+void ED_SyncHot (edict_t *ed);
+
+void ED_UpdateFindIndex (edict_t *ed, int field);
+void ED_StringStored (int ofs);
+void ED_ClearFindIndexes (void);
+qboolean ED_FindIndexed (int start, int field, char *s, edict_t **result);
+// string field index for PF_Find, anything that writes a string field
+// of an edict outside of QuakeC has to call ED_UpdateFindIndex
+
+extern	int		pr_findcalls;
+extern	int		pr_findindexed;
 
 char	*ED_NewString (char *string);
-// returns a copy of the string allocated from the server's string heap
+// returns a copy of the string allocated from the server's string heap,
+// shared with any earlier copy of the same string
+void ED_ClearNewStrings (void);
+void ED_NewStringStats (void);
 
 void ED_Print (edict_t *ed);
 void ED_Write (FILE *f, edict_t *ed);
@@ -144,7 +201,14 @@ void PR_RunError (char *error, ...);
 void ED_PrintEdicts (void);
 void ED_PrintNum (int ent);
 
-eval_t *GetEdictFieldValue(edict_t *ed, char *field);
+static inline eval_t *GetEdictFieldValue(edict_t *ed, int fieldofs)
+{
+	if (fieldofs < 0)
+		return NULL;
+
+	return (eval_t *)((char *)&ed->v + fieldofs*4);
+}
+
 dfunction_t *ED_FindFunction (char *name);
 
 //
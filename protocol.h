@@ -25,6 +25,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define PROTOCOL_FITZQUAKE	666		// johnfitz -- added new protocol for fitzquake 0.85
 #define PROTOCOL_MARKV		668		// Baker: fitz+ for smooth angles for rotating entities
 #define PROTOCOL_RMQ		999		// mh: RMQ
+#define PROTOCOL_DELTA		1000	// RMQ, with entities sent as deltas against the last snapshot the client acked
 
 // PROTOCOL_RMQ protocol flags
 #define PRFL_SHORTANGLE		(1 << 1)
@@ -66,7 +67,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define U_MODEL2		(1<<18) // 1 byte, this is .modelindex & 0xFF00 (second byte)
 #define U_LERPFINISH	(1<<19) // 1 byte, 0.0-1.0 maps to 0-255, not sent if exactly 0.1, this is ent->v.nextthink - sv.time, used for lerping
 #define U_SCALE			(1<<20) // 1 byte, for PROTOCOL_RMQ PRFL_EDICTSCALE
-#define U_UNUSED21		(1<<21)
+#define U_REMOVE		(1<<21) // PROTOCOL_DELTA: the entity left the snapshot, no fields follow
 #define U_UNUSED22		(1<<22)
 #define U_EXTEND2		(1<<23) // another byte to follow, future expansion
 // johnfitz
@@ -221,13 +222,16 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 // Nehahra
 #define svc_fogn			51	// [byte] enable <optional past this point, only included if enable is true> [float] density [byte] red [byte] green [byte] blue
 
+// PROTOCOL_DELTA
+#define svc_deltasnapshot	52	// [long] sequence [long] delta from, 0 = spawn baselines; entity updates follow
+
 //
 // client to server
 //
 #define	clc_bad			0
 #define	clc_nop 		1
 #define	clc_disconnect	2
-#define	clc_move		3			// [usercmd_t]
+#define	clc_move		3			// [usercmd_t], PROTOCOL_DELTA adds [long] last snapshot received
 #define	clc_stringcmd	4		// [string] message
 
 
@@ -273,3 +277,42 @@ typedef struct
 	byte		scale;		//Quakespasm: for model scale support
 	int			effects;
 } entity_state_t;
+
+// PROTOCOL_DELTA -- both ends keep the last DELTA_BACKUP snapshots, so an
+// update only carries what changed since the one the client last acked.
+// Entities the update doesn't mention are carried over from it.
+#define	DELTA_BACKUP		32		// power of two
+#define	DELTA_POOL			4096	// entity states kept for all of the snapshots
+#define	DELTA_MAXENTS		1024	// per snapshot, the rest aren't sent
+
+typedef struct
+{
+	entity_state_t	state;
+	unsigned short	num;
+	unsigned short	flags;		// U_STEP and U_LERPFINISH
+	byte			lerpfinish;
+} deltaentity_t;
+
+typedef struct
+{
+	int				sequence;	// 0 if unused
+	unsigned int	first;		// into the pool, counting up and wrapping around
+	int				count;		// sorted by entity number
+} deltaframe_t;
+
+typedef struct
+{
+	int				sequence;	// of the latest snapshot
+	unsigned int	poolhead;
+	int				dropped;	// entities left out of the latest one past DELTA_MAXENTS
+	deltaframe_t	frames[DELTA_BACKUP];
+	deltaentity_t	pool[DELTA_POOL];
+} deltahistory_t;
+
+#define	DELTA_ENT(h,i)	(&(h)->pool[(i) & (DELTA_POOL-1)])
+
+void Delta_Clear (deltahistory_t *hist);
+deltaframe_t *Delta_BaseFrame (deltahistory_t *hist, int base, int sequence);
+deltaframe_t *Delta_BeginFrame (deltahistory_t *hist, int sequence);
+qboolean Delta_AddEntity (deltahistory_t *hist, deltaframe_t *frame, deltaentity_t *state);
+void Delta_EndFrame (deltahistory_t *hist, deltaframe_t *frame, int sequence);
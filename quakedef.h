@@ -277,6 +277,8 @@ extern	quakeparms_t *host_parms;
 
 extern	cvar_t		sys_ticrate;
 extern	cvar_t		sys_throttle;
+extern	cvar_t		sys_wakeonpacket;
+extern	cvar_t		host_maxfps;
 
 extern	cvar_t		developer;
 extern	cvar_t		host_timescale;
@@ -290,8 +292,35 @@ extern	double		realtime;			// not bounded in any way, changed at
 										// start of every frame, never reset
 extern	float		host_netinterval;	// for renderer/server isolation
 
+// the parts of a server frame timed by host_framestats
+typedef enum
+{
+	FS_FRAME,			// all of Host_ServerFrame
+	FS_NEWCLIENTS,
+	FS_RUNCLIENTS,
+	FS_PHYSICS,			// all of SV_Physics, then split by what was run
+	FS_PHYS_CLIENT,
+	FS_PHYS_PUSH,
+	FS_PHYS_NONE,
+	FS_PHYS_FOLLOW,
+	FS_PHYS_NOCLIP,
+	FS_PHYS_STEP,
+	FS_PHYS_WALK,
+	FS_PHYS_TOSS,		// and bounce, fly and flymissile
+	FS_QUAKEC,			// PR_ExecuteProgram calls from the engine, inside the others
+	FS_SEND,			// SV_SendClientMessages
+	FS_NET,				// in the net drivers, inside the others
+
+	NUM_FRAMESTATS
+} framestat_t;
+
 void Host_ClearMemory (void);
 void Host_ServerFrame (void);
+// time a part of the server frame, start is 0 when host_framestats is off
+double Host_FrameStatStart (void);
+void Host_FrameStatStop (framestat_t stat, double start);
+void Host_FrameStats_f (void);
+void Host_FrameStatsCSV (void);
 void Host_InitFileList (void);
 void Host_AddExtCommands (void);
 void Host_InitCommands (void);
@@ -300,6 +329,8 @@ void Host_Shutdown(void);
 void Host_Error (char *error, ...);
 void Host_EndGame (char *message, ...);
 void Host_Frame (double time);
+void Host_Idle (double time);
+void Host_Load_f (void);
 void Host_Quit_f (void);
 void Host_ClientCommands (char *fmt, ...);
 void Host_ShutdownServer (qboolean crash);
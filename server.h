@@ -57,6 +57,7 @@ typedef struct
 	edict_t		*edicts;			// can NOT be array indexed, because
 									// edict_t is variable sized, but can
 									// be used to reference the world ent
+	edicthot_t	*edicthot;			// indexed by edict number
 	server_state_t	state;			// some actions are only valid during load
 
 	sizebuf_t	datagram;
@@ -109,6 +110,7 @@ typedef struct client_s
 
 // client known data for deltas	
 	int				old_frags;
+	int				delta_acked;		// PROTOCOL_DELTA snapshot the client has, 0 for none
 } client_t;
 
 
@@ -178,6 +180,23 @@ typedef struct client_s
 #define	SPAWNFLAG_NOT_HARD			1024
 #define	SPAWNFLAG_NOT_DEATHMATCH	2048
 
+#define	MAX_FATPVS_LEAFS	32
+
+// a pvs grown by 8 units, with its own buffers so clients can be done in parallel
+typedef struct
+{
+	int		bytes;
+	int		capacity;
+	byte	*bits;
+	byte	*leafbits;		// scratch for one leaf's pvs
+	qboolean	cached;		// main thread only, leaf rows come from the vis cache
+	qboolean	novis;		// r_novis 2 when bits was made
+	int		numleafs;		// leafs bits was made from, -1 if it must be rebuilt
+	int		numnewleafs;	// leafs around the current origin, > MAX_FATPVS_LEAFS if too many
+	struct mleaf_s	*leafs[MAX_FATPVS_LEAFS];
+	struct mleaf_s	*newleafs[MAX_FATPVS_LEAFS];
+} fatpvs_t;
+
 //============================================================================
 
 extern	cvar_t	sv_maxvelocity;
@@ -198,7 +217,10 @@ extern	cvar_t	sv_aim;
 extern	cvar_t	sv_altnoclip;
 extern	cvar_t	sv_touchnoclip;
 extern	cvar_t	sv_bouncedownslopes;
+extern	cvar_t	sv_parallelphysics;
 extern	cvar_t	sv_stupidquakebugfix;
+extern	cvar_t	sv_threads;
+extern	cvar_t	sv_fastfindradius;
 
 extern	cvar_t	teamplay;
 extern	cvar_t	skill;
@@ -230,6 +252,9 @@ void SV_DropClient (qboolean crash);
 void SV_SendClientMessages (void);
 void SV_ClearDatagram (void);
 byte *SV_FatPVS (vec3_t org, struct model_s *worldmodel);
+void SV_AllocFatPVS (fatpvs_t *fat, struct model_s *worldmodel);
+byte *SV_CalcFatPVS (fatpvs_t *fat, vec3_t org, struct model_s *worldmodel);
+void SV_ClearFatPVS (void);
 
 int SV_ModelIndex (char *name);
 
@@ -249,6 +274,11 @@ qboolean SV_CheckBottom (edict_t *ent);
 qboolean SV_movestep (edict_t *ent, vec3_t move, qboolean relink);
 
 void SV_WriteClientdataToMessage (edict_t *ent, sizebuf_t *msg);
+void SV_WriteClientdata (edict_t *ent, int weaponmodel, sizebuf_t *msg);
+void SV_BuildSnapshot (void);
+qboolean SV_WriteEntitiesToClient (edict_t *clent, byte *pvs, sizebuf_t *msg);
+qboolean SV_WriteDeltaEntities (client_t *client, deltahistory_t *hist, byte *pvs, sizebuf_t *msg);
+void SV_ClearClientDelta (client_t *client);
 
 void SV_MoveToGoal (void);
 
@@ -261,3 +291,4 @@ void SV_SpawnServer (char *server);
 void SV_Freezeall_f (void);
 
 void SV_StupidQuakeBugFix (void);
+void SV_Threads (void);
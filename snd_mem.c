@@ -114,7 +114,9 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 
 //	Con_Printf ("loading %s\n",namebuffer);
 
-	data = COM_LoadStackFile(namebuffer, stackbuf, sizeof(stackbuf), NULL);
+	data = COM_MapFile(namebuffer, NULL);
+	if (!data)
+		data = COM_LoadStackFile(namebuffer, stackbuf, sizeof(stackbuf), NULL);
 
 	if (!data)
 	{
@@ -125,24 +127,24 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 	info = GetWavinfo (s->name, data, com_filesize);
 
 	if (!info.dataofs)
-		return NULL;
+		goto done;
 
 	if (info.channels != 1)
 	{
 		if (info.channels != 2)
 		{
 			Con_SafePrintf("%s has an unsupported number of channels (%d)\n", s->name, info.channels);
-			return NULL;
+			goto done;
 		}
 
 		Con_SafePrintf ("%s is a stereo sample\n", s->name);
-		return NULL;
+		goto done;
 	}
 
 	if (info.width != 1 && info.width != 2)
 	{
 		Con_SafePrintf("%s is not 8 or 16 bit\n", s->name);
-		return NULL;
+		goto done;
 	}
 
 	stepscale = (float)info.rate / dma.speed;	
@@ -153,12 +155,12 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 	if (info.samples == 0 || len == 0)
 	{
 		Con_DWarning("Sound %s has zero samples\n", s->name);
-		return NULL;
+		goto done;
 	}
 
 	sc = Cache_Alloc ( &s->cache, len + sizeof(sfxcache_t), s->name);
 	if (!sc)
-		return NULL;
+		goto done;
 	
 	sc->length = info.samples;
 	sc->loopstart = info.loopstart;
@@ -168,6 +170,9 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 
 	ResampleSfx (s, sc->speed, sc->width, data + info.dataofs);
 
+done:
+	COM_UnmapFile (data);
+
 	return sc;
 }
 
@@ -26,6 +26,12 @@ server_static_t	svs;
 
 char	localmodels[MAX_MODELS][6]; // "*1023" //5 "*255"		// inline model names for precache
 
+cvar_t	sv_threads = {"sv_threads", "0", CVAR_ARCHIVE};	// worker threads building client datagrams
+cvar_t	sv_edicthot = {"sv_edicthot", "1", CVAR_NONE};	// 0 = cull entities from the edicts, for sv_edictbench
+
+void SV_SnapshotBench_f (void);
+void SV_EdictBench_f (void);
+
 
 //============================================================================
 
@@ -59,6 +65,9 @@ void SV_Protocol_f (void)
 		case PROTOCOL_RMQ:
 			p = "RMQ";
 			break;
+		case PROTOCOL_DELTA:
+			p = "Delta";
+			break;
 		default:
 			return;
 		}
@@ -66,9 +75,9 @@ void SV_Protocol_f (void)
 		break;
 	case 2:
 		i = atoi(Cmd_Argv(1));
-		if (i != PROTOCOL_NETQUAKE && i != PROTOCOL_FITZQUAKE && i != PROTOCOL_MARKV && i != PROTOCOL_RMQ)
-			Con_Printf ("sv_protocol must be %i, %i, %i or %i\n", 
-				PROTOCOL_NETQUAKE, PROTOCOL_FITZQUAKE, PROTOCOL_MARKV, PROTOCOL_RMQ);
+		if (i != PROTOCOL_NETQUAKE && i != PROTOCOL_FITZQUAKE && i != PROTOCOL_MARKV && i != PROTOCOL_RMQ && i != PROTOCOL_DELTA)
+			Con_Printf ("sv_protocol must be %i, %i, %i, %i or %i\n", 
+				PROTOCOL_NETQUAKE, PROTOCOL_FITZQUAKE, PROTOCOL_MARKV, PROTOCOL_RMQ, PROTOCOL_DELTA);
 		else
 		{
 			sv_protocol = i;
@@ -112,10 +121,19 @@ void SV_Init (void)
 	Cvar_RegisterVariableCallback (&sv_stupidquakebugfix, SV_StupidQuakeBugFix);
 
 	Cvar_RegisterVariable (&sv_bouncedownslopes);
+	Cvar_RegisterVariable (&sv_parallelphysics);
+	Cvar_RegisterVariableCallback (&sv_threads, SV_Threads);
+	Cvar_RegisterVariable (&sv_areadepth);
+	Cvar_RegisterVariable (&sv_fastfindradius);
+	Cvar_RegisterVariable (&sv_edicthot);
 
 	Cmd_AddCommand ("freezeall", &SV_Freezeall_f);
 
 	Cmd_AddCommand ("sv_protocol", &SV_Protocol_f);
+	Cmd_AddCommand ("sv_snapshotbench", &SV_SnapshotBench_f);
+	Cmd_AddCommand ("sv_edictbench", &SV_EdictBench_f);
+	Cmd_AddCommand ("sv_areastats", &SV_AreaStats_f);
+	Cmd_AddCommand ("sv_tracebench", &SV_TraceBench_f);
 
 	for (i=0 ; i<MAX_MODELS ; i++)
 		sprintf (localmodels[i], "*%i", i);
@@ -137,9 +155,12 @@ void SV_Init (void)
 	case PROTOCOL_RMQ:
 		p = "RMQ";
 		break;
+	case PROTOCOL_DELTA:
+		p = "Delta";
+		break;
 	default:
-		Sys_Error ("Bad protocol version request %i. Accepted values: %i, %i, %i or %i",
-				   sv_protocol, PROTOCOL_NETQUAKE, PROTOCOL_FITZQUAKE, PROTOCOL_MARKV, PROTOCOL_RMQ);
+		Sys_Error ("Bad protocol version request %i. Accepted values: %i, %i, %i, %i or %i",
+				   sv_protocol, PROTOCOL_NETQUAKE, PROTOCOL_FITZQUAKE, PROTOCOL_MARKV, PROTOCOL_RMQ, PROTOCOL_DELTA);
 		return; /* silence compiler */
 	}
 	Sys_Printf ("Server using protocol %i (%s)\n", sv_protocol, p);
@@ -158,6 +179,23 @@ void SV_StupidQuakeBugFix (void)
 	Con_Printf ("'stupid quake bug' fix %s\n", stupidquakebugfix ? "enabled" : "disabled");
 }
 
+/*
+===============
+SV_Threads
+===============
+*/
+void SV_Threads (void)
+{
+	if (sv_threads.value < 0 || sv_threads.value > MAX_WORKER_THREADS)
+	{
+		Con_Printf ("sv_threads must be between 0 and %i\n", MAX_WORKER_THREADS);
+		Cvar_SetValue ("sv_threads", CLAMP(0, sv_threads.value, MAX_WORKER_THREADS));
+		return;
+	}
+
+	Sys_SetWorkerThreads ((int)sv_threads.value);
+}
+
 /*
 =============================================================================
 
@@ -267,14 +305,14 @@ void SV_StartSound (edict_t *entity, int channel, char *sample, int volume, floa
 	//johnfitz -- PROTOCOL_FITZQUAKE
 	if (ent >= 8192)
 	{
-		if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ)
+		if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ || sv.protocol == PROTOCOL_DELTA)
 			field_mask |= SND_LARGEENTITY;
 		else
 			return; // don't send any info protocol can't support
 	}
 	if (sound_num >= 256 || channel >= 8)
 	{
-		if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ)
+		if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ || sv.protocol == PROTOCOL_DELTA)
 			field_mask |= SND_LARGESOUND;
 		else
 			return; // don't send any info protocol can't support
@@ -334,10 +372,12 @@ void SV_SendServerInfo (client_t *client)
 	sprintf (message, "%c\nfxQuake %4.2f SERVER (%i CRC)\n", 2, (float)VERSION, pr_crc);
 	MSG_WriteString (&client->message, message);
 
+	SV_ClearClientDelta (client);	// entity snapshots start over from the new baselines
+
 	MSG_WriteByte (&client->message, svc_serverinfo);
 	MSG_WriteLong (&client->message, sv.protocol); // use sv.protocol instead of PROTOCOL_NETQUAKE
     
-	if (sv.protocol == PROTOCOL_RMQ)
+	if (sv.protocol == PROTOCOL_RMQ || sv.protocol == PROTOCOL_DELTA)
 	{
 		// mh - now send protocol flags so that the client knows the protocol features to expect
 		MSG_WriteLong (&client->message, sv.protocolflags);
@@ -509,13 +549,98 @@ crosses a waterline.
 =============================================================================
 */
 
-static int	fatbytes;
-static byte	*fatpvs;
-static int	fatpvs_capacity;
+static fatpvs_t	sv_fatpvs;
+
+/*
+=============
+SV_AllocFatPVS
+
+Sizes the buffers of a fat pvs for worldmodel, must be called from the main
+thread before SV_CalcFatPVS
+=============
+*/
+void SV_AllocFatPVS (fatpvs_t *fat, model_t *worldmodel)
+{
+	if (fat->bytes != (worldmodel->numleafs+7)>>3)
+		fat->numleafs = -1;
+	fat->bytes = (worldmodel->numleafs+7)>>3; // ericw -- was +31, assumed to be a bug/typo
+	if (fat->bits == NULL || fat->bytes > fat->capacity)
+	{
+		fat->capacity = fat->bytes;
+		fat->numleafs = -1;
+		fat->bits = (byte *) realloc (fat->bits, fat->capacity);
+		fat->leafbits = (byte *) realloc (fat->leafbits, fat->capacity);
+		if (!fat->bits || !fat->leafbits)
+			Host_Error ("SV_AllocFatPVS: realloc() failed on %d bytes", fat->capacity);
+	}
+}
+
+/*
+=============
+SV_FindFatLeafs
+
+Lists the non solid leafs within 8 units of org in fat->newleafs.  The walk
+order only depends on the tree, so the same set of leafs always comes out
+in the same order.
+=============
+*/
+static void SV_FindFatLeafs (fatpvs_t *fat, vec3_t org, mnode_t *node)
+{
+	mplane_t	*plane;
+	float	d;
+
+	while (1)
+	{
+		if (node->contents < 0)
+		{
+			if (node->contents != CONTENTS_SOLID)
+			{
+				if (fat->numnewleafs < MAX_FATPVS_LEAFS)
+					fat->newleafs[fat->numnewleafs] = (mleaf_t *)node;
+				fat->numnewleafs++;
+			}
+			return;
+		}
+
+		plane = node->plane;
+		d = DotProduct (org, plane->normal) - plane->dist;
+		if (d > 8)
+			node = node->children[0];
+		else if (d < -8)
+			node = node->children[1];
+		else
+		{	// go down both
+			SV_FindFatLeafs (fat, org, node->children[0]);
+			node = node->children[1];
+		}
+	}
+}
+
+/*
+=============
+SV_OrPVS
 
-void SV_AddToFatPVS (vec3_t org, mnode_t *node, model_t *worldmodel) //johnfitz -- added worldmodel as a parameter
+dst |= src a machine word at a time, src rows may be unaligned
+=============
+*/
+static void SV_OrPVS (byte *dst, byte *src, int bytes)
 {
+	size_t	a, b;
 	int		i;
+
+	for (i=0 ; i + (int)sizeof(a) <= bytes ; i += sizeof(a))
+	{
+		memcpy (&a, dst + i, sizeof(a));
+		memcpy (&b, src + i, sizeof(b));
+		a |= b;
+		memcpy (dst + i, &a, sizeof(a));
+	}
+	for ( ; i<bytes ; i++)
+		dst[i] |= src[i];
+}
+
+static void SV_AddToFatPVS (fatpvs_t *fat, vec3_t org, mnode_t *node, model_t *worldmodel) //johnfitz -- added worldmodel as a parameter
+{
 	byte	*pvs;
 	mplane_t	*plane;
 	float	d;
@@ -527,9 +652,11 @@ void SV_AddToFatPVS (vec3_t org, mnode_t *node, model_t *worldmodel) //johnfitz
 		{
 			if (node->contents != CONTENTS_SOLID)
 			{
-				pvs = Mod_LeafPVS ( (mleaf_t *)node, worldmodel);
-				for (i=0 ; i<fatbytes ; i++)
-					fatpvs[i] |= pvs[i];
+				if (fat->cached)
+					pvs = Mod_LeafPVS ( (mleaf_t *)node, worldmodel);
+				else
+					pvs = Mod_LeafPVSBuffer ( (mleaf_t *)node, worldmodel, fat->leafbits);
+				SV_OrPVS (fat->bits, pvs, fat->bytes);
 			}
 			return;
 		}
@@ -542,7 +669,7 @@ void SV_AddToFatPVS (vec3_t org, mnode_t *node, model_t *worldmodel) //johnfitz
 			node = node->children[1];
 		else
 		{	// go down both
-			SV_AddToFatPVS (org, node->children[0], worldmodel);
+			SV_AddToFatPVS (fat, org, node->children[0], worldmodel);
 			node = node->children[1];
 		}
 	}
@@ -550,83 +677,157 @@ void SV_AddToFatPVS (vec3_t org, mnode_t *node, model_t *worldmodel) //johnfitz
 
 /*
 =============
-SV_FatPVS
+SV_CalcFatPVS
 
 Calculates a PVS that is the inclusive or of all leafs within 8 pixels of the
-given point.
+given point.  Only touches fat, so worker threads can run it.
+
+The bits are kept until the point moves into a different set of leafs, so a
+client standing or walking around inside a leaf only pays for the tree walk.
 =============
 */
-byte *SV_FatPVS (vec3_t org, model_t *worldmodel) //johnfitz -- added worldmodel as a parameter
+byte *SV_CalcFatPVS (fatpvs_t *fat, vec3_t org, model_t *worldmodel)
 {
-	fatbytes = (worldmodel->numleafs+7)>>3; // ericw -- was +31, assumed to be a bug/typo
-	if (fatpvs == NULL || fatbytes > fatpvs_capacity)
+	int		i;
+	byte	*pvs;
+	qboolean	novis;
+
+	fat->numnewleafs = 0;
+	SV_FindFatLeafs (fat, org, worldmodel->nodes);
+
+	novis = (r_novis.value == 2);
+	if (fat->numnewleafs == fat->numleafs && fat->novis == novis
+	 && !memcmp (fat->newleafs, fat->leafs, fat->numleafs * sizeof(fat->leafs[0])))
+		return fat->bits;
+
+	if (fat->numnewleafs > MAX_FATPVS_LEAFS)
+	{	// too many to remember, do it the slow way
+		memset (fat->bits, 0, fat->bytes);
+		SV_AddToFatPVS (fat, org, worldmodel->nodes, worldmodel);
+		fat->numleafs = -1;
+		return fat->bits;
+	}
+
+	memset (fat->bits, 0, fat->bytes);
+	for (i=0 ; i<fat->numnewleafs ; i++)
 	{
-		fatpvs_capacity = fatbytes;
-		fatpvs = (byte *) realloc (fatpvs, fatpvs_capacity);
-		if (!fatpvs)
-			Host_Error ("SV_FatPVS: realloc() failed on %d bytes", fatpvs_capacity);
+		if (fat->cached)
+			pvs = Mod_LeafPVS (fat->newleafs[i], worldmodel);
+		else
+			pvs = Mod_LeafPVSBuffer (fat->newleafs[i], worldmodel, fat->leafbits);
+		SV_OrPVS (fat->bits, pvs, fat->bytes);
 	}
-    
-	memset (fatpvs, 0, fatbytes);
-	SV_AddToFatPVS (org, worldmodel->nodes, worldmodel);
-    
-	return fatpvs;
+
+	fat->numleafs = fat->numnewleafs;
+	fat->novis = novis;
+	memcpy (fat->leafs, fat->newleafs, fat->numleafs * sizeof(fat->leafs[0]));
+
+	return fat->bits;
+}
+
+/*
+=============
+SV_FatPVS
+=============
+*/
+byte *SV_FatPVS (vec3_t org, model_t *worldmodel) //johnfitz -- added worldmodel as a parameter
+{
+	SV_AllocFatPVS (&sv_fatpvs, worldmodel);
+	sv_fatpvs.cached = true;
+	return SV_CalcFatPVS (&sv_fatpvs, org, worldmodel);
 }
 
 
 //=============================================================================
 
 
+/*
+=============================================================================
+
+ENTITY SNAPSHOT
+
+Entity updates are deltas against the spawn baseline, so they come out the
+same for every client.  They are encoded once per frame into a shared
+buffer, and each client only picks the records for the entities it can see.
+
+PROTOCOL_DELTA instead deltas every client against the last snapshot it
+acked, from the entity states taken here.
+
+=============================================================================
+*/
+
+typedef struct
+{
+	int		ofs;			// into snapshot_data, -1 if the entity isn't sent this frame,
+							// PROTOCOL_DELTA only sets it to 0 and writes no record
+	int		len;
+	int		packetsize;		// worst case room the record used to reserve in a datagram
+	qboolean	visible;	// has a model; an entity without one is only sent to itself
+	deltaentity_t	delta;	// PROTOCOL_DELTA state
+} snapentity_t;
+
+static snapentity_t	*snapshot_ents;
+static int			snapshot_ents_capacity;
+static byte			*snapshot_data;
+static int			snapshot_data_capacity;
+
+#define	MAX_SNAPSHOT_RECORD	64	// largest possible entity update is 40 bytes
+
 /*
 =============
-SV_WriteEntitiesToClient
+SV_BuildSnapshot
 
+Encodes the update of every entity that may be sent to a client this frame
 =============
 */
-void SV_WriteEntitiesToClient (edict_t	*clent, sizebuf_t *msg)
+void SV_BuildSnapshot (void)
 {
-	int		e, i, packetsize;
+	int		e, i;
 	int		bits;
-	byte	*pvs;
-	vec3_t	org;
 	float	miss;
 	edict_t	*ent;
-	static float lastmsg = 0;
 	eval_t  *val;
+	snapentity_t	*snap;
+	sizebuf_t	msg;
 
-// find the client's PVS
-	VectorAdd (clent->v.origin, clent->v.view_ofs, org);
-	pvs = SV_FatPVS (org, sv.worldmodel);
+	if (snapshot_ents == NULL || sv.num_edicts > snapshot_ents_capacity)
+	{
+		snapshot_ents_capacity = sv.max_edicts;
+		snapshot_ents = (snapentity_t *) realloc (snapshot_ents, snapshot_ents_capacity * sizeof(snapentity_t));
+		if (!snapshot_ents)
+			Host_Error ("SV_BuildSnapshot: realloc() failed on %d entities", snapshot_ents_capacity);
+	}
+	if (snapshot_data == NULL || sv.num_edicts * MAX_SNAPSHOT_RECORD > snapshot_data_capacity)
+	{
+		snapshot_data_capacity = sv.max_edicts * MAX_SNAPSHOT_RECORD;
+		snapshot_data = (byte *) realloc (snapshot_data, snapshot_data_capacity);
+		if (!snapshot_data)
+			Host_Error ("SV_BuildSnapshot: realloc() failed on %d bytes", snapshot_data_capacity);
+	}
+
+	msg.allowoverflow = false;
+	msg.overflowed = false;
+	msg.data = snapshot_data;
+	msg.maxsize = snapshot_data_capacity;
+	msg.cursize = 0;
 
-// send over all entities (except the client) that touch the pvs
 	ent = NEXT_EDICT(sv.edicts);
-	for (e=1 ; e<sv.num_edicts ; e++, ent = NEXT_EDICT(ent))
+	for (e=1, snap=snapshot_ents+1 ; e<sv.num_edicts ; e++, snap++, ent = NEXT_EDICT(ent))
 	{
+		snap->ofs = -1;
 
-		if (ent != clent)	// clent is ALWAYS sent
-		{
-			// ignore ents without visible models
-			if (!ent->v.modelindex || !*PR_GetString(ent->v.model))
-				continue;
+		// ignore ents without visible models
+		snap->visible = true;
+		if (!ent->v.modelindex || !*PR_GetString(ent->v.model))
+			snap->visible = false;
 
-			//johnfitz -- don't send model>255 entities if protocol is 15
-			if (sv.protocol == PROTOCOL_NETQUAKE && (int)ent->v.modelindex & 0xFF00)
-				continue;
+		//johnfitz -- don't send model>255 entities if protocol is 15
+		if (sv.protocol == PROTOCOL_NETQUAKE && (int)ent->v.modelindex & 0xFF00)
+			snap->visible = false;
 
-			// ignore if not touching a PV leaf
-			for (i=0 ; i < ent->num_leafs ; i++)
-				if (pvs[ent->leafnums[i] >> 3] & (1 << (ent->leafnums[i]&7) ))
-					break;
-
-			// ericw -- added ent->num_leafs < MAX_ENT_LEAFS condition.
-			//
-			// if ent->num_leafs == MAX_ENT_LEAFS, the ent is visible from too many leafs
-			// for us to say whether it's in the PVS, so don't try to vis cull it.
-			// this commonly happens with rotators, because they often have huge bboxes
-			// spanning the entire map, or really tall lifts, etc.
-			if (i == ent->num_leafs && ent->num_leafs < MAX_ENT_LEAFS)
-				continue;	// not visible
-		}
+		// a client entity is always sent to its own client
+		if (!snap->visible && e > svs.maxclients)
+			continue;
 
 // send an update
 		bits = 0;
@@ -668,14 +869,14 @@ void SV_WriteEntitiesToClient (edict_t	*clent, sizebuf_t *msg)
 		//  Model alpha support
 		if (pr_alpha_supported)
 		{
-			val = GetEdictFieldValue(ent, "alpha");
+			val = GetEdictFieldValue(ent, pr_extfields.alpha);
 			if (val)
 				ent->alpha = ENTALPHA_ENCODE(val->_float);
 		}
 		// Model fullbright support (Nehahra)
 		if (pr_fullbright_supported)
 		{
-			val = GetEdictFieldValue(ent, "fullbright");
+			val = GetEdictFieldValue(ent, pr_extfields.fullbright);
 			if (val)
 				ent->fullbright = val->_float;
 		}
@@ -685,14 +886,14 @@ void SV_WriteEntitiesToClient (edict_t	*clent, sizebuf_t *msg)
 			continue;
 		//johnfitz
 
-		val = GetEdictFieldValue(ent, "scale");
+		val = GetEdictFieldValue(ent, pr_extfields.scale);
 		if (val)
 			ent->scale = ENTSCALE_ENCODE(val->_float);
 		else
 			ent->scale = ENTSCALE_DEFAULT;
 
 		//johnfitz -- PROTOCOL_FITZQUAKE
-		if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ)
+		if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ || sv.protocol == PROTOCOL_DELTA)
 		{
 			if (ent->baseline.alpha != ent->alpha)
 				bits |= U_ALPHA;
@@ -725,124 +926,637 @@ void SV_WriteEntitiesToClient (edict_t	*clent, sizebuf_t *msg)
 			bits |= U_MOREBITS;
 
 		// PROTOCOL_FITZQUAKE
-		if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ)
+		if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ || sv.protocol == PROTOCOL_DELTA)
 		{
 			//johnfitz -- max size for protocol 15 is 18 bytes, not 16 as originally assumed here.
 			//And, for protocol 85(PROTOCOL_FITZQUAKE?) the max size is actually 24 bytes.
 			//For float coords and angles the limit is 40. PROTOCOL_RMQ?
-//			packetsize = 24;
-			packetsize = 40;
-
-			if (msg->maxsize - msg->cursize < packetsize)
-			{
-				if (IsTimeout (&lastmsg, 2))
-					Con_Printf ("packet overflow!\n");
-
-				return;
-			}
+//			snap->packetsize = 24;
+			snap->packetsize = 40;
 		}
 		else
 		{
-			packetsize = 16 + 2; // Original + missing for worst case
+			snap->packetsize = 16 + 2; // Original + missing for worst case
 
 			if (bits & U_TRANS)
-				packetsize += 12; // Nehahra
-
-			if (msg->maxsize - msg->cursize < packetsize)
-			{
-				if (IsTimeout (&lastmsg, 2))
-					Con_Printf ("packet overflow\n");
+				snap->packetsize += 12; // Nehahra
+		}
 
-				return;
-			}
+		if (sv.protocol == PROTOCOL_DELTA)
+		{
+			VectorCopy (ent->v.origin, snap->delta.state.origin);
+			VectorCopy (ent->v.angles, snap->delta.state.angles);
+			snap->delta.state.modelindex = ent->v.modelindex;
+			snap->delta.state.frame = ent->v.frame;
+			snap->delta.state.colormap = ent->v.colormap;
+			snap->delta.state.skin = ent->v.skin;
+			snap->delta.state.alpha = ent->alpha;
+			snap->delta.state.scale = ent->scale;
+			snap->delta.state.effects = ent->v.effects;
+			snap->delta.num = e;
+			snap->delta.flags = bits & (U_STEP | U_LERPFINISH);
+			snap->delta.lerpfinish = (bits & U_LERPFINISH) ? (byte)(Q_rint((ent->v.nextthink-sv.time)*255)) : 0;
+
+			// SV_WriteDeltaEntities encodes against each client's base itself
+			snap->ofs = 0;
+			snap->len = 0;
+			continue;
 		}
 
 	//
 	// write the message
 	//
-		MSG_WriteByte (msg,bits | U_SIGNAL);
+		snap->ofs = msg.cursize;
+
+		MSG_WriteByte (&msg,bits | U_SIGNAL);
 		
 		if (bits & U_MOREBITS)
-			MSG_WriteByte (msg, bits>>8);
+			MSG_WriteByte (&msg, bits>>8);
 
-		if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ)
+		if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ || sv.protocol == PROTOCOL_DELTA)
 		{
 			//johnfitz -- PROTOCOL_FITZQUAKE
 			if (bits & U_EXTEND1)
-				MSG_WriteByte (msg, bits>>16);
+				MSG_WriteByte (&msg, bits>>16);
 			if (bits & U_EXTEND2)
-				MSG_WriteByte (msg, bits>>24);
+				MSG_WriteByte (&msg, bits>>24);
 			//johnfitz
 		}
 
 		if (bits & U_LONGENTITY)
-			MSG_WriteShort (msg,e);
+			MSG_WriteShort (&msg,e);
 		else
-			MSG_WriteByte (msg,e);
+			MSG_WriteByte (&msg,e);
 
 		if (bits & U_MODEL)
-			MSG_WriteByte (msg, ent->v.modelindex);
+			MSG_WriteByte (&msg, ent->v.modelindex);
 		if (bits & U_FRAME)
-			MSG_WriteByte (msg, ent->v.frame);
+			MSG_WriteByte (&msg, ent->v.frame);
 		if (bits & U_COLORMAP)
-			MSG_WriteByte (msg, ent->v.colormap);
+			MSG_WriteByte (&msg, ent->v.colormap);
 		if (bits & U_SKIN)
-			MSG_WriteByte (msg, ent->v.skin);
+			MSG_WriteByte (&msg, ent->v.skin);
 		if (bits & U_EFFECTS)
-			MSG_WriteByte (msg, ent->v.effects);
+			MSG_WriteByte (&msg, ent->v.effects);
 		if (bits & U_ORIGIN1)
-			MSG_WriteCoord (msg, ent->v.origin[0], sv.protocolflags);
+			MSG_WriteCoord (&msg, ent->v.origin[0], sv.protocolflags);
 		if (bits & U_ANGLE1)
 		{
 			if (sv.protocol == PROTOCOL_MARKV)
-				MSG_WriteAngle16(msg, ent->v.angles[0], sv.protocolflags); // Baker change
+				MSG_WriteAngle16(&msg, ent->v.angles[0], sv.protocolflags); // Baker change
 			else
-				MSG_WriteAngle(msg, ent->v.angles[0], sv.protocolflags);
+				MSG_WriteAngle(&msg, ent->v.angles[0], sv.protocolflags);
 		}
 		if (bits & U_ORIGIN2)
-			MSG_WriteCoord (msg, ent->v.origin[1], sv.protocolflags);
+			MSG_WriteCoord (&msg, ent->v.origin[1], sv.protocolflags);
 		if (bits & U_ANGLE2)
 		{
 			if (sv.protocol == PROTOCOL_MARKV)
-				MSG_WriteAngle16(msg, ent->v.angles[1], sv.protocolflags); // Baker change
+				MSG_WriteAngle16(&msg, ent->v.angles[1], sv.protocolflags); // Baker change
 			else
-				MSG_WriteAngle(msg, ent->v.angles[1], sv.protocolflags);
+				MSG_WriteAngle(&msg, ent->v.angles[1], sv.protocolflags);
 		}
 		if (bits & U_ORIGIN3)
-			MSG_WriteCoord (msg, ent->v.origin[2], sv.protocolflags);
+			MSG_WriteCoord (&msg, ent->v.origin[2], sv.protocolflags);
 		if (bits & U_ANGLE3)
 		{
 			if (sv.protocol == PROTOCOL_MARKV)
-				MSG_WriteAngle16(msg, ent->v.angles[2], sv.protocolflags); // Baker change
+				MSG_WriteAngle16(&msg, ent->v.angles[2], sv.protocolflags); // Baker change
 			else
-				MSG_WriteAngle(msg, ent->v.angles[2], sv.protocolflags);
+				MSG_WriteAngle(&msg, ent->v.angles[2], sv.protocolflags);
 		}
 
-		if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ)
+		if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ || sv.protocol == PROTOCOL_DELTA)
 		{
 			//johnfitz -- PROTOCOL_FITZQUAKE
 			if (bits & U_ALPHA)
-				MSG_WriteByte(msg, ent->alpha);
+				MSG_WriteByte(&msg, ent->alpha);
 			if (bits & U_SCALE)
-				MSG_WriteByte(msg, ent->scale);
+				MSG_WriteByte(&msg, ent->scale);
 			if (bits & U_FRAME2)
-				MSG_WriteByte(msg, (int)ent->v.frame >> 8);
+				MSG_WriteByte(&msg, (int)ent->v.frame >> 8);
 			if (bits & U_MODEL2)
-				MSG_WriteByte(msg, (int)ent->v.modelindex >> 8);
+				MSG_WriteByte(&msg, (int)ent->v.modelindex >> 8);
 			if (bits & U_LERPFINISH)
-				MSG_WriteByte(msg, (byte)(Q_rint((ent->v.nextthink-sv.time)*255)));
+				MSG_WriteByte(&msg, (byte)(Q_rint((ent->v.nextthink-sv.time)*255)));
 			//johnfitz
 		}
 		else
 		{
 			if (bits & U_TRANS) // Nehahra
 			{ 
-				MSG_WriteFloat(msg, 2);
-				MSG_WriteFloat(msg, ENTALPHA_DECODE(ent->alpha));
-				MSG_WriteFloat(msg, ent->fullbright);
+				MSG_WriteFloat(&msg, 2);
+				MSG_WriteFloat(&msg, ENTALPHA_DECODE(ent->alpha));
+				MSG_WriteFloat(&msg, ent->fullbright);
 			}
 		}
+
+		snap->len = msg.cursize - snap->ofs;
+	}
+}
+
+/*
+=============
+SV_EntityInPVS
+=============
+*/
+static qboolean SV_EntityInPVS (edict_t *ent, edicthot_t *hot, qboolean usehot, byte *pvs)
+{
+	int		i;
+	int		num_leafs, *leafnums;
+
+	// only entities in more than HOT_LEAFS leafs need the edict
+	if (usehot)
+	{
+		num_leafs = hot->num_leafs;
+		leafnums = (num_leafs <= HOT_LEAFS) ? hot->leafnums : ent->leafnums;
+	}
+	else
+	{
+		num_leafs = ent->num_leafs;
+		leafnums = ent->leafnums;
 	}
+
+	// ignore if not touching a PV leaf
+	for (i=0 ; i < num_leafs ; i++)
+		if (pvs[leafnums[i] >> 3] & (1 << (leafnums[i]&7) ))
+			break;
+
+	// ericw -- added ent->num_leafs < MAX_ENT_LEAFS condition.
+	//
+	// if ent->num_leafs == MAX_ENT_LEAFS, the ent is visible from too many leafs
+	// for us to say whether it's in the PVS, so don't try to vis cull it.
+	// this commonly happens with rotators, because they often have huge bboxes
+	// spanning the entire map, or really tall lifts, etc.
+	return (i < num_leafs || num_leafs >= MAX_ENT_LEAFS);
+}
+
+/*
+=============
+SV_WriteEntitiesToClient
+
+Copies the snapshot records of the entities in the client's PVS, returns
+false if msg ran out of room
+=============
+*/
+qboolean SV_WriteEntitiesToClient (edict_t *clent, byte *pvs, sizebuf_t *msg)
+{
+	int		e;
+	qboolean	usehot;
+	edict_t	*ent;
+	edicthot_t	*hot;
+	snapentity_t	*snap;
+
+	usehot = (sv_edicthot.value != 0);
+
+// send over all entities (except the client) that touch the pvs
+	ent = NEXT_EDICT(sv.edicts);
+	for (e=1, snap=snapshot_ents+1, hot=sv.edicthot+1 ; e<sv.num_edicts ; e++, snap++, hot++, ent = NEXT_EDICT(ent))
+	{
+		if (snap->ofs == -1)
+			continue;	// nothing to send this frame
+
+		if (ent != clent)	// clent is ALWAYS sent
+		{
+			if (!snap->visible || !SV_EntityInPVS (ent, hot, usehot, pvs))
+				continue;
+		}
+
+		if (msg->maxsize - msg->cursize < snap->packetsize)
+			return false;
+
+		SZ_Write (msg, snapshot_data + snap->ofs, snap->len);
+	}
+
+	return true;
+}
+
+#define	MAX_DELTA_RECORD	40	// same worst case as a PROTOCOL_RMQ update
+
+/*
+=============
+SV_DeltaBits
+
+The fields of to that differ from what the client has in from
+=============
+*/
+static int SV_DeltaBits (deltaentity_t *from, deltaentity_t *to)
+{
+	int		i;
+	int		bits;
+	float	miss;
+
+	bits = 0;
+
+	for (i=0 ; i<3 ; i++)
+	{
+		miss = to->state.origin[i] - from->state.origin[i];
+		if ( miss < -0.1 || miss > 0.1 )
+			bits |= U_ORIGIN1<<i;
+	}
+
+	if (to->state.angles[0] != from->state.angles[0])
+		bits |= U_ANGLE1;
+	if (to->state.angles[1] != from->state.angles[1])
+		bits |= U_ANGLE2;
+	if (to->state.angles[2] != from->state.angles[2])
+		bits |= U_ANGLE3;
+	if (to->state.colormap != from->state.colormap)
+		bits |= U_COLORMAP;
+	if (to->state.skin != from->state.skin)
+		bits |= U_SKIN;
+	if (to->state.frame != from->state.frame)
+		bits |= U_FRAME;
+	if (to->state.effects != from->state.effects)
+		bits |= U_EFFECTS;
+	if (to->state.modelindex != from->state.modelindex)
+		bits |= U_MODEL;
+	if (to->state.alpha != from->state.alpha)
+		bits |= U_ALPHA;
+	if (to->state.scale != from->state.scale)
+		bits |= U_SCALE;
+
+	return bits;
+}
+
+/*
+=============
+SV_WriteDeltaRecord
+
+An update in the PROTOCOL_RMQ layout, bits only holds the fields to send
+=============
+*/
+static void SV_WriteDeltaRecord (sizebuf_t *msg, int bits, deltaentity_t *to)
+{
+	bits |= to->flags;
+	if (bits & U_FRAME && to->state.frame & 0xFF00)
+		bits |= U_FRAME2;
+	if (bits & U_MODEL && to->state.modelindex & 0xFF00)
+		bits |= U_MODEL2;
+	if (bits >= 65536)
+		bits |= U_EXTEND1;
+	if (bits >= 16777216)
+		bits |= U_EXTEND2;
+	if (to->num >= 256)
+		bits |= U_LONGENTITY;
+	if (bits >= 256)
+		bits |= U_MOREBITS;
+
+	MSG_WriteByte (msg, bits | U_SIGNAL);
+	if (bits & U_MOREBITS)
+		MSG_WriteByte (msg, bits>>8);
+	if (bits & U_EXTEND1)
+		MSG_WriteByte (msg, bits>>16);
+	if (bits & U_EXTEND2)
+		MSG_WriteByte (msg, bits>>24);
+
+	if (bits & U_LONGENTITY)
+		MSG_WriteShort (msg, to->num);
+	else
+		MSG_WriteByte (msg, to->num);
+
+	if (bits & U_MODEL)
+		MSG_WriteByte (msg, to->state.modelindex);
+	if (bits & U_FRAME)
+		MSG_WriteByte (msg, to->state.frame);
+	if (bits & U_COLORMAP)
+		MSG_WriteByte (msg, to->state.colormap);
+	if (bits & U_SKIN)
+		MSG_WriteByte (msg, to->state.skin);
+	if (bits & U_EFFECTS)
+		MSG_WriteByte (msg, to->state.effects);
+	if (bits & U_ORIGIN1)
+		MSG_WriteCoord (msg, to->state.origin[0], sv.protocolflags);
+	if (bits & U_ANGLE1)
+		MSG_WriteAngle (msg, to->state.angles[0], sv.protocolflags);
+	if (bits & U_ORIGIN2)
+		MSG_WriteCoord (msg, to->state.origin[1], sv.protocolflags);
+	if (bits & U_ANGLE2)
+		MSG_WriteAngle (msg, to->state.angles[1], sv.protocolflags);
+	if (bits & U_ORIGIN3)
+		MSG_WriteCoord (msg, to->state.origin[2], sv.protocolflags);
+	if (bits & U_ANGLE3)
+		MSG_WriteAngle (msg, to->state.angles[2], sv.protocolflags);
+	if (bits & U_ALPHA)
+		MSG_WriteByte (msg, to->state.alpha);
+	if (bits & U_SCALE)
+		MSG_WriteByte (msg, to->state.scale);
+	if (bits & U_FRAME2)
+		MSG_WriteByte (msg, to->state.frame >> 8);
+	if (bits & U_MODEL2)
+		MSG_WriteByte (msg, to->state.modelindex >> 8);
+	if (bits & U_LERPFINISH)
+		MSG_WriteByte (msg, to->lerpfinish);
+}
+
+/*
+=============
+SV_WriteDeltaEntity
+
+Sends to as a delta against the client's state from, the base snapshot
+entry or NULL for the spawn baseline, and keeps what the client ends up with.
+Returns false if msg ran out of room.
+=============
+*/
+static qboolean SV_WriteDeltaEntity (deltahistory_t *hist, deltaframe_t *frame, deltaentity_t *from, deltaentity_t *to, edict_t *ent, sizebuf_t *msg)
+{
+	int		i;
+	int		bits;
+	deltaentity_t	baseline, sent;
+
+	if (frame->count == DELTA_MAXENTS)
+	{
+		hist->dropped++;	// the client drops it as well
+		return true;
+	}
+
+	if (!from)
+	{
+		baseline.state = ent->baseline;
+		baseline.num = to->num;
+		baseline.flags = 0;
+		baseline.lerpfinish = 0;
+	}
+
+	bits = SV_DeltaBits (from ? from : &baseline, to);
+
+	// a base entity that didn't change isn't sent at all
+	if (from && !bits && from->flags == to->flags && from->lerpfinish == to->lerpfinish)
+	{
+		Delta_AddEntity (hist, frame, from);
+		return true;
+	}
+
+	if (msg->maxsize - msg->cursize < MAX_DELTA_RECORD)
+	{
+		if (from)
+			Delta_AddEntity (hist, frame, from);	// carried over as it was
+		return false;
+	}
+
+	SV_WriteDeltaRecord (msg, bits, to);
+
+	// origins within the epsilon stay what the client has
+	sent = *to;
+	for (i=0 ; i<3 ; i++)
+		if (!(bits & (U_ORIGIN1<<i)))
+			sent.state.origin[i] = (from ? from : &baseline)->state.origin[i];
+	Delta_AddEntity (hist, frame, &sent);
+	return true;
+}
+
+/*
+=============
+SV_WriteDeltaRemove
+=============
+*/
+static qboolean SV_WriteDeltaRemove (deltahistory_t *hist, deltaframe_t *frame, deltaentity_t *from, sizebuf_t *msg)
+{
+	int		bits;
+
+	if (msg->maxsize - msg->cursize < 5)
+	{
+		Delta_AddEntity (hist, frame, from);	// try again next time
+		return false;
+	}
+
+	bits = U_REMOVE | U_EXTEND1 | U_MOREBITS;
+	if (from->num >= 256)
+		bits |= U_LONGENTITY;
+
+	MSG_WriteByte (msg, bits | U_SIGNAL);
+	MSG_WriteByte (msg, bits>>8);
+	MSG_WriteByte (msg, bits>>16);
+	if (bits & U_LONGENTITY)
+		MSG_WriteShort (msg, from->num);
+	else
+		MSG_WriteByte (msg, from->num);
+
+	return true;
+}
+
+/*
+=============
+SV_WriteDeltaEntities
+
+PROTOCOL_DELTA version of SV_WriteEntitiesToClient: a snapshot of the
+entities in the client's PVS, sent as a delta against the last one the
+client acked, or against the spawn baselines if that one is gone.  Records
+come in entity order, the client merges them with its copy of the base.
+=============
+*/
+qboolean SV_WriteDeltaEntities (client_t *client, deltahistory_t *hist, byte *pvs, sizebuf_t *msg)
+{
+	int		e;
+	int		sequence, oldindex;
+	qboolean	usehot, fits;
+	edict_t	*ent;
+	edicthot_t	*hot;
+	snapentity_t	*snap;
+	deltaframe_t	*frame, *base;
+	deltaentity_t	*old;
+
+	if (msg->maxsize - msg->cursize < 9)
+		return false;
+
+	usehot = (sv_edicthot.value != 0);
+
+	sequence = hist->sequence + 1;
+	base = Delta_BaseFrame (hist, client->delta_acked, sequence);
+
+	MSG_WriteByte (msg, svc_deltasnapshot);
+	MSG_WriteLong (msg, sequence);
+	MSG_WriteLong (msg, base ? base->sequence : 0);
+
+	frame = Delta_BeginFrame (hist, sequence);
+
+	fits = true;
+	oldindex = 0;
+	old = (base && base->count) ? DELTA_ENT(hist, base->first) : NULL;
+
+	ent = NEXT_EDICT(sv.edicts);
+	for (e=1, snap=snapshot_ents+1, hot=sv.edicthot+1 ; e<sv.num_edicts ; e++, snap++, hot++, ent = NEXT_EDICT(ent))
+	{
+		if (snap->ofs == -1)
+			continue;	// nothing to send this frame
+
+		if (ent != client->edict)	// clent is ALWAYS sent
+		{
+			if (!snap->visible || !SV_EntityInPVS (ent, hot, usehot, pvs))
+				continue;
+		}
+
+		// the base entities in between left the snapshot
+		while (old && old->num < e)
+		{
+			fits &= SV_WriteDeltaRemove (hist, frame, old, msg);
+			old = (++oldindex < base->count) ? DELTA_ENT(hist, base->first + oldindex) : NULL;
+		}
+
+		if (old && old->num == e)
+		{
+			fits &= SV_WriteDeltaEntity (hist, frame, old, &snap->delta, ent, msg);
+			old = (++oldindex < base->count) ? DELTA_ENT(hist, base->first + oldindex) : NULL;
+		}
+		else
+			fits &= SV_WriteDeltaEntity (hist, frame, NULL, &snap->delta, ent, msg);
+	}
+
+	while (old)
+	{
+		fits &= SV_WriteDeltaRemove (hist, frame, old, msg);
+		old = (++oldindex < base->count) ? DELTA_ENT(hist, base->first + oldindex) : NULL;
+	}
+
+	Delta_EndFrame (hist, frame, sequence);
+
+	return fits;
+}
+
+/*
+=============
+SV_SnapshotBench_f
+
+Times the entity updates of one server frame for a number of simulated
+clients, looking from entities spread over the map, once with the shared
+snapshot and once re-encoding it for every client.
+=============
+*/
+void SV_SnapshotBench_f (void)
+{
+	edict_t		*viewers[MAX_SCOREBOARD];
+	byte		buf[MAX_DATAGRAM];
+	sizebuf_t	msg;
+	vec3_t		org;
+	int			i, f, numviewers, frames, bytes;
+	double		start, shared, perclient;
+
+	if (!sv.active)
+	{
+		Con_Printf ("Not running a server\n");
+		return;
+	}
+
+	if (Cmd_Argc() < 2)
+	{
+		Con_Printf ("usage: sv_snapshotbench <clients> [frames]\n");
+		return;
+	}
+
+	numviewers = CLAMP(1, atoi(Cmd_Argv(1)), MAX_SCOREBOARD);
+	frames = (Cmd_Argc() > 2) ? max(1, atoi(Cmd_Argv(2))) : 100;
+
+	for (i=0 ; i<numviewers ; i++)
+		viewers[i] = EDICT_NUM(1 + (i * (sv.num_edicts - 1)) / numviewers);
+
+	msg.allowoverflow = false;
+	msg.overflowed = false;
+	msg.data = buf;
+	msg.maxsize = sizeof(buf);
+
+	bytes = 0;
+	start = Sys_DoubleTime ();
+	for (f=0 ; f<frames ; f++)
+	{
+		SV_BuildSnapshot ();
+		for (i=0 ; i<numviewers ; i++)
+		{
+			msg.cursize = 0;
+			VectorAdd (viewers[i]->v.origin, viewers[i]->v.view_ofs, org);
+			SV_WriteEntitiesToClient (viewers[i], SV_FatPVS (org, sv.worldmodel), &msg);
+			bytes += msg.cursize;
+		}
+	}
+	shared = Sys_DoubleTime () - start;
+
+	start = Sys_DoubleTime ();
+	for (f=0 ; f<frames ; f++)
+	{
+		for (i=0 ; i<numviewers ; i++)
+		{
+			SV_BuildSnapshot ();
+			msg.cursize = 0;
+			VectorAdd (viewers[i]->v.origin, viewers[i]->v.view_ofs, org);
+			SV_WriteEntitiesToClient (viewers[i], SV_FatPVS (org, sv.worldmodel), &msg);
+		}
+	}
+	perclient = Sys_DoubleTime () - start;
+
+	Con_Printf ("%i clients, %i edicts, %i bytes/client\n", numviewers, sv.num_edicts, bytes / (frames * numviewers));
+	Con_Printf ("shared snapshot: %.3f ms/frame\n", shared * 1000.0 / frames);
+	Con_Printf ("encoded per client: %.3f ms/frame\n", perclient * 1000.0 / frames);
+}
+
+/*
+=============
+SV_EdictBench_f
+
+Times the physics free checks and the entity culling of all clients, once
+reading the edicts and once the packed hot fields.  host_framereport with
+sv_edicthot 0 and 1 shows the same for whole server frames.
+=============
+*/
+void SV_EdictBench_f (void)
+{
+	edict_t		*viewers[MAX_SCOREBOARD];
+	byte		buf[MAX_DATAGRAM];
+	sizebuf_t	msg;
+	vec3_t		org;
+	int			i, e, f, pass, numviewers, frames, count;
+	float		saved;
+	double		start, times[2];
+
+	if (!sv.active)
+	{
+		Con_Printf ("Not running a server\n");
+		return;
+	}
+
+	numviewers = (Cmd_Argc() > 1) ? CLAMP(1, atoi(Cmd_Argv(1)), MAX_SCOREBOARD) : 16;
+	frames = (Cmd_Argc() > 2) ? max(1, atoi(Cmd_Argv(2))) : 100;
+
+	for (i=0 ; i<numviewers ; i++)
+		viewers[i] = EDICT_NUM(1 + (i * (sv.num_edicts - 1)) / numviewers);
+
+	msg.allowoverflow = false;
+	msg.overflowed = false;
+	msg.data = buf;
+	msg.maxsize = sizeof(buf);
+
+	SV_BuildSnapshot ();
+	saved = sv_edicthot.value;
+	count = 0;
+	for (pass=0 ; pass<2 ; pass++)
+	{
+		sv_edicthot.value = pass;
+		start = Sys_DoubleTime ();
+		for (f=0 ; f<frames ; f++)
+		{
+			if (pass)
+			{
+				for (e=0 ; e<sv.num_edicts ; e++)
+					count += sv.edicthot[e].free;
+			}
+			else
+			{
+				for (e=0 ; e<sv.num_edicts ; e++)
+					count += EDICT_NUM(e)->free;
+			}
+
+			for (i=0 ; i<numviewers ; i++)
+			{
+				msg.cursize = 0;
+				VectorAdd (viewers[i]->v.origin, viewers[i]->v.view_ofs, org);
+				SV_WriteEntitiesToClient (viewers[i], SV_FatPVS (org, sv.worldmodel), &msg);
+			}
+		}
+		times[pass] = Sys_DoubleTime () - start;
+	}
+	sv_edicthot.value = saved;
+
+	Con_Printf ("%i clients, %i edicts, %i bytes/edict, %i free\n", numviewers, sv.num_edicts, pr_edict_size, count / (2 * frames));
+	Con_Printf ("edicts:     %.3f ms/frame\n", times[0] * 1000.0 / frames);
+	Con_Printf ("hot fields: %.3f ms/frame\n", times[1] * 1000.0 / frames);
 }
 
 /*
@@ -871,6 +1585,20 @@ SV_WriteClientdataToMessage
 ==================
 */
 void SV_WriteClientdataToMessage (edict_t *ent, sizebuf_t *msg)
+{
+	SV_SetIdealPitch ();		// how much to look up / down ideally
+	SV_WriteClientdata (ent, SV_ModelIndex(PR_GetString(ent->v.weaponmodel)), msg);
+}
+
+/*
+==================
+SV_WriteClientdata
+
+The part of SV_WriteClientdataToMessage that doesn't trace or look up
+precaches, so worker threads can run it.  The only edict it changes is ent.
+==================
+*/
+void SV_WriteClientdata (edict_t *ent, int weaponmodel, sizebuf_t *msg)
 {
 	int		bits;
 	int		i;
@@ -894,11 +1622,6 @@ void SV_WriteClientdataToMessage (edict_t *ent, sizebuf_t *msg)
 		ent->v.dmg_save = 0;
 	}
 
-//
-// send the current viewpos offset from the view entity
-//
-	SV_SetIdealPitch ();		// how much to look up / down ideally
-
 // a fixangle might get lost in a dropped packet.  Oh well.
 	if ( ent->v.fixangle )
 	{
@@ -918,7 +1641,7 @@ void SV_WriteClientdataToMessage (edict_t *ent, sizebuf_t *msg)
 
 // stuff the sigil bits into the high bits of items for sbar, or else
 // mix in items2
-	val = GetEdictFieldValue(ent, "items2");
+	val = GetEdictFieldValue(ent, pr_extfields.items2);
 
 	if (val)
 		items = (int)ent->v.items | ((int)val->_float << 23);
@@ -951,9 +1674,9 @@ void SV_WriteClientdataToMessage (edict_t *ent, sizebuf_t *msg)
 		bits |= SU_WEAPON;
 
 	//johnfitz -- PROTOCOL_FITZQUAKE
-	if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ)
+	if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ || sv.protocol == PROTOCOL_DELTA)
 	{
-		if (bits & SU_WEAPON && SV_ModelIndex(PR_GetString(ent->v.weaponmodel)) & 0xFF00)
+		if (bits & SU_WEAPON && weaponmodel & 0xFF00)
 			bits |= SU_WEAPON2;
 		if ((int)ent->v.armorvalue & 0xFF00)
 			bits |= SU_ARMOR2;
@@ -984,7 +1707,7 @@ void SV_WriteClientdataToMessage (edict_t *ent, sizebuf_t *msg)
 	MSG_WriteShort (msg, bits);
 
 	//johnfitz -- PROTOCOL_FITZQUAKE
-	if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ)
+	if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ || sv.protocol == PROTOCOL_DELTA)
 	{
 		if (bits & SU_EXTEND1)
 			MSG_WriteByte(msg, bits>>16);
@@ -1015,7 +1738,7 @@ void SV_WriteClientdataToMessage (edict_t *ent, sizebuf_t *msg)
 	if (bits & SU_ARMOR)
 		MSG_WriteByte (msg, ent->v.armorvalue);
 	if (bits & SU_WEAPON)
-		MSG_WriteByte (msg, SV_ModelIndex(PR_GetString(ent->v.weaponmodel)));
+		MSG_WriteByte (msg, weaponmodel);
 	
 	MSG_WriteShort (msg, ent->v.health);
 	MSG_WriteByte (msg, ent->v.currentammo);
@@ -1041,10 +1764,10 @@ void SV_WriteClientdataToMessage (edict_t *ent, sizebuf_t *msg)
 	}
 
 	//johnfitz -- PROTOCOL_FITZQUAKE
-	if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ)
+	if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ || sv.protocol == PROTOCOL_DELTA)
 	{
 		if (bits & SU_WEAPON2)
-			MSG_WriteByte (msg, SV_ModelIndex(PR_GetString(ent->v.weaponmodel)) >> 8);
+			MSG_WriteByte (msg, weaponmodel >> 8);
 		if (bits & SU_ARMOR2)
 			MSG_WriteByte (msg, (int)ent->v.armorvalue >> 8);
 		if (bits & SU_AMMO2)
@@ -1065,6 +1788,136 @@ void SV_WriteClientdataToMessage (edict_t *ent, sizebuf_t *msg)
 	//johnfitz
 }
 
+/*
+=============================================================================
+
+CLIENT DATAGRAMS
+
+The per client part of the datagrams is built for all clients before any
+of them is sent, spread over sv_threads worker threads.  Everything that
+traces, runs QuakeC, prints or can error out is done in the main thread
+before and after, so the datagrams don't depend on the thread count.
+
+=============================================================================
+*/
+
+typedef struct
+{
+	qboolean	build;			// active and spawned
+	int			weaponmodel;	// precache index, looked up in the main thread
+	qboolean	overflowed;		// ran out of room for entities
+	sizebuf_t	msg;
+	fatpvs_t	fatpvs;
+	deltahistory_t	*delta;		// PROTOCOL_DELTA snapshots sent, allocated on first use
+	byte		buf[MAX_DATAGRAM];
+} svdatagram_t;
+
+static svdatagram_t	sv_datagrams[MAX_SCOREBOARD];
+
+/*
+=======================
+SV_PrepareClientDatagrams
+
+Main thread setup for SV_BuildClientDatagram
+=======================
+*/
+void SV_PrepareClientDatagrams (void)
+{
+	int			i;
+	client_t	*client;
+	svdatagram_t	*dg;
+
+	for (i=0, client = svs.clients, dg = sv_datagrams ; i<svs.maxclients ; i++, client++, dg++)
+	{
+		dg->build = client->active && client->spawned;
+		if (!dg->build)
+			continue;
+
+		SV_SetIdealPitch ();		// how much to look up / down ideally
+		dg->weaponmodel = SV_ModelIndex(PR_GetString(client->edict->v.weaponmodel));
+		SV_AllocFatPVS (&dg->fatpvs, sv.worldmodel);
+
+		if (sv.protocol == PROTOCOL_DELTA && !dg->delta)
+		{
+			dg->delta = (deltahistory_t *) calloc (1, sizeof(deltahistory_t));
+			if (!dg->delta)
+				Host_Error ("SV_PrepareClientDatagrams: calloc() failed on %d bytes", (int)sizeof(deltahistory_t));
+		}
+	}
+}
+
+/*
+=======================
+SV_ClearClientDelta
+
+The client starts over from the spawn baselines, on connect and level change
+=======================
+*/
+void SV_ClearClientDelta (client_t *client)
+{
+	svdatagram_t	*dg;
+
+	dg = sv_datagrams + (client - svs.clients);
+	if (dg->delta)
+		Delta_Clear (dg->delta);
+	client->delta_acked = 0;
+}
+
+/*
+=======================
+SV_ClearFatPVS
+
+The remembered leafs go stale when the hunk is cleared
+=======================
+*/
+void SV_ClearFatPVS (void)
+{
+	int		i;
+
+	sv_fatpvs.numleafs = -1;
+	for (i=0 ; i<MAX_SCOREBOARD ; i++)
+		sv_datagrams[i].fatpvs.numleafs = -1;
+}
+
+/*
+=======================
+SV_BuildClientDatagram
+
+Called from the worker threads with a client number
+=======================
+*/
+void SV_BuildClientDatagram (int clientnum)
+{
+	client_t	*client;
+	svdatagram_t	*dg;
+	vec3_t		org;
+	byte		*pvs;
+
+	client = svs.clients + clientnum;
+	dg = sv_datagrams + clientnum;
+	if (!dg->build)
+		return;
+
+	dg->msg.data = dg->buf;
+	dg->msg.maxsize = client->netconnection->mtu;
+	dg->msg.cursize = 0;
+	dg->msg.allowoverflow = false;
+	dg->msg.overflowed = false;
+
+	MSG_WriteByte (&dg->msg, svc_time);
+	MSG_WriteFloat (&dg->msg, sv.time);
+
+// add the client specific data to the datagram
+	SV_WriteClientdata (client->edict, dg->weaponmodel, &dg->msg);
+
+	VectorAdd (client->edict->v.origin, client->edict->v.view_ofs, org);
+	pvs = SV_CalcFatPVS (&dg->fatpvs, org, sv.worldmodel);
+	if (sv.protocol == PROTOCOL_DELTA)
+		dg->overflowed = !SV_WriteDeltaEntities (client, dg->delta, pvs, &dg->msg);
+	else
+		dg->overflowed = !SV_WriteEntitiesToClient (client->edict, pvs, &dg->msg);
+}
+
 /*
 =======================
 SV_SendClientDatagram
@@ -1072,33 +1925,37 @@ SV_SendClientDatagram
 */
 qboolean SV_SendClientDatagram (client_t *client)
 {
-	byte		buf[MAX_DATAGRAM];
-	sizebuf_t	msg;
+	svdatagram_t	*dg;
 	static float lastmsg = 0;
+	static float lastoverflow = 0;
+	static float lastdropped = 0;
 
-	msg.data = buf;
-	msg.maxsize = client->netconnection->mtu;
-	msg.cursize = 0;
+	dg = sv_datagrams + (client - svs.clients);
 
-	MSG_WriteByte (&msg, svc_time);
-	MSG_WriteFloat (&msg, sv.time);
+	if (dg->overflowed)
+	{
+		if (IsTimeout (&lastoverflow, 2))
+			Con_Printf ("packet overflow\n");
+	}
 
-// add the client specific data to the datagram
-	SV_WriteClientdataToMessage (client->edict, &msg);
-	SV_WriteEntitiesToClient (client->edict, &msg);
+	if (sv.protocol == PROTOCOL_DELTA && dg->delta && dg->delta->dropped)
+	{
+		if (IsTimeout (&lastdropped, 2))
+			Con_DWarning ("SV_SendClientDatagram: %d entities past the snapshot limit of %d not sent\n", dg->delta->dropped, DELTA_MAXENTS);
+	}
 
-	if (msg.cursize > 1024) // old limit warning
+	if (dg->msg.cursize > 1024) // old limit warning
 	{
 		if (IsTimeout (&lastmsg, 10))
-			Con_DWarning ("SV_SendClientDatagram: byte packet exceeds standard limit (%d, normal max = %d)\n", msg.cursize, 1024);
+			Con_DWarning ("SV_SendClientDatagram: byte packet exceeds standard limit (%d, normal max = %d)\n", dg->msg.cursize, 1024);
 	}
 
 // copy the server datagram if there is space
-	if (msg.cursize + sv.datagram.cursize < msg.maxsize)
-		SZ_Write (&msg, sv.datagram.data, sv.datagram.cursize);
+	if (dg->msg.cursize + sv.datagram.cursize < dg->msg.maxsize)
+		SZ_Write (&dg->msg, sv.datagram.data, sv.datagram.cursize);
 
 // send the datagram
-	if (NET_SendUnreliableMessage (client->netconnection, &msg) == -1)
+	if (NET_SendUnreliableMessage (client->netconnection, &dg->msg) == -1)
 	{
 		SV_DropClient (true); // if the message couldn't send, kick off
 		return false;
@@ -1182,7 +2039,14 @@ void SV_SendClientMessages (void)
 // update frags, names, etc
 	SV_UpdateToReliableMessages ();
 
+// encode the entity updates shared by all clients
+	SV_BuildSnapshot ();
+
 // build individual updates
+	SV_PrepareClientDatagrams ();
+	Sys_RunJobs (SV_BuildClientDatagram, svs.maxclients);
+
+// and send them in client order
 	for (i=0, host_client = svs.clients ; i<svs.maxclients ; i++, host_client++)
 	{
 		if (!host_client->active)
@@ -1322,10 +2186,10 @@ void SV_CreateBaseline (void)
 			svent->baseline.alpha = svent->alpha; //johnfitz -- alpha support
 //			svent->baseline.scale = svent->scale;
 			svent->baseline.scale = ENTSCALE_DEFAULT;
-			if (sv.protocol == PROTOCOL_RMQ)
+			if (sv.protocol == PROTOCOL_RMQ || sv.protocol == PROTOCOL_DELTA)
 			{
 				eval_t* val;
-				val = GetEdictFieldValue(svent, "scale");
+				val = GetEdictFieldValue(svent, pr_extfields.scale);
 				if (val)
 					svent->baseline.scale = ENTSCALE_ENCODE(val->_float);
 			}
@@ -1333,7 +2197,7 @@ void SV_CreateBaseline (void)
 
 		//johnfitz -- PROTOCOL_FITZQUAKE
 		bits = 0;
-		if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ) //decide which extra data needs to be sent
+		if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ || sv.protocol == PROTOCOL_DELTA) //decide which extra data needs to be sent
 		{
 			if (svent->baseline.modelindex & 0xFF00)
 				bits |= B_LARGEMODEL;
@@ -1359,7 +2223,7 @@ void SV_CreateBaseline (void)
 	// add to the message
 	//
 		//johnfitz -- PROTOCOL_FITZQUAKE
-		if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ)
+		if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ || sv.protocol == PROTOCOL_DELTA)
 		{
 			if (bits)
 				MSG_WriteByte (&sv.signon, svc_spawnbaseline2);
@@ -1375,7 +2239,7 @@ void SV_CreateBaseline (void)
 		MSG_WriteShort (&sv.signon,entnum);
 
 		//johnfitz -- PROTOCOL_FITZQUAKE
-		if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ)
+		if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ || sv.protocol == PROTOCOL_DELTA)
 		{
 			if (bits)
 				MSG_WriteByte (&sv.signon, bits);
@@ -1407,7 +2271,7 @@ void SV_CreateBaseline (void)
 		}
 
 		//johnfitz -- PROTOCOL_FITZQUAKE
-		if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ)
+		if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ || sv.protocol == PROTOCOL_DELTA)
 		{
 			if (bits & B_ALPHA)
 				MSG_WriteByte (&sv.signon, svent->baseline.alpha);
@@ -1541,7 +2405,7 @@ void SV_SpawnServer (char *server)
 
 	sv.protocol = sv_protocol;
 
-	if (sv.protocol == PROTOCOL_RMQ)
+	if (sv.protocol == PROTOCOL_RMQ || sv.protocol == PROTOCOL_DELTA)
 	{
 		// set up the protocol flags used by this server
 		// (note - these could be cvar-ised so that server admins could choose the protocol features used by their servers)
@@ -1556,6 +2420,7 @@ void SV_SpawnServer (char *server)
 // allocate server memory
 	sv.max_edicts = MAX_EDICTS;
 	sv.edicts = Hunk_AllocName (sv.max_edicts*pr_edict_size, "edicts");
+	sv.edicthot = Hunk_AllocName (sv.max_edicts*sizeof(edicthot_t), "edicthot");
 
 	sv.datagram.maxsize = sizeof(sv.datagram_buf);
 	sv.datagram.cursize = 0;
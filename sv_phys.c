@@ -48,6 +48,8 @@ cvar_t	sv_nostep = {"sv_nostep","0", CVAR_NONE};
 
 cvar_t	sv_bouncedownslopes = {"sv_bouncedownslopes","0", CVAR_SERVER};
 
+cvar_t	sv_parallelphysics = {"sv_parallelphysics","0", CVAR_NONE};
+
 #define	MOVE_EPSILON	0.01
 
 void SV_Physics_Toss (edict_t *ent);
@@ -381,7 +383,7 @@ void SV_AddGravity (edict_t *ent)
 	float	ent_gravity;
 	eval_t	*val;
 
-	val = GetEdictFieldValue(ent, "gravity");
+	val = GetEdictFieldValue(ent, pr_extfields.gravity);
 	if (val && val->_float)
 		ent_gravity = val->_float;
 	else
@@ -401,31 +403,59 @@ PUSHMOVE
 
 /*
 ============
-SV_PushEntity
+SV_PushEntityMove
 
-Does not change the entities velocity at all
+Fills in the move SV_PushEntity does
 ============
 */
-trace_t SV_PushEntity (edict_t *ent, vec3_t push)
+static void SV_PushEntityMove (edict_t *ent, vec3_t push, movequery_t *move)
 {
-	trace_t	trace;
-	vec3_t	end;
-		
-	VectorAdd (ent->v.origin, push, end);
+	VectorCopy (ent->v.origin, move->start);
+	VectorCopy (ent->v.mins, move->mins);
+	VectorCopy (ent->v.maxs, move->maxs);
+	VectorAdd (ent->v.origin, push, move->end);
+	move->passedict = ent;
 
 	if (ent->v.movetype == MOVETYPE_FLYMISSILE)
-		trace = SV_Move (ent->v.origin, ent->v.mins, ent->v.maxs, end, MOVE_MISSILE, ent);
+		move->type = MOVE_MISSILE;
 	else if (ent->v.solid == SOLID_TRIGGER || ent->v.solid == SOLID_NOT)
 	// only clip against bmodels
-		trace = SV_Move (ent->v.origin, ent->v.mins, ent->v.maxs, end, MOVE_NOMONSTERS, ent);
+		move->type = MOVE_NOMONSTERS;
 	else
-		trace = SV_Move (ent->v.origin, ent->v.mins, ent->v.maxs, end, MOVE_NORMAL, ent);	
-	
-	VectorCopy (trace.endpos, ent->v.origin);
+		move->type = MOVE_NORMAL;
+}
+
+/*
+============
+SV_FinishPush
+
+Puts ent at the end of the trace and runs the touch functions
+============
+*/
+static void SV_FinishPush (edict_t *ent, trace_t *trace)
+{
+	VectorCopy (trace->endpos, ent->v.origin);
 	SV_LinkEdict (ent, true);
 
-	if (trace.ent)
-		SV_Impact (ent, trace.ent);		
+	if (trace->ent)
+		SV_Impact (ent, trace->ent);		
+}
+
+/*
+============
+SV_PushEntity
+
+Does not change the entities velocity at all
+============
+*/
+trace_t SV_PushEntity (edict_t *ent, vec3_t push)
+{
+	trace_t	trace;
+	movequery_t	move;
+
+	SV_PushEntityMove (ent, push, &move);
+	trace = SV_Move (move.start, move.mins, move.maxs, move.end, move.type, ent);
+	SV_FinishPush (ent, &trace);
 
 	return trace;
 }					
@@ -1254,24 +1284,21 @@ void SV_CheckWaterTransition (edict_t *ent)
 
 /*
 =============
-SV_Physics_Toss
+SV_StartToss
 
-Toss, bounce, and fly movement.  When onground, do nothing.
+The part of SV_Physics_Toss before the move.  Returns false if the entity
+doesn't move this frame.
 =============
 */
-void SV_Physics_Toss (edict_t *ent)
+static qboolean SV_StartToss (edict_t *ent, vec3_t move)
 {
-	trace_t	trace;
-	vec3_t	move;
-	float	backoff;
-
 	// regular thinking
 	if (!SV_RunThink (ent))
-		return;
+		return false;
 
 // if onground, return without moving
 	if ( ((int)ent->v.flags & FL_ONGROUND) )
-		return;
+		return false;
 
 	SV_CheckVelocity (ent);
 
@@ -1283,10 +1310,22 @@ void SV_Physics_Toss (edict_t *ent)
 // move angles
 	VectorMA (ent->v.angles, host_frametime, ent->v.avelocity, ent->v.angles);
 
-// move origin
 	VectorScale (ent->v.velocity, host_frametime, move);
-	trace = SV_PushEntity (ent, move);
-	if (trace.fraction == 1)
+	return true;
+}
+
+/*
+=============
+SV_FinishToss
+
+The part of SV_Physics_Toss after the move
+=============
+*/
+static void SV_FinishToss (edict_t *ent, trace_t *trace)
+{
+	float	backoff;
+
+	if (trace->fraction == 1)
 		return;
 	if (ent->free)
 		return;
@@ -1296,15 +1335,15 @@ void SV_Physics_Toss (edict_t *ent)
 	else
 		backoff = 1;
 
-	ClipVelocity (ent->v.velocity, trace.plane.normal, ent->v.velocity, backoff);
+	ClipVelocity (ent->v.velocity, trace->plane.normal, ent->v.velocity, backoff);
 
 // stop if on ground
-	if (trace.plane.normal[2] > 0.7)
+	if (trace->plane.normal[2] > 0.7)
 	{
 		int stop_moving = false;
 		if (sv_bouncedownslopes.value)
 		{
-			if (DotProduct(trace.plane.normal, ent->v.velocity) < 60)
+			if (DotProduct(trace->plane.normal, ent->v.velocity) < 60)
 				stop_moving = true;
 		}
 		else
@@ -1316,7 +1355,7 @@ void SV_Physics_Toss (edict_t *ent)
 		if (stop_moving)
 		{
 			ent->v.flags = (int)ent->v.flags | FL_ONGROUND;
-			ent->v.groundentity = EDICT_TO_PROG(trace.ent);
+			ent->v.groundentity = EDICT_TO_PROG(trace->ent);
 			VectorClear (ent->v.velocity);
 			VectorClear (ent->v.avelocity);
 		}
@@ -1329,6 +1368,317 @@ void SV_Physics_Toss (edict_t *ent)
 /*
 ===============================================================================
 
+PARALLEL TOSS MOVES
+
+With sv_parallelphysics, the moves of the toss entities are guessed at the
+start of the frame and traced at once on the worker threads, against the
+world as it is then.  The entities still run one at a time in edict order,
+just like without it.  When an entity gets to its move, the guessed trace is
+only used if the move is the one that was guessed and nothing the trace
+could have hit has been linked, unlinked or changed since; otherwise it is
+traced again.  Thinks, touches and results are the same as in the serial
+path, for any number of threads.
+
+===============================================================================
+*/
+
+// what SV_Move looks at in an edict it clips against
+typedef struct
+{
+	float	solid, movetype, modelindex, flags;
+	int		owner;
+	vec3_t	origin, angles, mins, maxs, size, absmin, absmax;
+} tossclip_t;
+
+#define	MAX_TOSS_CHECK	256		// edicts near a guessed move, more is a miss
+
+static movequery_t	*sv_tossmoves;
+static trace_t		*sv_tosstraces;
+static qboolean		*sv_tossfailed;
+static int			sv_numtosses, sv_maxtosses;
+
+static tossclip_t	*sv_tossclips;		// every edict at the time of the guess
+static int			*sv_tossindex;		// guessed move of every edict, -1 for none
+static int			sv_numtossedicts, sv_maxtossedicts;
+
+/*
+=============
+SV_TossClip
+=============
+*/
+static void SV_TossClip (edict_t *ent, tossclip_t *clip)
+{
+	clip->solid = ent->v.solid;
+	clip->movetype = ent->v.movetype;
+	clip->modelindex = ent->v.modelindex;
+	clip->flags = ent->v.flags;
+	clip->owner = ent->v.owner;
+	VectorCopy (ent->v.origin, clip->origin);
+	VectorCopy (ent->v.angles, clip->angles);
+	VectorCopy (ent->v.mins, clip->mins);
+	VectorCopy (ent->v.maxs, clip->maxs);
+	VectorCopy (ent->v.size, clip->size);
+	VectorCopy (ent->v.absmin, clip->absmin);
+	VectorCopy (ent->v.absmax, clip->absmax);
+}
+
+/*
+=============
+SV_GuessToss
+
+The move SV_StartToss will come up with if nothing touches ent before its
+turn.  Returns false for entities that don't move or will think first.
+=============
+*/
+static qboolean SV_GuessToss (edict_t *ent, vec3_t push)
+{
+	int		i;
+	float	ent_gravity;
+	vec3_t	velocity;
+	eval_t	*val;
+
+	if (ent->v.nextthink > 0 && ent->v.nextthink <= sv.time + host_frametime)
+		return false;
+	if ((int)ent->v.flags & FL_ONGROUND)
+		return false;
+
+	// SV_CheckVelocity
+	for (i=0 ; i<3 ; i++)
+	{
+		if (IS_NAN(ent->v.velocity[i]) || IS_NAN(ent->v.origin[i]))
+			return false;
+		velocity[i] = ent->v.velocity[i];
+		if (velocity[i] > sv_maxvelocity.value)
+			velocity[i] = sv_maxvelocity.value;
+		else if (velocity[i] < -sv_maxvelocity.value)
+			velocity[i] = -sv_maxvelocity.value;
+	}
+
+	// SV_AddGravity
+	if (ent->v.movetype != MOVETYPE_FLY && ent->v.movetype != MOVETYPE_FLYMISSILE)
+	{
+		val = GetEdictFieldValue(ent, pr_extfields.gravity);
+		if (val && val->_float)
+			ent_gravity = val->_float;
+		else
+			ent_gravity = 1.0;
+		velocity[2] -= ent_gravity * sv_gravity.value * host_frametime;
+	}
+
+	VectorScale (velocity, host_frametime, push);
+	return true;
+}
+
+/*
+=============
+SV_GuessTosses
+
+Traces the guessed moves of all toss entities on the worker threads
+=============
+*/
+static void SV_GuessTosses (int entity_cap)
+{
+	int		i;
+	edict_t	*ent;
+	vec3_t	push;
+	double	start;
+
+	start = Host_FrameStatStart ();
+
+	if (sv.num_edicts > sv_maxtossedicts)
+	{
+		sv_maxtossedicts = sv.max_edicts;
+		sv_tossclips = (tossclip_t *) realloc (sv_tossclips, sv_maxtossedicts * sizeof(*sv_tossclips));
+		sv_tossindex = (int *) realloc (sv_tossindex, sv_maxtossedicts * sizeof(*sv_tossindex));
+		if (!sv_tossclips || !sv_tossindex)
+			Host_Error ("SV_GuessTosses: realloc() failed on %d edicts", sv_maxtossedicts);
+	}
+	sv_numtossedicts = sv.num_edicts;
+
+	for (i=0, ent = sv.edicts ; i<sv.num_edicts ; i++, ent = NEXT_EDICT(ent))
+	{
+		SV_TossClip (ent, &sv_tossclips[i]);
+		sv_tossindex[i] = -1;
+
+		if (i <= svs.maxclients || i >= entity_cap || ent->free)
+			continue;
+		if (ent->v.movetype != MOVETYPE_TOSS && ent->v.movetype != MOVETYPE_BOUNCE
+		&& ent->v.movetype != MOVETYPE_FLY && ent->v.movetype != MOVETYPE_FLYMISSILE)
+			continue;
+		if (!SV_GuessToss (ent, push))
+			continue;
+
+		if (sv_numtosses == sv_maxtosses)
+		{
+			sv_maxtosses = sv_maxtosses ? sv_maxtosses * 2 : 256;
+			sv_tossmoves = (movequery_t *) realloc (sv_tossmoves, sv_maxtosses * sizeof(*sv_tossmoves));
+			sv_tosstraces = (trace_t *) realloc (sv_tosstraces, sv_maxtosses * sizeof(*sv_tosstraces));
+			sv_tossfailed = (qboolean *) realloc (sv_tossfailed, sv_maxtosses * sizeof(*sv_tossfailed));
+			if (!sv_tossmoves || !sv_tosstraces || !sv_tossfailed)
+				Host_Error ("SV_GuessTosses: realloc() failed on %d moves", sv_maxtosses);
+		}
+
+		sv_tossindex[i] = sv_numtosses;
+		SV_PushEntityMove (ent, push, &sv_tossmoves[sv_numtosses]);
+		sv_numtosses++;
+	}
+
+	if (sv_numtosses)
+		SV_MoveParallel (sv_tossmoves, sv_numtosses, sv_tosstraces, sv_tossfailed);
+
+	// from here on, whatever moves is checked against the guesses
+	SV_WatchLinks (true);
+
+	Host_FrameStatStop (FS_PHYS_TOSS, start);
+}
+
+/*
+=============
+SV_ClearTosses
+=============
+*/
+static void SV_ClearTosses (void)
+{
+	sv_numtosses = 0;
+	sv_numtossedicts = 0;
+	SV_WatchLinks (false);
+}
+
+/*
+=============
+SV_SameMove
+=============
+*/
+static qboolean SV_SameMove (movequery_t *a, movequery_t *b)
+{
+	return VectorCompare (a->start, b->start) && VectorCompare (a->end, b->end)
+		&& VectorCompare (a->mins, b->mins) && VectorCompare (a->maxs, b->maxs)
+		&& a->type == b->type && a->passedict == b->passedict;
+}
+
+/*
+=============
+SV_BoxesTouch
+=============
+*/
+static qboolean SV_BoxesTouch (vec3_t mins1, vec3_t maxs1, vec3_t mins2, vec3_t maxs2)
+{
+	return !(mins1[0] > maxs2[0] || mins1[1] > maxs2[1] || mins1[2] > maxs2[2]
+		|| maxs1[0] < mins2[0] || maxs1[1] < mins2[1] || maxs1[2] < mins2[2]);
+}
+
+/*
+=============
+SV_TossWorldChanged
+
+True if anything the guessed trace of move could have hit is not where
+or what it was when the trace was made
+=============
+*/
+static qboolean SV_TossWorldChanged (movequery_t *move)
+{
+	int			i, num, count;
+	vec3_t		mins, maxs, boxmins, boxmaxs;
+	edict_t		*touch, **unlinked;
+	edict_t		*list[MAX_TOSS_CHECK];
+	tossclip_t	*clip, now;
+
+// the mover's own fields that SV_ClipToLinks looks at
+	clip = &sv_tossclips[NUM_FOR_EDICT(move->passedict)];
+	if (clip->owner != move->passedict->v.owner || clip->size[0] != move->passedict->v.size[0])
+		return true;
+
+// the same box SV_StartMove clips in
+	for (i=0 ; i<3 ; i++)
+	{
+		mins[i] = (move->type == MOVE_MISSILE) ? -15 : move->mins[i];
+		maxs[i] = (move->type == MOVE_MISSILE) ? 15 : move->maxs[i];
+	}
+	SV_MoveBounds (move->start, mins, maxs, move->end, boxmins, boxmaxs);
+
+// edicts that were in the box and left it
+	count = SV_UnlinkedEdicts (&unlinked);
+	for (i=0 ; i<count ; i++)
+	{
+		num = NUM_FOR_EDICT(unlinked[i]);
+		if (unlinked[i] == move->passedict || num >= sv_numtossedicts)
+			continue;
+		clip = &sv_tossclips[num];
+		if (SV_BoxesTouch (boxmins, boxmaxs, clip->absmin, clip->absmax))
+			return true;
+	}
+
+// edicts in the box now, which have to be untouched since
+	count = SV_AreaEdicts (boxmins, boxmaxs, list, MAX_TOSS_CHECK);
+	if (count == MAX_TOSS_CHECK)
+		return true;
+	for (i=0 ; i<count ; i++)
+	{
+		touch = list[i];
+		if (touch == move->passedict)
+			continue;
+		if (touch->linkstamp == sv_linkstamp)
+			return true;
+		num = NUM_FOR_EDICT(touch);
+		if (num >= sv_numtossedicts)
+			return true;
+		SV_TossClip (touch, &now);
+		if (memcmp (&now, &sv_tossclips[num], sizeof(now)))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+=============
+SV_TossMove
+
+SV_Move for the move of a toss entity, using the guessed trace if it still
+holds
+=============
+*/
+static trace_t SV_TossMove (edict_t *ent, movequery_t *move)
+{
+	int		i, num;
+
+	if (sv_numtosses)
+	{
+		num = NUM_FOR_EDICT(ent);
+		i = (num < sv_numtossedicts) ? sv_tossindex[num] : -1;
+		if (i >= 0 && !sv_tossfailed[i] && SV_SameMove (move, &sv_tossmoves[i]) && !SV_TossWorldChanged (move))
+			return sv_tosstraces[i];
+	}
+
+	return SV_Move (move->start, move->mins, move->maxs, move->end, move->type, ent);
+}
+
+/*
+=============
+SV_Physics_Toss
+
+Toss, bounce, and fly movement.  When onground, do nothing.
+=============
+*/
+void SV_Physics_Toss (edict_t *ent)
+{
+	trace_t	trace;
+	vec3_t	push;
+	movequery_t	move;
+
+	if (!SV_StartToss (ent, push))
+		return;
+
+// move origin
+	SV_PushEntityMove (ent, push, &move);
+	trace = SV_TossMove (ent, &move);
+	SV_FinishPush (ent, &trace);
+	SV_FinishToss (ent, &trace);
+}
+
+/*
+===============================================================================
+
 STEPPING MOVEMENT
 
 ===============================================================================
@@ -1377,6 +1727,30 @@ void SV_Physics_Step (edict_t *ent)
 
 //============================================================================
 
+/*
+================
+SV_PhysicsStat
+
+Which part of the physics an entity's time goes to in the frame stats
+================
+*/
+static framestat_t SV_PhysicsStat (edict_t *ent, int num)
+{
+	if (num > 0 && num <= svs.maxclients)
+		return FS_PHYS_CLIENT;
+
+	switch ((int)ent->v.movetype)
+	{
+	case MOVETYPE_PUSH:		return FS_PHYS_PUSH;
+	case MOVETYPE_NONE:		return FS_PHYS_NONE;
+	case MOVETYPE_FOLLOW:	return FS_PHYS_FOLLOW;
+	case MOVETYPE_NOCLIP:	return FS_PHYS_NOCLIP;
+	case MOVETYPE_STEP:		return FS_PHYS_STEP;
+	case MOVETYPE_WALK:		return FS_PHYS_WALK;
+	default:				return FS_PHYS_TOSS;
+	}
+}
+
 /*
 ================
 SV_Physics
@@ -1388,6 +1762,11 @@ void SV_Physics (void)
 	int	i;
 	int		entity_cap; // For sv.frozen (sv_freezenonclients)
 	edict_t	*ent;
+	double	start;
+	framestat_t	stat = FS_PHYS_TOSS;
+
+// a Host_Error in the last frame may have left guesses behind
+	SV_ClearTosses ();
 
 // let the progs know that a new frame has started
 	pr_global_struct->self = EDICT_TO_PROG(sv.edicts);
@@ -1407,10 +1786,13 @@ void SV_Physics (void)
 	else
 		entity_cap = sv.num_edicts;
 
+	if (sv_parallelphysics.value && !pr_global_struct->force_retouch)
+		SV_GuessTosses (entity_cap);
+
 //	for (i=0 ; i<sv.num_edicts ; i++, ent = NEXT_EDICT(ent))
 	for (i=0 ; i<entity_cap ; i++, ent = NEXT_EDICT(ent))
 	{
-		if (ent->free)
+		if (sv.edicthot[i].free)
 			continue;
 
 		if (pr_global_struct->force_retouch)
@@ -1418,6 +1800,9 @@ void SV_Physics (void)
 			SV_LinkEdict (ent, true);	// force retouch even for stationary
 		}
 
+		if ((start = Host_FrameStatStart ()))
+			stat = SV_PhysicsStat (ent, i);
+
 		if (i > 0 && i <= svs.maxclients)
 			SV_Physics_Client (ent, i);
 		else if (ent->v.movetype == MOVETYPE_PUSH)
@@ -1433,7 +1818,10 @@ void SV_Physics (void)
 		else if (ent->v.movetype == MOVETYPE_WALK) // Nehahra
 		{
 			if (!SV_RunThink (ent))
+			{
+				SV_ClearTosses ();
 				return;
+			}
 			if (!SV_CheckWater (ent) && ! ((int)ent->v.flags & FL_WATERJUMP) )
 				SV_AddGravity (ent);
 			SV_CheckStuck (ent);
@@ -1447,6 +1835,9 @@ void SV_Physics (void)
 		else
 			Host_Error ("SV_Physics: bad movetype %i", (int)ent->v.movetype);
 
+		if (start)
+			Host_FrameStatStop (stat, start);
+
 	//johnfitz -- PROTOCOL_FITZQUAKE
 	//capture interval to nextthink here and send it to client for better
 	//lerp timing, but only if interval is not 0.1 (which client assumes)
@@ -1459,6 +1850,8 @@ void SV_Physics (void)
 		}
 	//johnfitz
 	}
+
+	SV_ClearTosses ();
 	
 	if (pr_global_struct->force_retouch)
 		pr_global_struct->force_retouch--;	
@@ -57,8 +57,8 @@ SV_SetIdealPitch
 void SV_SetIdealPitch (void)
 {
 	float	angleval, sinval, cosval;
-	trace_t	tr;
-	vec3_t	top, bottom;
+	movequery_t	moves[MAX_FORWARD];
+	trace_t	traces[MAX_FORWARD];
 	float	z[MAX_FORWARD];
 	int		i, j;
 	int		step, dir, steps;
@@ -72,22 +72,31 @@ void SV_SetIdealPitch (void)
 
 	for (i=0 ; i<MAX_FORWARD ; i++)
 	{
-		top[0] = sv_player->v.origin[0] + cosval*(i+3)*12;
-		top[1] = sv_player->v.origin[1] + sinval*(i+3)*12;
-		top[2] = sv_player->v.origin[2] + sv_player->v.view_ofs[2];
+		moves[i].start[0] = sv_player->v.origin[0] + cosval*(i+3)*12;
+		moves[i].start[1] = sv_player->v.origin[1] + sinval*(i+3)*12;
+		moves[i].start[2] = sv_player->v.origin[2] + sv_player->v.view_ofs[2];
 		
-		bottom[0] = top[0];
-		bottom[1] = top[1];
-		bottom[2] = top[2] - 160;
-		
-		tr = SV_Move (top, vec3_origin, vec3_origin, bottom, 1, sv_player);
-		if (tr.allsolid)
+		moves[i].end[0] = moves[i].start[0];
+		moves[i].end[1] = moves[i].start[1];
+		moves[i].end[2] = moves[i].start[2] - 160;
+
+		VectorClear (moves[i].mins);
+		VectorClear (moves[i].maxs);
+		moves[i].type = MOVE_NOMONSTERS;
+		moves[i].passedict = sv_player;
+	}
+
+	SV_MoveBatch (moves, MAX_FORWARD, traces);
+
+	for (i=0 ; i<MAX_FORWARD ; i++)
+	{
+		if (traces[i].allsolid)
 			return;	// looking at a wall, leave ideal the way is was
 
-		if (tr.fraction == 1)
+		if (traces[i].fraction == 1)
 			return;	// near a dropoff
 		
-		z[i] = top[2] + tr.fraction*(bottom[2]-top[2]);
+		z[i] = moves[i].start[2] + traces[i].fraction*(moves[i].end[2]-moves[i].start[2]);
 	}
 	
 	dir = 0;
@@ -454,7 +463,7 @@ void SV_ReadClientMove (usercmd_t *move)
 		for (i=0 ; i<3 ; i++)
 			angle[i] = MSG_ReadPreciseAngle (net_message);
 	}
-	else if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ) //johnfitz -- 16-bit angles for PROTOCOL_FITZQUAKE
+	else if (sv.protocol == PROTOCOL_FITZQUAKE || sv.protocol == PROTOCOL_MARKV || sv.protocol == PROTOCOL_RMQ || sv.protocol == PROTOCOL_DELTA) //johnfitz -- 16-bit angles for PROTOCOL_FITZQUAKE
 	{
 		for (i=0 ; i<3 ; i++)
 			angle[i] = MSG_ReadAngle16 (net_message, sv.protocolflags);
@@ -480,6 +489,10 @@ void SV_ReadClientMove (usercmd_t *move)
 	i = MSG_ReadByte (net_message);
 	if (i)
 		host_client->edict->v.impulse = i;
+
+// read the last entity snapshot the client got
+	if (sv.protocol == PROTOCOL_DELTA)
+		host_client->delta_acked = MSG_ReadLong (net_message);
 }
 
 /*
@@ -26,6 +26,24 @@ void Sys_mkdir (char *path);
 void Sys_ScanDirList (char *path, filelist_t **list);
 void Sys_ScanDirFileList(char *path, char *subdir, char *ext, qboolean stripext, filelist_t **list);
 
+void *Sys_MapFile (char *path, int offset, int length);
+// maps length bytes at offset of the file copy-on-write,
+// returns NULL if the system can't map it
+void Sys_UnmapFile (void *data, int offset, int length);
+
+//
+// worker threads
+//
+#define	MAX_WORKER_THREADS	32
+
+void Sys_SetWorkerThreads (int count);
+// starts or stops worker threads until count of them are running
+
+void Sys_RunJobs (void (*func) (int job), int numjobs);
+// calls func once for every job in [0, numjobs), spread over the worker
+// threads and the calling thread, and returns when all of them are done.
+// func must not print, error out or call into QuakeC
+
 //
 // system IO
 //
@@ -21,6 +21,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 #include "unixquake.h"
+#include "net_udp.h"
 #include "xquake.h"
 
 static qboolean nostdout = false;
@@ -117,6 +118,181 @@ void Sys_EditFile(char *filename)
 	}
 }
 
+/*
+================
+Sys_MapFile
+
+private mapping, so loaders may swap data in place
+without touching the file or other views of it
+================
+*/
+void *Sys_MapFile (char *path, int offset, int length)
+{
+	int		fd;
+	int		skip;
+	byte	*base;
+
+	fd = open (path, O_RDONLY);
+	if (fd == -1)
+		return NULL;
+
+	skip = offset % sysconf (_SC_PAGESIZE);
+	base = mmap (NULL, length + skip, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, offset - skip);
+	close (fd);
+
+	if (base == MAP_FAILED)
+		return NULL;
+
+	return base + skip;
+}
+
+/*
+================
+Sys_UnmapFile
+================
+*/
+void Sys_UnmapFile (void *data, int offset, int length)
+{
+	int		skip;
+
+	skip = offset % sysconf (_SC_PAGESIZE);
+	munmap ((byte *)data - skip, length + skip);
+}
+
+/*
+===============================================================================
+
+WORKER THREADS
+
+===============================================================================
+*/
+
+static pthread_mutex_t	job_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	job_start = PTHREAD_COND_INITIALIZER;	// a new batch or a change of worker count
+static pthread_cond_t	job_done = PTHREAD_COND_INITIALIZER;	// the last job finished or a worker exited
+
+static void	(*job_func) (int job);
+static int	job_next, job_count, job_pending;
+static int	job_batch;			// bumped for every Sys_RunJobs
+static int	job_numworkers;		// running
+static int	job_wantworkers;	// requested, workers numbered above it exit
+
+/*
+================
+Sys_WorkerThread
+================
+*/
+static void *Sys_WorkerThread (void *arg)
+{
+	int		index = (int)(intptr_t)arg;
+	int		batch;
+	int		job;
+
+	pthread_mutex_lock (&job_lock);
+	batch = job_batch;
+
+	while (1)
+	{
+		while (batch == job_batch && index < job_wantworkers)
+			pthread_cond_wait (&job_start, &job_lock);
+
+		if (index >= job_wantworkers)
+			break;
+
+		batch = job_batch;
+		while (job_next < job_count)
+		{
+			job = job_next++;
+			pthread_mutex_unlock (&job_lock);
+			job_func (job);
+			pthread_mutex_lock (&job_lock);
+			if (--job_pending == 0)
+				pthread_cond_broadcast (&job_done);
+		}
+	}
+
+	job_numworkers--;
+	pthread_cond_broadcast (&job_done);
+	pthread_mutex_unlock (&job_lock);
+
+	return NULL;
+}
+
+/*
+================
+Sys_SetWorkerThreads
+================
+*/
+void Sys_SetWorkerThreads (int count)
+{
+	pthread_t	thread;
+
+	count = CLAMP(0, count, MAX_WORKER_THREADS);
+
+	pthread_mutex_lock (&job_lock);
+
+	// let the surplus workers exit before numbering new ones
+	job_wantworkers = count;
+	pthread_cond_broadcast (&job_start);
+	while (job_numworkers > count)
+		pthread_cond_wait (&job_done, &job_lock);
+
+	while (job_numworkers < count)
+	{
+		if (pthread_create (&thread, NULL, Sys_WorkerThread, (void *)(intptr_t)job_numworkers))
+		{
+			Con_Warning ("Sys_SetWorkerThreads: couldn't start thread %d\n", job_numworkers);
+			job_wantworkers = job_numworkers;
+			break;
+		}
+		pthread_detach (thread);
+		job_numworkers++;
+	}
+
+	pthread_mutex_unlock (&job_lock);
+}
+
+/*
+================
+Sys_RunJobs
+================
+*/
+void Sys_RunJobs (void (*func) (int job), int numjobs)
+{
+	int		job;
+
+	if (!job_numworkers || numjobs < 2)
+	{
+		for (job=0 ; job<numjobs ; job++)
+			func (job);
+		return;
+	}
+
+	pthread_mutex_lock (&job_lock);
+
+	job_func = func;
+	job_next = 0;
+	job_count = numjobs;
+	job_pending = numjobs;
+	job_batch++;
+	pthread_cond_broadcast (&job_start);
+
+	// help out instead of just waiting
+	while (job_next < job_count)
+	{
+		job = job_next++;
+		pthread_mutex_unlock (&job_lock);
+		func (job);
+		pthread_mutex_lock (&job_lock);
+		job_pending--;
+	}
+
+	while (job_pending)
+		pthread_cond_wait (&job_done, &job_lock);
+
+	pthread_mutex_unlock (&job_lock);
+}
+
 /*
 ===============================================================================
 
@@ -367,7 +543,7 @@ static char basepath[MAX_OSPATH];
 
 int main (int argc, char **argv)
 {
-	double time, oldtime, newtime;
+	double time, oldtime, newtime, wait;
 	quakeparms_t parms;
 	int t;
     char *c;
@@ -458,8 +634,30 @@ int main (int argc, char **argv)
 		{
 			if (time < sys_ticrate.value)
 			{
-				Sys_Sleep ();
-				continue; // not time to run a server only tic yet
+				// block until the next tic instead of spinning, or until
+				// a packet arrives if sys_wakeonpacket is set, but never
+				// sooner than host_maxfps allows
+				if (sys_wakeonpacket.value && host_maxfps.value > 0 && time >= 1.0 / host_maxfps.value)
+				{
+					if (!UDP_Wait (sys_ticrate.value - time))
+					{
+						Host_Idle (Sys_DoubleTime () - newtime);
+						continue; // not time to run a server only tic yet
+					}
+				}
+				else
+				{
+					wait = sys_ticrate.value - time;
+					if (sys_wakeonpacket.value && host_maxfps.value > 0)
+						wait = min(wait, 1.0 / host_maxfps.value - time);
+					usleep ((useconds_t)(wait * 1000000.0));
+					Host_Idle (Sys_DoubleTime () - newtime);
+					continue; // not time to run a server only tic yet
+				}
+
+				Host_Idle (Sys_DoubleTime () - newtime);
+				newtime = Sys_DoubleTime ();
+				time = newtime - oldtime;
 			}
 //			time = sys_ticrate.value;
 		}
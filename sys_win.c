@@ -100,6 +100,202 @@ void Sys_ScanDirFileList(char *path, char *subdir, char *ext, qboolean stripext,
 	FindClose(handle);
 }
 
+/*
+================
+Sys_MapFile
+
+private mapping, so loaders may swap data in place
+without touching the file or other views of it
+================
+*/
+void *Sys_MapFile (char *path, int offset, int length)
+{
+	HANDLE		file, mapping;
+	SYSTEM_INFO	info;
+	int			skip;
+	byte		*base;
+
+	file = CreateFile (path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	mapping = CreateFileMapping (file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	CloseHandle (file);
+	if (!mapping)
+		return NULL;
+
+	GetSystemInfo (&info);
+	skip = offset % info.dwAllocationGranularity;
+	base = MapViewOfFile (mapping, FILE_MAP_COPY, 0, offset - skip, length + skip);
+	CloseHandle (mapping); // the view keeps the mapping alive
+
+	if (!base)
+		return NULL;
+
+	return base + skip;
+}
+
+/*
+================
+Sys_UnmapFile
+================
+*/
+void Sys_UnmapFile (void *data, int offset, int length)
+{
+	SYSTEM_INFO	info;
+
+	GetSystemInfo (&info);
+	UnmapViewOfFile ((byte *)data - offset % info.dwAllocationGranularity);
+}
+
+/*
+===============================================================================
+
+WORKER THREADS
+
+===============================================================================
+*/
+
+static CRITICAL_SECTION	job_lock;
+static HANDLE	job_start;		// semaphore, a token per worker for every batch
+static HANDLE	job_done;		// the last job finished or a worker exited
+static qboolean	job_initialized = false;
+
+static void	(*job_func) (int job);
+static int	job_next, job_count, job_pending;
+static int	job_numworkers;		// running
+static int	job_wantworkers;	// requested, workers numbered above it exit
+
+/*
+================
+Sys_WorkerThread
+================
+*/
+static DWORD WINAPI Sys_WorkerThread (LPVOID arg)
+{
+	int		index = (int)(intptr_t)arg;
+	int		job;
+
+	while (1)
+	{
+		WaitForSingleObject (job_start, INFINITE);
+
+		EnterCriticalSection (&job_lock);
+		if (index >= job_wantworkers)
+			break;
+
+		while (job_next < job_count)
+		{
+			job = job_next++;
+			LeaveCriticalSection (&job_lock);
+			job_func (job);
+			EnterCriticalSection (&job_lock);
+			if (--job_pending == 0)
+				SetEvent (job_done);
+		}
+		LeaveCriticalSection (&job_lock);
+	}
+
+	job_numworkers--;
+	SetEvent (job_done);
+	LeaveCriticalSection (&job_lock);
+
+	return 0;
+}
+
+/*
+================
+Sys_SetWorkerThreads
+================
+*/
+void Sys_SetWorkerThreads (int count)
+{
+	HANDLE	thread;
+
+	count = CLAMP(0, count, MAX_WORKER_THREADS);
+
+	if (!job_initialized)
+	{
+		InitializeCriticalSection (&job_lock);
+		job_start = CreateSemaphore (NULL, 0, 0x7fffffff, NULL);
+		job_done = CreateEvent (NULL, FALSE, FALSE, NULL);
+		job_initialized = true;
+	}
+
+	EnterCriticalSection (&job_lock);
+
+	// let the surplus workers exit before numbering new ones, a token
+	// may wake a worker that stays, so keep handing them out
+	job_wantworkers = count;
+	while (job_numworkers > count)
+	{
+		ReleaseSemaphore (job_start, job_numworkers, NULL);
+		LeaveCriticalSection (&job_lock);
+		WaitForSingleObject (job_done, 10);
+		EnterCriticalSection (&job_lock);
+	}
+
+	while (job_numworkers < count)
+	{
+		thread = CreateThread (NULL, 0, Sys_WorkerThread, (LPVOID)(intptr_t)job_numworkers, 0, NULL);
+		if (!thread)
+		{
+			Con_Warning ("Sys_SetWorkerThreads: couldn't start thread %d\n", job_numworkers);
+			job_wantworkers = job_numworkers;
+			break;
+		}
+		CloseHandle (thread);
+		job_numworkers++;
+	}
+
+	LeaveCriticalSection (&job_lock);
+}
+
+/*
+================
+Sys_RunJobs
+================
+*/
+void Sys_RunJobs (void (*func) (int job), int numjobs)
+{
+	int		job;
+
+	if (!job_numworkers || numjobs < 2)
+	{
+		for (job=0 ; job<numjobs ; job++)
+			func (job);
+		return;
+	}
+
+	EnterCriticalSection (&job_lock);
+
+	job_func = func;
+	job_next = 0;
+	job_count = numjobs;
+	job_pending = numjobs;
+	ReleaseSemaphore (job_start, job_numworkers, NULL);
+
+	// help out instead of just waiting
+	while (job_next < job_count)
+	{
+		job = job_next++;
+		LeaveCriticalSection (&job_lock);
+		func (job);
+		EnterCriticalSection (&job_lock);
+		job_pending--;
+	}
+
+	// job_done may still be set from an earlier batch
+	while (job_pending)
+	{
+		LeaveCriticalSection (&job_lock);
+		WaitForSingleObject (job_done, INFINITE);
+		EnterCriticalSection (&job_lock);
+	}
+
+	LeaveCriticalSection (&job_lock);
+}
+
 /*
 ===============================================================================
 
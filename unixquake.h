@@ -23,6 +23,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <fcntl.h>
 #include <paths.h>
 #include <dirent.h>
+#include <pthread.h>
+#include <poll.h>
 
 #include <sys/ioctl.h>
 #include <sys/stat.h>
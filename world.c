@@ -30,6 +30,14 @@ line of sight checks trace->crosscontent, but bullets don't
 */
 
 
+// a box hull of its own for a move run on a worker thread
+typedef struct
+{
+	hull_t		hull;
+	mplane_t	planes[6];
+	qboolean	failed;		// ran into something that is a Host_Error on the main thread
+} boxhull_t;
+
 typedef struct
 {
 	vec3_t		boxmins, boxmaxs;// enclose the test object along entire move
@@ -39,6 +47,9 @@ typedef struct
 	trace_t		trace;
 	int			type;
 	edict_t		*passedict;
+	boxhull_t	*box;			// NULL on the main thread
+	int			candidates;		// for sv_areastats
+	int			clips;
 } moveclip_t;
 
 
@@ -91,6 +102,35 @@ void SV_InitBoxHull (void)
 	
 }
 
+/*
+===================
+SV_InitMoveBoxHull
+
+A copy of the box hull with planes of its own
+===================
+*/
+static void SV_InitMoveBoxHull (boxhull_t *box)
+{
+	box->hull = box_hull;
+	box->hull.planes = box->planes;
+	memcpy (box->planes, box_planes, sizeof(box->planes));
+	box->failed = false;
+}
+
+/*
+===================
+SV_SetBoxPlanes
+===================
+*/
+static void SV_SetBoxPlanes (mplane_t *planes, vec3_t mins, vec3_t maxs)
+{
+	planes[0].dist = maxs[0];
+	planes[1].dist = mins[0];
+	planes[2].dist = maxs[1];
+	planes[3].dist = mins[1];
+	planes[4].dist = maxs[2];
+	planes[5].dist = mins[2];
+}
 
 /*
 ===================
@@ -102,12 +142,7 @@ BSP trees instead of being compared directly.
 */
 hull_t	*SV_HullForBox (vec3_t mins, vec3_t maxs)
 {
-	box_planes[0].dist = maxs[0];
-	box_planes[1].dist = mins[0];
-	box_planes[2].dist = maxs[1];
-	box_planes[3].dist = mins[1];
-	box_planes[4].dist = maxs[2];
-	box_planes[5].dist = mins[2];
+	SV_SetBoxPlanes (box_planes, mins, maxs);
 
 	return &box_hull;
 }
@@ -122,9 +157,10 @@ Returns a hull that can be used for testing or clipping an object of mins/maxs
 size.
 Offset is filled in to contain the adjustment that must be added to the
 testing object's origin to get a point to use with the returned hull.
+A box on a worker thread gets errors flagged in it instead of raised.
 ================
 */
-hull_t *SV_HullForEntity (edict_t *ent, vec3_t mins, vec3_t maxs, vec3_t offset)
+hull_t *SV_HullForEntity (edict_t *ent, vec3_t mins, vec3_t maxs, vec3_t offset, boxhull_t *box)
 {
 	model_t		*model;
 	vec3_t		size;
@@ -134,13 +170,21 @@ hull_t *SV_HullForEntity (edict_t *ent, vec3_t mins, vec3_t maxs, vec3_t offset)
 // decide which clipping hull to use, based on the size
 	if (ent->v.solid == SOLID_BSP)
 	{	// explicit hulls in the BSP model
-		if (ent->v.movetype != MOVETYPE_PUSH)
-			Host_Error ("SOLID_BSP without MOVETYPE_PUSH");
-
 		model = sv.models[ (int)ent->v.modelindex ];
 
-		if (!model || model->type != mod_brush)
-			Host_Error ("SOLID_BSP with a non bsp model");
+		if (box && (ent->v.movetype != MOVETYPE_PUSH || !model || model->type != mod_brush))
+		{	// the caller throws the trace away
+			box->failed = true;
+			model = sv.worldmodel;
+		}
+		else
+		{
+			if (ent->v.movetype != MOVETYPE_PUSH)
+				Host_Error ("SOLID_BSP without MOVETYPE_PUSH");
+
+			if (!model || model->type != mod_brush)
+				Host_Error ("SOLID_BSP with a non bsp model");
+		}
 
 		VectorSubtract (maxs, mins, size);
 		if (size[0] < 3)
@@ -159,7 +203,13 @@ hull_t *SV_HullForEntity (edict_t *ent, vec3_t mins, vec3_t maxs, vec3_t offset)
 
 		VectorSubtract (ent->v.mins, maxs, hullmins);
 		VectorSubtract (ent->v.maxs, mins, hullmaxs);
-		hull = SV_HullForBox (hullmins, hullmaxs);
+		if (box)
+		{
+			SV_SetBoxPlanes (box->planes, hullmins, hullmaxs);
+			hull = &box->hull;
+		}
+		else
+			hull = SV_HullForBox (hullmins, hullmaxs);
 		
 		VectorCopy (ent->v.origin, offset);
 	}
@@ -185,11 +235,25 @@ typedef struct areanode_s
 	link_t	solid_edicts;
 } areanode_t;
 
-#define	AREA_DEPTH	4
-#define	AREA_NODES	32
+#define	AREA_DEPTH			4		// smallest tree, the only one in the original game
+#define	MAX_AREA_DEPTH		10
+#define	MAX_AREA_NODES		((2 << MAX_AREA_DEPTH) - 1)
+#define	AREA_LEAF_ENTS		8		// grow the tree until there are this few map entities per leaf
+#define	AREA_MIN_SIZE		256		// but don't make leafs smaller than this squared
 
-static	areanode_t	sv_areanodes[AREA_NODES];
+cvar_t	sv_areadepth = {"sv_areadepth", "0", CVAR_NONE};	// 0 = pick from the map size and entity count
+
+static	areanode_t	sv_areanodes[MAX_AREA_NODES];
 static	int			sv_numareanodes;
+static	int			sv_areadepth_used;
+
+static	int			sv_areamoves;		// SV_Move calls since the last sv_areastats
+static	int			sv_areacandidates;	// solid links looked at by them
+static	int			sv_areaclips;		// and the ones that needed an exact clip
+
+static	int			sv_tracerecord;		// frames left to record for SV_TraceBench_f
+static	int			sv_numrecordedmoves;
+static void SV_RecordMove (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict);
 
 /*
 ===============
@@ -209,7 +273,7 @@ areanode_t *SV_CreateAreaNode (int depth, vec3_t mins, vec3_t maxs)
 	ClearLink (&anode->trigger_edicts);
 	ClearLink (&anode->solid_edicts);
 	
-	if (depth == AREA_DEPTH)
+	if (depth == sv_areadepth_used)
 	{
 		anode->axis = -1;
 		anode->children[0] = anode->children[1] = NULL;
@@ -236,6 +300,38 @@ areanode_t *SV_CreateAreaNode (int depth, vec3_t mins, vec3_t maxs)
 	return anode;
 }
 
+/*
+===============
+SV_AreaDepth
+
+Big maps with a lot of entities get a deeper tree, so the lists stay short.
+The entity lump is all there is to go on before the map is spawned.
+===============
+*/
+int SV_AreaDepth (void)
+{
+	int		depth, numents;
+	char	*s;
+	double	area;
+
+	if (sv_areadepth.value > 0)
+		return CLAMP(1, (int)sv_areadepth.value, MAX_AREA_DEPTH);
+
+	numents = 0;
+	for (s = sv.worldmodel->entities ; s && *s ; s++)
+		if (*s == '{')
+			numents++;
+
+	area = (double)(sv.worldmodel->maxs[0] - sv.worldmodel->mins[0]) * (sv.worldmodel->maxs[1] - sv.worldmodel->mins[1]);
+
+	depth = AREA_DEPTH;
+	while (depth < MAX_AREA_DEPTH && (1 << depth) * AREA_LEAF_ENTS < numents
+		&& area / (2 << depth) >= AREA_MIN_SIZE * AREA_MIN_SIZE)
+		depth++;
+
+	return depth;
+}
+
 /*
 ===============
 SV_ClearWorld
@@ -248,10 +344,124 @@ void SV_ClearWorld (void)
 	
 	memset (sv_areanodes, 0, sizeof(sv_areanodes));
 	sv_numareanodes = 0;
+	sv_areadepth_used = SV_AreaDepth ();
 	SV_CreateAreaNode (0, sv.worldmodel->mins, sv.worldmodel->maxs);
+
+	sv_areamoves = sv_areacandidates = sv_areaclips = 0;
+
+// the recorded moves point at the old edicts
+	sv_tracerecord = 0;
+	sv_numrecordedmoves = 0;
+}
+
+/*
+===============
+SV_AreaStats_f
+
+===============
+*/
+void SV_AreaStats_f (void)
+{
+	int			i, count;
+	int			solid, solidlists, solidmax;
+	int			trigger, triggerlists, triggermax;
+	areanode_t	*node;
+	link_t		*l;
+
+	if (!sv.active)
+	{
+		Con_Printf ("Not running a server\n");
+		return;
+	}
+
+	solid = solidlists = solidmax = 0;
+	trigger = triggerlists = triggermax = 0;
+	for (i=0, node = sv_areanodes ; i<sv_numareanodes ; i++, node++)
+	{
+		count = 0;
+		for (l = node->solid_edicts.next ; l != &node->solid_edicts ; l = l->next)
+			count++;
+		if (count)
+		{
+			solid += count;
+			solidlists++;
+			solidmax = max(solidmax, count);
+		}
+
+		count = 0;
+		for (l = node->trigger_edicts.next ; l != &node->trigger_edicts ; l = l->next)
+			count++;
+		if (count)
+		{
+			trigger += count;
+			triggerlists++;
+			triggermax = max(triggermax, count);
+		}
+	}
+
+	Con_Printf ("area tree: depth %i%s, %i nodes\n", sv_areadepth_used, sv_areadepth.value > 0 ? " (sv_areadepth)" : "", sv_numareanodes);
+	Con_Printf ("solid:   %4i links in %3i lists, %.1f average, %i max\n", solid, solidlists, solidlists ? (float)solid / solidlists : 0, solidmax);
+	Con_Printf ("trigger: %4i links in %3i lists, %.1f average, %i max\n", trigger, triggerlists, triggerlists ? (float)trigger / triggerlists : 0, triggermax);
+
+	if (sv_areamoves)
+		Con_Printf ("%i moves, %.1f candidates and %.1f clips per move\n", sv_areamoves,
+			(float)sv_areacandidates / sv_areamoves, (float)sv_areaclips / sv_areamoves);
+
+	sv_areamoves = sv_areacandidates = sv_areaclips = 0;
 }
 
 
+/*
+===============
+SV_WatchLinks
+
+Starts a new sv_linkstamp.  While watching, the edicts that leave their
+place in the area tree are noted once each, so whoever traced against the
+tree before can tell what moved away.
+===============
+*/
+int				sv_linkstamp;
+static qboolean	sv_watchlinks;
+static edict_t	**sv_unlinked;
+static int		sv_numunlinked, sv_maxunlinked;
+
+void SV_WatchLinks (qboolean watch)
+{
+	sv_linkstamp++;
+	sv_watchlinks = watch;
+	sv_numunlinked = 0;
+}
+
+/*
+===============
+SV_NoteUnlink
+===============
+*/
+static void SV_NoteUnlink (edict_t *ent)
+{
+	if (sv_numunlinked == sv_maxunlinked)
+	{
+		sv_maxunlinked = sv_maxunlinked ? sv_maxunlinked * 2 : 256;
+		sv_unlinked = (edict_t **) realloc (sv_unlinked, sv_maxunlinked * sizeof(*sv_unlinked));
+		if (!sv_unlinked)
+			Host_Error ("SV_NoteUnlink: realloc() failed on %d edicts", sv_maxunlinked);
+	}
+	sv_unlinked[sv_numunlinked++] = ent;
+}
+
+/*
+===============
+SV_UnlinkedEdicts
+
+The edicts unlinked since SV_WatchLinks
+===============
+*/
+int SV_UnlinkedEdicts (edict_t ***list)
+{
+	*list = sv_unlinked;
+	return sv_numunlinked;
+}
+
 /*
 ===============
 SV_UnlinkEdict
@@ -265,6 +475,9 @@ void SV_UnlinkEdict (edict_t *ent)
 {
 	if (!ent->area.prev)
 		return;		// not linked in anywhere
+	if (sv_watchlinks && ent->linkstamp != sv_linkstamp)
+		SV_NoteUnlink (ent);
+	ent->linkstamp = sv_linkstamp;
 	RemoveLink (&ent->area);
 	if (sv_link_next && *sv_link_next == &ent->area)
 		*sv_link_next = ent->area.next;
@@ -334,6 +547,59 @@ void SV_TouchLinks ( edict_t *ent, areanode_t *node )
 }
 
 
+/*
+====================
+SV_AreaEdicts_r
+====================
+*/
+static int SV_AreaEdicts_r (areanode_t *node, vec3_t mins, vec3_t maxs, edict_t **list, int count, int maxcount)
+{
+	link_t		*l, *start;
+	edict_t		*touch;
+	int			i;
+
+	for (i=0 ; i<2 ; i++)
+	{
+		start = i ? &node->trigger_edicts : &node->solid_edicts;
+		for (l = start->next ; l != start ; l = l->next)
+		{
+			touch = EDICT_FROM_AREA(l);
+			if (mins[0] > touch->v.absmax[0]
+			|| mins[1] > touch->v.absmax[1]
+			|| mins[2] > touch->v.absmax[2]
+			|| maxs[0] < touch->v.absmin[0]
+			|| maxs[1] < touch->v.absmin[1]
+			|| maxs[2] < touch->v.absmin[2] )
+				continue;
+			if (count == maxcount)
+				return count;
+			list[count++] = touch;
+		}
+	}
+
+// recurse down both sides
+	if (node->axis == -1)
+		return count;
+
+	if ( maxs[node->axis] > node->dist )
+		count = SV_AreaEdicts_r (node->children[0], mins, maxs, list, count, maxcount);
+	if ( mins[node->axis] < node->dist )
+		count = SV_AreaEdicts_r (node->children[1], mins, maxs, list, count, maxcount);
+
+	return count;
+}
+
+/*
+====================
+SV_AreaEdicts
+====================
+*/
+int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **list, int maxcount)
+{
+	return SV_AreaEdicts_r (sv_areanodes, mins, maxs, list, 0, maxcount);
+}
+
+
 /*
 ===============
 SV_FindTouchedLeafs
@@ -454,6 +720,8 @@ void SV_LinkEdict (edict_t *ent, qboolean touch_triggers)
 	if (ent->v.modelindex)
 		SV_FindTouchedLeafs (ent, sv.worldmodel->nodes);
 
+	ED_SyncHot (ent);
+
 	if (ent->v.solid == SOLID_NOT)
 		return;
 
@@ -477,6 +745,7 @@ void SV_LinkEdict (edict_t *ent, qboolean touch_triggers)
 		InsertLinkBefore (&ent->area, &node->trigger_edicts);
 	else
 		InsertLinkBefore (&ent->area, &node->solid_edicts);
+	ent->linkstamp = sv_linkstamp;
 	
 // if touch_triggers, touch all entities at this node and decend for more
 	if (touch_triggers)
@@ -495,11 +764,13 @@ POINT TESTING IN HULLS
 
 /*
 ==================
-SV_HullPointContents
+SV_MoveHullPointContents
 
+box is NULL on the main thread, a worker sets box->failed instead of
+raising the Host_Error
 ==================
 */
-int SV_HullPointContents (hull_t *hull, int num, vec3_t p)
+static int SV_MoveHullPointContents (hull_t *hull, int num, vec3_t p, boxhull_t *box)
 {
 	float		d;
 	mclipnode_t	*node; //johnfitz -- was dclipnode_t
@@ -508,7 +779,14 @@ int SV_HullPointContents (hull_t *hull, int num, vec3_t p)
 	while (num >= 0)
 	{
 		if (num < hull->firstclipnode || num > hull->lastclipnode)
+		{
+			if (box)
+			{
+				box->failed = true;
+				return CONTENTS_SOLID;
+			}
 			Host_Error ("SV_HullPointContents: node number %d outside %d - %d", num, hull->firstclipnode, hull->lastclipnode);
+		}
 	
 		node = hull->clipnodes + num;
 		plane = hull->planes + node->planenum;
@@ -526,6 +804,17 @@ int SV_HullPointContents (hull_t *hull, int num, vec3_t p)
 	return num;
 }
 
+/*
+==================
+SV_HullPointContents
+
+==================
+*/
+int SV_HullPointContents (hull_t *hull, int num, vec3_t p)
+{
+	return SV_MoveHullPointContents (hull, num, p, NULL);
+}
+
 
 /*
 ==================
@@ -579,13 +868,15 @@ LINE TESTING IN HULLS
 */
 
 
+static qboolean	sv_recursivehullcheck;	// for SV_TraceBench_f
+
 /*
 ==================
-SV_RecursiveHullCheck
+SV_MoveRecursiveHullCheck
 
 ==================
 */
-qboolean SV_RecursiveHullCheck (hull_t *hull, int num, float p1f, float p2f, vec3_t p1, vec3_t p2, trace_t *trace)
+static qboolean SV_MoveRecursiveHullCheck (hull_t *hull, int num, float p1f, float p2f, vec3_t p1, vec3_t p2, trace_t *trace, boxhull_t *box)
 {
 	mclipnode_t	*node; //johnfitz -- was dclipnode_t
 	mplane_t	*plane;
@@ -615,7 +906,14 @@ restart:
 	}
 
 	if (num < hull->firstclipnode || num > hull->lastclipnode)
+	{
+		if (box)
+		{
+			box->failed = true;
+			return false;
+		}
 		Host_Error ("SV_RecursiveHullCheck: bad node number");
+	}
 
 //
 // find the point distances
@@ -669,13 +967,13 @@ restart:
 	side = (t1 < 0);
 
 // move up to the node
-	if (!SV_RecursiveHullCheck (hull, node->children[side], p1f, midf, p1, mid, trace))
+	if (!SV_MoveRecursiveHullCheck (hull, node->children[side], p1f, midf, p1, mid, trace, box))
 		return false;
 
 // LordHavoc: this recursion can not be optimized because mid would need to be duplicated on a stack
 // go past the node
-	if (SV_HullPointContents (hull, node->children[side^1], mid) != CONTENTS_SOLID)
-		return SV_RecursiveHullCheck (hull, node->children[side^1], midf, p2f, mid, p2, trace);
+	if (SV_MoveHullPointContents (hull, node->children[side^1], mid, box) != CONTENTS_SOLID)
+		return SV_MoveRecursiveHullCheck (hull, node->children[side^1], midf, p2f, mid, p2, trace, box);
 
 	if (trace->allsolid)
 		return false;		// never got out of the solid area
@@ -694,7 +992,7 @@ restart:
 		trace->plane.dist = -plane->dist;
 	}
 
-	while (SV_HullPointContents (hull, hull->firstclipnode, mid) == CONTENTS_SOLID)
+	while (SV_MoveHullPointContents (hull, hull->firstclipnode, mid, box) == CONTENTS_SOLID)
 	{ // shouldn't really happen, but does occasionally
 		frac -= 0.1f;
 		if (frac < 0)
@@ -702,7 +1000,8 @@ restart:
 			trace->fraction = midf;
 			VectorCopy (mid, trace->endpos);
 
-			if (developer.value > 2 && IsTimeout (&lastmsg, 2))
+			// not from the workers, the console isn't theirs
+			if (!box && developer.value > 2 && IsTimeout (&lastmsg, 2))
 				Con_DPrintf ("backup past 0 near (%.0f %.0f %.0f)\n", mid[0], mid[1], mid[2]);
 
 			return false;
@@ -718,6 +1017,218 @@ restart:
 	return false;
 }
 
+/*
+==================
+SV_RecursiveHullCheck
+
+==================
+*/
+qboolean SV_RecursiveHullCheck (hull_t *hull, int num, float p1f, float p2f, vec3_t p1, vec3_t p2, trace_t *trace)
+{
+	return SV_MoveRecursiveHullCheck (hull, num, p1f, p2f, p1, p2, trace, NULL);
+}
+
+/*
+==================
+SV_HullCheck
+
+SV_RecursiveHullCheck with its own stack instead of recursion.  It does the
+same float operations in the same order, so the results are identical.
+Subtrees deeper than the stack are handed to SV_RecursiveHullCheck.
+==================
+*/
+#define	MAX_HULLCHECK_STACK	128
+
+typedef struct
+{
+	mclipnode_t	*node;
+	mplane_t	*plane;
+	int			side;
+	float		frac;
+	float		p1f, p2f, midf;
+	vec3_t		p1, p2, mid;
+} hullcheck_t;
+
+static qboolean SV_MoveHullCheck (hull_t *hull, int num, float p1f, float p2f, vec3_t p1, vec3_t p2, trace_t *trace, boxhull_t *box)
+{
+	hullcheck_t	stack[MAX_HULLCHECK_STACK];
+	hullcheck_t	*frame;
+	int			sp;
+	mclipnode_t	*node;
+	mplane_t	*plane;
+	float		t1, t2;
+	float		frac;
+	int			i;
+	vec3_t		start, end;
+	static float	lastmsg = 0;
+
+	sp = 0;
+	VectorCopy (p1, start);
+	VectorCopy (p2, end);
+
+	while (1)
+	{
+	// walk down to the next leaf or crossed node
+		while (num >= 0)
+		{
+			if (num < hull->firstclipnode || num > hull->lastclipnode)
+			{
+				if (box)
+				{
+					box->failed = true;
+					return false;
+				}
+				Host_Error ("SV_HullCheck: bad node number");
+			}
+
+			node = hull->clipnodes + num;
+			plane = hull->planes + node->planenum;
+
+			switch (plane->type)
+			{
+			case PLANE_X:
+			case PLANE_Y:
+			case PLANE_Z:
+				t1 = start[plane->type] - plane->dist;
+				t2 = end[plane->type] - plane->dist;
+				break;
+			default:
+				// add casts to double to force 64-bit precision on SSE builds.
+				t1 = PreciseDotProduct (plane->normal, start) - plane->dist;
+				t2 = PreciseDotProduct (plane->normal, end) - plane->dist;
+				break;
+			}
+
+			if (t1 >= 0 && t2 >= 0)
+			{
+				num = node->children[0];	// go down the front side
+				continue;
+			}
+			if (t1 < 0 && t2 < 0)
+			{
+				num = node->children[1];	// go down the back side
+				continue;
+			}
+
+			if (sp == MAX_HULLCHECK_STACK)
+			{
+				if (!SV_MoveRecursiveHullCheck (hull, num, p1f, p2f, start, end, trace, box))
+					return false;
+				break;	// same as reaching an empty leaf
+			}
+
+		// put the crosspoint DIST_EPSILON pixels on the near side
+			if (t1 < 0)
+				frac = (t1 + DIST_EPSILON)/(t1-t2);
+			else
+				frac = (t1 - DIST_EPSILON)/(t1-t2);
+
+			if (frac < 0)
+				frac = 0;
+			if (frac > 1)
+				frac = 1;
+
+			frame = &stack[sp++];
+			frame->node = node;
+			frame->plane = plane;
+			frame->side = (t1 < 0);
+			frame->frac = frac;
+			frame->p1f = p1f;
+			frame->p2f = p2f;
+			frame->midf = p1f + (p2f - p1f)*frac;
+			VectorCopy (start, frame->p1);
+			VectorCopy (end, frame->p2);
+			for (i=0 ; i<3 ; i++)
+				frame->mid[i] = start[i] + frac*(end[i] - start[i]);
+
+		// move up to the node
+			num = node->children[frame->side];
+			p2f = frame->midf;
+			VectorCopy (frame->mid, end);
+		}
+
+	// check for empty
+		if (num < 0)
+		{
+			if (num != CONTENTS_SOLID)
+			{
+				trace->allsolid = false;
+				if (num == CONTENTS_EMPTY)
+					trace->inopen = true;
+				else
+					trace->inwater = true;
+			}
+			else
+				trace->startsolid = true;
+		}
+
+		if (!sp)
+			return true;
+
+	// the near side of the innermost crossed node is done, go past it
+		frame = &stack[--sp];
+		if (SV_MoveHullPointContents (hull, frame->node->children[frame->side^1], frame->mid, box) != CONTENTS_SOLID)
+		{
+			num = frame->node->children[frame->side^1];
+			p1f = frame->midf;
+			p2f = frame->p2f;
+			VectorCopy (frame->mid, start);
+			VectorCopy (frame->p2, end);
+			continue;
+		}
+
+		if (trace->allsolid)
+			return false;		// never got out of the solid area
+
+	// the other side of the node is solid, this is the impact point
+		plane = frame->plane;
+		if (!frame->side)
+		{
+			VectorCopy (plane->normal, trace->plane.normal);
+			trace->plane.dist = plane->dist;
+		}
+		else
+		{
+			VectorNegate (plane->normal, trace->plane.normal);
+			trace->plane.dist = -plane->dist;
+		}
+
+		frac = frame->frac;
+		while (SV_MoveHullPointContents (hull, hull->firstclipnode, frame->mid, box) == CONTENTS_SOLID)
+		{ // shouldn't really happen, but does occasionally
+			frac -= 0.1f;
+			if (frac < 0)
+			{
+				trace->fraction = frame->midf;
+				VectorCopy (frame->mid, trace->endpos);
+
+				if (!box && developer.value > 2 && IsTimeout (&lastmsg, 2))
+					Con_DPrintf ("backup past 0 near (%.0f %.0f %.0f)\n", frame->mid[0], frame->mid[1], frame->mid[2]);
+
+				return false;
+			}
+			frame->midf = frame->p1f + (frame->p2f - frame->p1f)*frac;
+			for (i=0 ; i<3 ; i++)
+				frame->mid[i] = frame->p1[i] + frac*(frame->p2[i] - frame->p1[i]);
+		}
+
+		trace->fraction = frame->midf;
+		VectorCopy (frame->mid, trace->endpos);
+
+		return false;
+	}
+}
+
+/*
+==================
+SV_HullCheck
+==================
+*/
+qboolean SV_HullCheck (hull_t *hull, int num, float p1f, float p2f, vec3_t p1, vec3_t p2, trace_t *trace)
+{
+	return SV_MoveHullCheck (hull, num, p1f, p2f, p1, p2, trace, NULL);
+}
+
 
 /*
 ==================
@@ -727,7 +1238,7 @@ Handles selection or creation of a clipping hull, and offseting (and
 eventually rotation) of the end points
 ==================
 */
-trace_t SV_ClipMoveToEntity (edict_t *ent, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end)
+trace_t SV_ClipMoveToEntity (edict_t *ent, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, boxhull_t *box)
 {
 	trace_t		trace;
 	vec3_t		offset;
@@ -741,7 +1252,7 @@ trace_t SV_ClipMoveToEntity (edict_t *ent, vec3_t start, vec3_t mins, vec3_t max
 	VectorCopy (end, trace.endpos);
 
 // get the clipping hull
-	hull = SV_HullForEntity (ent, mins, maxs, offset);
+	hull = SV_HullForEntity (ent, mins, maxs, offset, box);
 
 	VectorSubtract (start, offset, start_l);
 	VectorSubtract (end, offset, end_l);
@@ -768,7 +1279,10 @@ trace_t SV_ClipMoveToEntity (edict_t *ent, vec3_t start, vec3_t mins, vec3_t max
 // ROTATE END
 
 // trace a line through the apropriate clipping hull
-	SV_RecursiveHullCheck (hull, hull->firstclipnode, 0, 1, start_l, end_l, &trace);
+	if (sv_recursivehullcheck)
+		SV_MoveRecursiveHullCheck (hull, hull->firstclipnode, 0, 1, start_l, end_l, &trace, box);
+	else
+		SV_MoveHullCheck (hull, hull->firstclipnode, 0, 1, start_l, end_l, &trace, box);
 
 // ROTATE START
 	// rotate endpos back to world frame of reference
@@ -835,6 +1349,7 @@ void SV_ClipToLinks ( areanode_t *node, moveclip_t *clip )
 	{
 		next = l->next;
 		touch = EDICT_FROM_AREA(l);
+		clip->candidates++;
 
 		if (touch->v.solid == SOLID_NOT)
 			continue;
@@ -843,7 +1358,14 @@ void SV_ClipToLinks ( areanode_t *node, moveclip_t *clip )
 			continue;
 
 		if (touch->v.solid == SOLID_TRIGGER)
+		{
+			if (clip->box)
+			{
+				clip->box->failed = true;
+				continue;
+			}
 			Host_Error ("Trigger in clipping list");
+		}
 
 		if (clip->type == MOVE_NOMONSTERS && touch->v.solid != SOLID_BSP)
 			continue;
@@ -870,10 +1392,11 @@ void SV_ClipToLinks ( areanode_t *node, moveclip_t *clip )
 				continue;	// don't clip against owner
 		}
 
+		clip->clips++;
 		if ((int)touch->v.flags & FL_MONSTER)
-			trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins2, clip->maxs2, clip->end);
+			trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins2, clip->maxs2, clip->end, clip->box);
 		else
-			trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins, clip->maxs, clip->end);
+			trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins, clip->maxs, clip->end, clip->box);
 		if (trace.allsolid || trace.startsolid || trace.fraction < clip->trace.fraction)
 		{
 			trace.ent = touch;
@@ -926,46 +1449,336 @@ void SV_MoveBounds (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, vec3_t b
 
 /*
 ==================
-SV_Move
+SV_StartMove
+
+Sets up clip and clips it to the world
 ==================
 */
-trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict)
+static void SV_StartMove (moveclip_t *clip, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict, boxhull_t *box)
 {
-	moveclip_t	clip;
 	int			i;
 
-	memset ( &clip, 0, sizeof ( moveclip_t ) );
+	memset ( clip, 0, sizeof ( moveclip_t ) );
 
 // clip to world
-	clip.trace = SV_ClipMoveToEntity ( sv.edicts, start, mins, maxs, end );
+	clip->box = box;
+	clip->trace = SV_ClipMoveToEntity ( sv.edicts, start, mins, maxs, end, box );
 
-	clip.start = start;
-	clip.end = end;
-	clip.mins = mins;
-	clip.maxs = maxs;
-	clip.type = type;
-	clip.passedict = passedict;
+	clip->start = start;
+	clip->end = end;
+	clip->mins = mins;
+	clip->maxs = maxs;
+	clip->type = type;
+	clip->passedict = passedict;
 
 	if (type == MOVE_MISSILE)
 	{
 		for (i=0 ; i<3 ; i++)
 		{
-			clip.mins2[i] = -15;
-			clip.maxs2[i] = 15;
+			clip->mins2[i] = -15;
+			clip->maxs2[i] = 15;
 		}
 	}
 	else
 	{
-		VectorCopy (mins, clip.mins2);
-		VectorCopy (maxs, clip.maxs2);
+		VectorCopy (mins, clip->mins2);
+		VectorCopy (maxs, clip->maxs2);
 	}
 	
 // create the bounding box of the entire move
-	SV_MoveBounds ( start, clip.mins2, clip.maxs2, end, clip.boxmins, clip.boxmaxs );
+	SV_MoveBounds ( start, clip->mins2, clip->maxs2, end, clip->boxmins, clip->boxmaxs );
+}
+
+/*
+==================
+SV_Move
+==================
+*/
+trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict)
+{
+	moveclip_t	clip;
+
+	if (sv_tracerecord)
+		SV_RecordMove (start, mins, maxs, end, type, passedict);
+
+	SV_StartMove (&clip, start, mins, maxs, end, type, passedict, NULL);
 
 // clip to entities
 	SV_ClipToLinks ( sv_areanodes, &clip );
+	sv_areamoves++;
+	sv_areacandidates += clip.candidates;
+	sv_areaclips += clip.clips;
 
 	return clip.trace;
 }
 
+/*
+==================
+SV_MoveBatch
+
+SV_Move for a number of independent moves.  All of them are clipped to the
+world before any of them to the entities, so the world hull stays in the
+cache.  The traces are the same as from separate SV_Move calls.
+==================
+*/
+#define	MOVE_BATCH	32
+
+void SV_MoveBatch (movequery_t *moves, int count, trace_t *traces)
+{
+	moveclip_t	clips[MOVE_BATCH];
+	movequery_t	*move;
+	int			i, first, num;
+
+	for (first=0 ; first<count ; first+=num)
+	{
+		num = min(count - first, MOVE_BATCH);
+
+		for (i=0, move = moves + first ; i<num ; i++, move++)
+		{
+			if (sv_tracerecord)
+				SV_RecordMove (move->start, move->mins, move->maxs, move->end, move->type, move->passedict);
+			SV_StartMove (&clips[i], move->start, move->mins, move->maxs, move->end, move->type, move->passedict, NULL);
+		}
+
+		for (i=0 ; i<num ; i++)
+		{
+			SV_ClipToLinks ( sv_areanodes, &clips[i] );
+			traces[first + i] = clips[i].trace;
+			sv_areamoves++;
+			sv_areacandidates += clips[i].candidates;
+			sv_areaclips += clips[i].clips;
+		}
+	}
+}
+
+static movequery_t	*sv_jobmoves;
+static trace_t		*sv_jobtraces;
+static qboolean		*sv_jobfailed;
+static int			sv_jobcount;
+
+/*
+==================
+SV_MoveJob
+
+One batch of SV_MoveParallel, on any thread
+==================
+*/
+static void SV_MoveJob (int job)
+{
+	moveclip_t	clips[MOVE_BATCH];
+	boxhull_t	box;
+	movequery_t	*move;
+	int			i, first, num;
+
+	first = job * MOVE_BATCH;
+	num = min(sv_jobcount - first, MOVE_BATCH);
+	SV_InitMoveBoxHull (&box);
+
+	for (i=0, move = sv_jobmoves + first ; i<num ; i++, move++)
+	{
+		SV_StartMove (&clips[i], move->start, move->mins, move->maxs, move->end, move->type, move->passedict, &box);
+		sv_jobfailed[first + i] = box.failed;
+		box.failed = false;
+	}
+
+	for (i=0 ; i<num ; i++)
+	{
+		SV_ClipToLinks ( sv_areanodes, &clips[i] );
+		sv_jobtraces[first + i] = clips[i].trace;
+		sv_jobfailed[first + i] |= box.failed;
+		box.failed = false;
+	}
+}
+
+/*
+==================
+SV_MoveParallel
+
+SV_MoveBatch spread over the worker threads.  Nothing may be linked or
+unlinked until it returns.  Moves that would have raised an error on the
+main thread come back with failed set and have to be redone with SV_Move.
+They aren't counted by sv_areastats.
+==================
+*/
+void SV_MoveParallel (movequery_t *moves, int count, trace_t *traces, qboolean *failed)
+{
+	int		i;
+
+	if (sv_tracerecord)
+		for (i=0 ; i<count ; i++)
+			SV_RecordMove (moves[i].start, moves[i].mins, moves[i].maxs, moves[i].end, moves[i].type, moves[i].passedict);
+
+	sv_jobmoves = moves;
+	sv_jobtraces = traces;
+	sv_jobfailed = failed;
+	sv_jobcount = count;
+	Sys_RunJobs (SV_MoveJob, (count + MOVE_BATCH - 1) / MOVE_BATCH);
+}
+
+/*
+===============================================================================
+
+TRACE BENCHMARK
+
+===============================================================================
+*/
+
+#define	MAX_RECORDED_MOVES	65536
+
+static movequery_t	*sv_recordedmoves;
+
+/*
+==================
+SV_RecordMove
+==================
+*/
+static void SV_RecordMove (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict)
+{
+	movequery_t	*move;
+
+	if (sv_numrecordedmoves == MAX_RECORDED_MOVES)
+		return;
+
+	move = &sv_recordedmoves[sv_numrecordedmoves++];
+	VectorCopy (start, move->start);
+	VectorCopy (mins, move->mins);
+	VectorCopy (maxs, move->maxs);
+	VectorCopy (end, move->end);
+	move->type = type;
+	move->passedict = passedict;
+}
+
+/*
+==================
+SV_TraceRecordFrame
+
+Called at the end of every server frame
+==================
+*/
+void SV_TraceRecordFrame (void)
+{
+	if (sv_tracerecord && !--sv_tracerecord)
+		Con_Printf ("recorded %i moves\n", sv_numrecordedmoves);
+}
+
+/*
+==================
+SV_TracesEqual
+==================
+*/
+static qboolean SV_TracesEqual (trace_t *a, trace_t *b)
+{
+	return a->allsolid == b->allsolid && a->startsolid == b->startsolid
+		&& a->inopen == b->inopen && a->inwater == b->inwater
+		&& !memcmp (&a->fraction, &b->fraction, sizeof(a->fraction))
+		&& !memcmp (a->endpos, b->endpos, sizeof(a->endpos))
+		&& !memcmp (&a->plane, &b->plane, sizeof(a->plane))
+		&& a->ent == b->ent;
+}
+
+/*
+==================
+SV_TraceBench_f
+
+"sv_tracebench record <frames>" keeps the moves of the next server frames,
+"sv_tracebench [passes]" replays them through the recursive and the
+iterative hull walk, SV_MoveBatch and SV_MoveParallel, and checks that all
+of them give the same traces
+==================
+*/
+void SV_TraceBench_f (void)
+{
+	trace_t		*ref, *traces;
+	qboolean	*failed;
+	movequery_t	*move;
+	int			i, pass, passes, mismatches;
+	double		start, recursive, iterative, batched, parallel;
+
+	if (!sv.active)
+	{
+		Con_Printf ("Not running a server\n");
+		return;
+	}
+
+	if (Cmd_Argc() > 1 && !strcmp (Cmd_Argv(1), "record"))
+	{
+		if (!sv_recordedmoves)
+			sv_recordedmoves = (movequery_t *) malloc (MAX_RECORDED_MOVES * sizeof(movequery_t));
+		if (!sv_recordedmoves)
+		{
+			Con_Printf ("sv_tracebench: couldn't allocate %i moves\n", MAX_RECORDED_MOVES);
+			return;
+		}
+		sv_numrecordedmoves = 0;
+		sv_tracerecord = (Cmd_Argc() > 2) ? max(1, atoi(Cmd_Argv(2))) : 1;
+		return;
+	}
+
+	if (sv_tracerecord || !sv_numrecordedmoves)
+	{
+		Con_Printf ("usage: sv_tracebench record <frames>, then sv_tracebench [passes]\n");
+		return;
+	}
+
+	passes = (Cmd_Argc() > 1) ? max(1, atoi(Cmd_Argv(1))) : 10;
+	ref = (trace_t *) malloc (sv_numrecordedmoves * sizeof(trace_t));
+	traces = (trace_t *) malloc (sv_numrecordedmoves * sizeof(trace_t));
+	failed = (qboolean *) malloc (sv_numrecordedmoves * sizeof(qboolean));
+	if (!ref || !traces || !failed)
+	{
+		free (ref);
+		free (traces);
+		free (failed);
+		Con_Printf ("sv_tracebench: couldn't allocate %i traces\n", sv_numrecordedmoves);
+		return;
+	}
+
+	sv_recursivehullcheck = true;
+	start = Sys_DoubleTime ();
+	for (pass=0 ; pass<passes ; pass++)
+		for (i=0, move = sv_recordedmoves ; i<sv_numrecordedmoves ; i++, move++)
+			ref[i] = SV_Move (move->start, move->mins, move->maxs, move->end, move->type, move->passedict);
+	recursive = Sys_DoubleTime () - start;
+	sv_recursivehullcheck = false;
+
+	mismatches = 0;
+	start = Sys_DoubleTime ();
+	for (pass=0 ; pass<passes ; pass++)
+		for (i=0, move = sv_recordedmoves ; i<sv_numrecordedmoves ; i++, move++)
+			traces[i] = SV_Move (move->start, move->mins, move->maxs, move->end, move->type, move->passedict);
+	iterative = Sys_DoubleTime () - start;
+	for (i=0 ; i<sv_numrecordedmoves ; i++)
+		if (!SV_TracesEqual (&ref[i], &traces[i]))
+			mismatches++;
+
+	start = Sys_DoubleTime ();
+	for (pass=0 ; pass<passes ; pass++)
+		SV_MoveBatch (sv_recordedmoves, sv_numrecordedmoves, traces);
+	batched = Sys_DoubleTime () - start;
+	for (i=0 ; i<sv_numrecordedmoves ; i++)
+		if (!SV_TracesEqual (&ref[i], &traces[i]))
+			mismatches++;
+
+	start = Sys_DoubleTime ();
+	for (pass=0 ; pass<passes ; pass++)
+		SV_MoveParallel (sv_recordedmoves, sv_numrecordedmoves, traces, failed);
+	parallel = Sys_DoubleTime () - start;
+	for (i=0 ; i<sv_numrecordedmoves ; i++)
+		if (!failed[i] && !SV_TracesEqual (&ref[i], &traces[i]))
+			mismatches++;
+
+	free (ref);
+	free (traces);
+	free (failed);
+
+	Con_Printf ("%i moves x %i passes\n", sv_numrecordedmoves, passes);
+	Con_Printf ("recursive: %.3f us/move\n", recursive * 1000000.0 / (passes * sv_numrecordedmoves));
+	Con_Printf ("iterative: %.3f us/move\n", iterative * 1000000.0 / (passes * sv_numrecordedmoves));
+	Con_Printf ("batched:   %.3f us/move\n", batched * 1000000.0 / (passes * sv_numrecordedmoves));
+	Con_Printf ("parallel:  %.3f us/move\n", parallel * 1000000.0 / (passes * sv_numrecordedmoves));
+	if (mismatches)
+		Con_Warning ("%i traces differ from the recursive hull check\n", mismatches);
+	else
+		Con_Printf ("all traces identical\n");
+}
+
@@ -42,15 +42,41 @@ typedef struct
 #define	MOVE_NOMONSTERS	1
 #define	MOVE_MISSILE	2
 
+typedef struct
+{
+	vec3_t	start, mins, maxs, end;
+	int		type;
+	edict_t	*passedict;
+} movequery_t;
+
+
+extern	cvar_t	sv_areadepth;
 
 void SV_ClearWorld (void);
 // called after the world model has been loaded, before linking any entities
 
+void SV_AreaStats_f (void);
+// prints the area tree list lengths and the candidates per SV_Move
+
 void SV_UnlinkEdict (edict_t *ent);
 // call before removing an entity, and before trying to move one,
 // so it doesn't clip against itself
 // flags ent->v.modified
 
+extern	int		sv_linkstamp;
+
+void SV_WatchLinks (qboolean watch);
+// starts a new sv_linkstamp, which SV_LinkEdict and SV_UnlinkEdict put on
+// the edicts they link and unlink.  While watching, the edicts unlinked
+// from where they were at the start are kept for SV_UnlinkedEdicts
+
+int SV_UnlinkedEdicts (edict_t ***list);
+
+int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **list, int maxcount);
+// fills list with up to maxcount linked edicts whose abs box touches mins/maxs
+// and returns how many it found.  SOLID_NOT edicts are never linked, and
+// each edict is listed once, in no particular order
+
 void SV_LinkEdict (edict_t *ent, qboolean touch_triggers);
 // Needs to be called any time an entity changes origin, mins, maxs, or solid
 // flags ent->v.modified
@@ -65,6 +91,8 @@ int SV_TruePointContents (vec3_t p);
 
 edict_t	*SV_TestEntityPosition (edict_t *ent);
 qboolean SV_RecursiveHullCheck (hull_t *hull, int num, float p1f, float p2f, vec3_t p1, vec3_t p2, trace_t *trace);
+qboolean SV_HullCheck (hull_t *hull, int num, float p1f, float p2f, vec3_t p1, vec3_t p2, trace_t *trace);
+// same result as SV_RecursiveHullCheck, without the recursion
 
 trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict);
 // mins and maxs are reletive
@@ -78,3 +106,16 @@ trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, e
 // shouldn't be considered solid objects
 
 // passedict is explicitly excluded from clipping checks (normally NULL)
+
+void SV_MoveBounds (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, vec3_t boxmins, vec3_t boxmaxs);
+// the box SV_Move looks for edicts in
+
+void SV_MoveBatch (movequery_t *moves, int count, trace_t *traces);
+// SV_Move for each of count independent moves
+
+void SV_MoveParallel (movequery_t *moves, int count, trace_t *traces, qboolean *failed);
+// SV_MoveBatch on the worker threads, nothing may be linked meanwhile.
+// moves with failed set must be redone with SV_Move on the main thread
+
+void SV_TraceRecordFrame (void);
+void SV_TraceBench_f (void);